@@ -0,0 +1,642 @@
+// Copyright 2015 The MathWorks, Inc.
+#ifndef _eml_general_AtomicSharedRadixTree_hpp
+#define _eml_general_AtomicSharedRadixTree_hpp
+
+#include "SharedRadixTree.hpp"
+
+#include <mutex>
+#include <vector>
+
+#include <cassert>
+
+namespace EML
+{
+    namespace shared_radix_tree_detail
+    {
+        /// An `intrusive_shared_ptr` that may be loaded and replaced by
+        /// any number of threads at once, using split reference counting.
+        /// The pointer and a count of loads in progress share one word, so
+        /// a load first claims the pointer by incrementing that count, then
+        /// takes a use of its own and gives the claim back.  Replacing the
+        /// pointer moves the claims still outstanding onto the old
+        /// pointer's use count, so it cannot be destroyed under a load in
+        /// progress.  No operation waits for another: loads are a
+        /// `fetch_add` and a usually uncontended compare and swap, and
+        /// replacements a usually uncontended compare and swap.
+        ///
+        /// Every replacement also bumps a generation kept in the word, and a
+        /// load only gives its claim back to the word while the generation
+        /// is the one it claimed.  Comparing pointers alone is not enough,
+        /// since publishing a pointer again, as a no-op `update` or a
+        /// `store` of an older version does, starts its claims from zero.
+        /// Publishing the pointer already held leaves the word alone.  The
+        /// generation has 8 bits, so a load would only be confused by
+        /// exactly a multiple of 256 replacements ending with its own
+        /// pointer, all while it sits between its two atomic operations.
+        ///
+        /// Pointers must be 8-byte aligned and below `2^48`, as on x86-64
+        /// and AArch64, and up to 2047 loads may be in progress at once.
+        /// The use counts of `T` must be atomic.
+        template <typename T>
+        struct atomic_intrusive_shared_ptr
+        {
+            static_assert(sizeof(void*) == sizeof(std::uint64_t), "atomic_intrusive_shared_ptr requires 64-bit pointers");
+            static_assert(std::is_same<typename T::control_block_type::ref_count_type, multi_threaded>::value,
+                          "atomic_intrusive_shared_ptr requires multi_threaded use counts");
+
+            atomic_intrusive_shared_ptr()
+                : fWord(0)
+            {}
+
+            explicit atomic_intrusive_shared_ptr(intrusive_shared_ptr<T> ptr)
+                : fWord(pack(ptr.detach(), 0))
+            {}
+
+            atomic_intrusive_shared_ptr(atomic_intrusive_shared_ptr const&) = delete;
+            atomic_intrusive_shared_ptr& operator=(atomic_intrusive_shared_ptr const&) = delete;
+
+            ~atomic_intrusive_shared_ptr()
+            {
+                intrusive_shared_ptr<T>(pointer(fWord.load(std::memory_order_acquire)));
+            }
+
+            intrusive_shared_ptr<T> load() const
+            {
+                auto claimed = fWord.fetch_add(one_claim, std::memory_order_acquire);
+                auto ptr = pointer(claimed);
+                if (ptr) {
+                    block(ptr)->retain();
+                }
+                // Give the claim back, unless the pointer was replaced and
+                // the claim moved onto its use count.
+                auto word = claimed + one_claim;
+                while (version(word) == version(claimed)) {
+                    if (fWord.compare_exchange_weak(word, word - one_claim, std::memory_order_relaxed)) {
+                        return intrusive_shared_ptr<T>(ptr);
+                    }
+                }
+                // The moved claim and the use taken above are both this
+                // load's, so one is given back, and it cannot be the last.
+                if (ptr) {
+                    block(ptr)->release();
+                }
+                return intrusive_shared_ptr<T>(ptr);
+            }
+
+            intrusive_shared_ptr<T> exchange(intrusive_shared_ptr<T> desired)
+            {
+                auto word = fWord.load(std::memory_order_relaxed);
+                for (;;) {
+                    if (pointer(word) == desired.get()) {
+                        // The word keeps its use, and `desired` becomes the
+                        // use returned for the pointer replaced.
+                        return desired;
+                    }
+                    if (fWord.compare_exchange_weak(word, replacement(word, desired.get()), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                        desired.detach();
+                        return settle(word);
+                    }
+                }
+            }
+
+            void store(intrusive_shared_ptr<T> desired)
+            {
+                exchange(std::move(desired));
+            }
+
+            /// Return the pointer without taking a use of it, for a caller
+            /// that keeps it alive by other means.
+            T* peek() const
+            {
+                return pointer(fWord.load(std::memory_order_seq_cst));
+            }
+
+            /// Replace the pointer with `desired` if it is `expected`.
+            /// Otherwise, load the pointer into `expected`.
+            bool compare_exchange(intrusive_shared_ptr<T>& expected, intrusive_shared_ptr<T> desired)
+            {
+                auto word = fWord.load(std::memory_order_relaxed);
+                while (pointer(word) == expected.get()) {
+                    if (desired == expected) {
+                        return true;
+                    }
+                    // Claims come and go, so the whole word is compared and
+                    // a change in their count alone retries.
+                    if (fWord.compare_exchange_weak(word, replacement(word, desired.get()), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                        desired.detach();
+                        settle(word);
+                        return true;
+                    }
+                }
+                expected = load();
+                return false;
+            }
+
+          private:
+            /// The pointer shifted right by its three alignment bits, then
+            /// the generation, then the claims.
+            static int const pointer_bits = 45;
+            static int const generation_bits = 8;
+            static int const claim_shift = pointer_bits + generation_bits;
+            static std::uint64_t const one_generation = std::uint64_t(1) << pointer_bits;
+            static std::uint64_t const one_claim = std::uint64_t(1) << claim_shift;
+            static std::uint64_t const version_mask = one_claim - 1;
+
+            static std::uint64_t pack(T* ptr, std::uint64_t generation)
+            {
+                auto bits = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(ptr));
+                assert((bits & 7) == 0 && bits >> (pointer_bits + 3) == 0);
+                return bits >> 3 | (generation & (one_claim - one_generation));
+            }
+
+            static T* pointer(std::uint64_t word)
+            {
+                return reinterpret_cast<T*>(static_cast<std::uintptr_t>((word & (one_generation - 1)) << 3));
+            }
+
+            /// The pointer and the generation, which together change with
+            /// every replacement.
+            static std::uint64_t version(std::uint64_t word)
+            {
+                return word & version_mask;
+            }
+
+            /// The word replacing `word` to hold `ptr`, in the next
+            /// generation and with no claims.
+            static std::uint64_t replacement(std::uint64_t word, T* ptr)
+            {
+                return pack(ptr, word + one_generation);
+            }
+
+            static typename T::control_block_type* block(T* ptr)
+            {
+                return ptr;
+            }
+
+            /// Take over the use held by the replaced `word`, first moving
+            /// the claims still outstanding onto its use count.
+            static intrusive_shared_ptr<T> settle(std::uint64_t word)
+            {
+                auto ptr = pointer(word);
+                auto claims = static_cast<unsigned int>(word >> claim_shift);
+                if (ptr && claims != 0) {
+                    block(ptr)->retain(claims);
+                }
+                return intrusive_shared_ptr<T>(ptr);
+            }
+
+            mutable std::atomic<std::uint64_t> fWord;
+        };
+
+        /// Process-wide epoch-based reclamation.  A reader announces the
+        /// global epoch in a record of its own before reading shared
+        /// pointers, and withdraws it after.  Something retired in epoch `e`
+        /// may still be read by readers that announced `e` or `e - 1`, and
+        /// the epoch only advances once every active reader has announced
+        /// the current one, so it is safe to free from epoch `e + 2` on.
+        /// Each thread owns a record, padded to a cache line of its own and
+        /// reused by later threads after it exits, so entering and leaving
+        /// writes nothing another core reads on its fast path.
+        struct epoch_domain
+        {
+            static epoch_domain& get()
+            {
+                static epoch_domain result;
+                return result;
+            }
+
+            std::uint64_t epoch() const
+            {
+                return fEpoch.load(std::memory_order_seq_cst);
+            }
+
+            /// Announce the current epoch for this thread.  Nested calls
+            /// only count.
+            void enter()
+            {
+                auto& record = local_record();
+                if (record.fDepth++ == 0) {
+                    record.fState.store(fEpoch.load(std::memory_order_relaxed) << 1 | 1, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                }
+            }
+
+            void leave()
+            {
+                auto& record = local_record();
+                if (--record.fDepth == 0) {
+                    record.fState.store(0, std::memory_order_release);
+                }
+            }
+
+            /// Advance the epoch unless a reader has yet to announce the
+            /// current one, and return the resulting epoch.
+            std::uint64_t try_advance()
+            {
+                auto epoch = fEpoch.load(std::memory_order_seq_cst);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                for (auto record = fRecords.load(std::memory_order_acquire); record; record = record->fNext) {
+                    auto state = record->fState.load(std::memory_order_acquire);
+                    if ((state & 1) && state >> 1 != epoch) {
+                        return epoch;
+                    }
+                }
+                fEpoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+                return fEpoch.load(std::memory_order_seq_cst);
+            }
+
+          private:
+            struct record
+            {
+                /// The announced epoch shifted left by one, with the low
+                /// bit set while the owner is reading.
+                std::atomic<std::uint64_t> fState;
+                std::atomic<bool> fOwned;
+                int fDepth;
+                record* fNext;
+                char fPad[64];
+            };
+
+            /// Releases the record of an exiting thread.
+            struct owner
+            {
+                ~owner()
+                {
+                    if (fRecord) {
+                        fRecord->fOwned.store(false, std::memory_order_release);
+                    }
+                }
+
+                record* fRecord;
+            };
+
+            epoch_domain()
+                : fEpoch(0)
+                , fRecords(nullptr)
+            {}
+
+            record& local_record()
+            {
+                static thread_local owner local = {nullptr};
+                if (!local.fRecord) {
+                    local.fRecord = acquire_record();
+                }
+                return *local.fRecord;
+            }
+
+            /// Reuse a released record, or add a new one.  Records are never
+            /// freed, like the chunks of `pool_allocator`.
+            record* acquire_record()
+            {
+                for (auto record = fRecords.load(std::memory_order_acquire); record; record = record->fNext) {
+                    bool owned = false;
+                    if (!record->fOwned.load(std::memory_order_relaxed) &&
+                        record->fOwned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+                        return record;
+                    }
+                }
+                auto result = new record;
+                result->fState.store(0, std::memory_order_relaxed);
+                result->fOwned.store(true, std::memory_order_relaxed);
+                result->fDepth = 0;
+                result->fNext = fRecords.load(std::memory_order_relaxed);
+                while (!fRecords.compare_exchange_weak(result->fNext, result, std::memory_order_release, std::memory_order_relaxed)) {
+                }
+                return result;
+            }
+
+            std::atomic<std::uint64_t> fEpoch;
+            std::atomic<record*> fRecords;
+        };
+
+        /// A version published by an `atomic_shared_radix_tree`: the root of
+        /// a tree along with its size, which the root alone only gives in
+        /// `O(1)` for a `counted` tree.  The size is `unknown` if the tree
+        /// had not counted it yet.
+        /// @see lazy_size
+        template <typename Tree>
+        struct published_tree : control_block<multi_threaded>
+        {
+            typedef typename tree_access::node_of<Tree>::type node_type;
+
+            published_tree(intrusive_shared_ptr<node_type> root, typename Tree::size_type size)
+                : fRoot(std::move(root))
+                , fSize(size)
+            {}
+
+            static void destroy(published_tree* version)
+            {
+                delete version;
+            }
+
+            intrusive_shared_ptr<node_type> const fRoot;
+            typename Tree::size_type const fSize;
+        };
+
+        /// Read-only access to the version of an `atomic_shared_radix_tree`
+        /// that was current when it was borrowed, without taking a use of
+        /// any node.  While it exists, the calling thread holds the epoch,
+        /// so no node reachable from the version is freed; it should be
+        /// short-lived and stay on the thread that borrowed it.  Iterators
+        /// are valid for as long as it exists.
+        /// @see atomic_shared_radix_tree::borrow
+        template <typename Tree>
+        struct borrowed_shared_radix_tree
+        {
+            typedef typename Tree::key_type key_type;
+            typedef typename Tree::mapped_type mapped_type;
+            typedef typename Tree::value_type value_type;
+            typedef typename Tree::const_iterator const_iterator;
+            typedef typename Tree::size_type size_type;
+
+            borrowed_shared_radix_tree(borrowed_shared_radix_tree&& rhs)
+                : fRoot(rhs.fRoot)
+                , fSize(rhs.fSize)
+                , fAllocator(rhs.fAllocator)
+                , fEntered(rhs.fEntered)
+            {
+                rhs.fEntered = false;
+            }
+
+            borrowed_shared_radix_tree(borrowed_shared_radix_tree const&) = delete;
+            borrowed_shared_radix_tree& operator=(borrowed_shared_radix_tree const&) = delete;
+
+            ~borrowed_shared_radix_tree()
+            {
+                if (fEntered) {
+                    epoch_domain::get().leave();
+                }
+            }
+
+            /// `O(min(log(n), sizeof(Key)))`
+            const_iterator find(key_type const& key) const
+            {
+                if (fRoot) {
+                    if (auto leaf = find_leaf(fRoot, key)) {
+                        return const_iterator(fRoot, &leaf->get());
+                    }
+                }
+                return const_iterator();
+            }
+
+            /// `O(min(log(n), sizeof(Key)))`
+            size_type count(key_type const& key) const
+            {
+                return find(key) != end() ? 1 : 0;
+            }
+
+            /// `O(sizeof(Key))`
+            const_iterator begin() const
+            {
+                return const_iterator(fRoot);
+            }
+
+            const_iterator end() const
+            {
+                return const_iterator();
+            }
+
+            bool empty() const
+            {
+                return !fRoot;
+            }
+
+            /// `O(1)`, unless the version was published before it counted
+            /// its values, in which case they are counted in `O(n)`.
+            size_type size() const
+            {
+                if (fSize == lazy_size<size_type>::unknown()) {
+                    return fRoot ? subtree_size(fRoot) : 0;
+                }
+                return fSize;
+            }
+
+            /// Take a use of the borrowed version, which then outlives this
+            /// borrow.  `O(1)`
+            Tree snapshot() const
+            {
+                intrusive_shared_ptr<node_type> borrowed(fRoot);
+                auto root = borrowed;
+                borrowed.detach();
+                Tree result(fAllocator);
+                tree_access::reset(result, std::move(root), fSize);
+                return result;
+            }
+
+          private:
+            template <typename>
+            friend struct atomic_shared_radix_tree;
+
+            typedef typename tree_access::node_of<Tree>::type node_type;
+            typedef typename Tree::allocator_type allocator_type;
+
+            template <typename Version>
+            borrowed_shared_radix_tree(Version const& version, allocator_type const& alloc)
+                : fRoot(nullptr)
+                , fSize(0)
+                , fAllocator(alloc)
+                , fEntered(true)
+            {
+                epoch_domain::get().enter();
+                if (auto published = version.peek()) {
+                    fRoot = published->fRoot.get();
+                    fSize = published->fSize;
+                }
+            }
+
+            node_type* fRoot;
+            size_type fSize;
+            allocator_type fAllocator;
+            bool fEntered;
+        };
+
+        /// Holds the current version of a `SharedRadixTree` for one or more
+        /// writers publishing new versions and any number of readers taking
+        /// snapshots, without locks.  `load` returns the current version in
+        /// `O(1)`, a tree that stays as it was however many versions are
+        /// published after it.  `update` applies a change to a copy of the
+        /// current version and publishes it if no other version was
+        /// published in the meantime, retrying otherwise.  Readers never
+        /// wait for writers or for one another.  The tree must be
+        /// `multi_threaded`, and its allocator safe to use from several
+        /// threads, as `new_allocator` and `pool_allocator` are.  Each
+        /// version is published in a small block holding its root and its
+        /// size, so a loaded tree knows its size without counting it.
+        ///
+        /// `borrow` reads the current version without writing to any
+        /// shared memory, so reads scale with the number of cores where
+        /// `load` makes them all increment the same use count.  Replaced
+        /// versions are retired rather than released, and released by a
+        /// later write once every reader that could have borrowed them has
+        /// left.  This delays the freeing of replaced nodes by a few writes.
+        /// @see epoch_domain
+        template <typename Tree>
+        struct atomic_shared_radix_tree
+        {
+            static_assert(std::is_same<typename tree_access::node_of<Tree>::type::control_block_type::ref_count_type, multi_threaded>::value,
+                          "atomic_shared_radix_tree requires multi_threaded use counts");
+            static_assert(concurrent_allocation<typename Tree::allocator_type>::value,
+                          "atomic_shared_radix_tree requires an allocator allowing concurrent allocation");
+
+            typedef Tree value_type;
+            typedef typename Tree::allocator_type allocator_type;
+
+            explicit atomic_shared_radix_tree(Tree tree = Tree())
+                : fAllocator(tree.get_allocator())
+                , fVersion(publish(tree))
+            {}
+
+            atomic_shared_radix_tree(atomic_shared_radix_tree const&) = delete;
+            atomic_shared_radix_tree& operator=(atomic_shared_radix_tree const&) = delete;
+
+            /// `O(1)`
+            Tree load() const
+            {
+                return make(fVersion.load());
+            }
+
+            /// Read the current version without taking a use of it.  `O(1)`
+            /// @see borrowed_shared_radix_tree
+            borrowed_shared_radix_tree<Tree> borrow() const
+            {
+                return borrowed_shared_radix_tree<Tree>(fVersion, fAllocator);
+            }
+
+            /// `O(1)`
+            void store(Tree tree)
+            {
+                retire(fVersion.exchange(publish(tree)));
+            }
+
+            /// Publish `tree` and return the version it replaced.  `O(1)`
+            Tree exchange(Tree tree)
+            {
+                auto version = fVersion.exchange(publish(tree));
+                auto result = make(version);
+                retire(std::move(version));
+                return result;
+            }
+
+            /// Publish `desired` if the current version is `expected`, by
+            /// identity of their roots rather than by value.  Otherwise,
+            /// load the current version into `expected`.  `O(1)`
+            bool compare_exchange(Tree& expected, Tree desired)
+            {
+                auto& root = tree_access::root(expected);
+                auto current = fVersion.load();
+                if (root_of(current) == root.get()) {
+                    if (tree_access::root(desired) == root) {
+                        return true;
+                    }
+                    auto next = publish(desired);
+                    do {
+                        // A failed exchange loads the newer version into
+                        // `current`, which may still hold the same root.
+                        if (fVersion.compare_exchange(current, next)) {
+                            retire(std::move(current));
+                            return true;
+                        }
+                    } while (root_of(current) == root.get());
+                }
+                expected = make(current);
+                return false;
+            }
+
+            /// Call `f` with a copy of the current version to modify, and
+            /// publish the result, retrying with the newer version if
+            /// another was published first.  `f` may be called more than
+            /// once and should do nothing but modify its argument.  Return
+            /// the version published.
+            template <typename Function>
+            Tree update(Function f)
+            {
+                auto current = load();
+                for (;;) {
+                    auto next = current;
+                    f(next);
+                    if (compare_exchange(current, next)) {
+                        return next;
+                    }
+                }
+            }
+
+            /// Release the retired versions no reader can still be reading,
+            /// which writes otherwise do in passing.
+            void reclaim()
+            {
+                std::vector<intrusive_shared_ptr<version_type>> released;
+                std::lock_guard<std::mutex> lock(fRetiredMutex);
+                reclaim(released);
+            }
+
+          private:
+            typedef published_tree<Tree> version_type;
+            typedef typename version_type::node_type node_type;
+
+            /// The version holding `tree`, or `nullptr` for an empty tree.
+            static intrusive_shared_ptr<version_type> publish(Tree const& tree)
+            {
+                if (tree.empty()) {
+                    return nullptr;
+                }
+                return intrusive_shared_ptr<version_type>(new version_type(tree_access::root(tree), tree_access::stored_size(tree)));
+            }
+
+            static node_type* root_of(intrusive_shared_ptr<version_type> const& version)
+            {
+                return version ? version->fRoot.get() : nullptr;
+            }
+
+            Tree make(intrusive_shared_ptr<version_type> const& version) const
+            {
+                Tree result(fAllocator);
+                if (version) {
+                    tree_access::reset(result, version->fRoot, version->fSize);
+                }
+                return result;
+            }
+
+            /// Keep the replaced `version` until no reader can have borrowed
+            /// it.
+            void retire(intrusive_shared_ptr<version_type> version)
+            {
+                if (!version) {
+                    return;
+                }
+                // Declared before the lock so that nodes are freed after it
+                // is released.
+                std::vector<intrusive_shared_ptr<version_type>> released;
+                std::lock_guard<std::mutex> lock(fRetiredMutex);
+                fRetired.emplace_back(epoch_domain::get().epoch(), std::move(version));
+                reclaim(released);
+            }
+
+            void reclaim(std::vector<intrusive_shared_ptr<version_type>>& released)
+            {
+                auto& domain = epoch_domain::get();
+                domain.try_advance();
+                auto epoch = domain.try_advance();
+                auto kept = fRetired.begin();
+                for (auto& retired : fRetired) {
+                    if (retired.first + 2 <= epoch) {
+                        released.push_back(std::move(retired.second));
+                    } else {
+                        *kept++ = std::move(retired);
+                    }
+                }
+                fRetired.erase(kept, fRetired.end());
+            }
+
+            allocator_type const fAllocator;
+            atomic_intrusive_shared_ptr<version_type> fVersion;
+            std::mutex fRetiredMutex;
+            /// Replaced versions by the epoch they were replaced in.
+            std::vector<std::pair<std::uint64_t, intrusive_shared_ptr<version_type>>> fRetired;
+        };
+    }
+
+    using shared_radix_tree_detail::atomic_shared_radix_tree;
+    using shared_radix_tree_detail::borrowed_shared_radix_tree;
+}
+
+#endif
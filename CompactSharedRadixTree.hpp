@@ -0,0 +1,940 @@
+// Copyright 2015 The MathWorks, Inc.
+#ifndef _eml_general_CompactSharedRadixTree_hpp
+#define _eml_general_CompactSharedRadixTree_hpp
+
+#include "SharedRadixTree.hpp"
+
+#include <stdexcept>
+
+namespace EML
+{
+    namespace shared_radix_tree_detail
+    {
+        /// Reference to a node of a tree with `compact_nodes`: the index of
+        /// the node among the nodes of its kind in the arena, shifted left
+        /// by one, with the low bit set for a leaf.
+        typedef std::uint32_t compact_ref;
+
+        /// The empty tree.  No node is allocated at the last index.
+        compact_ref const compact_null = ~static_cast<compact_ref>(0);
+
+        inline bool compact_is_leaf(compact_ref ref)
+        {
+            return (ref & 1) != 0;
+        }
+
+        inline std::uint32_t compact_index(compact_ref ref)
+        {
+            return ref >> 1;
+        }
+
+        /// Use count at the start of both kinds of compact node.  The kind
+        /// is kept in the references to a node rather than in the node.
+        struct compact_node
+        {
+            compact_node()
+                : fUseCount(1)
+            {}
+
+            std::uint32_t fUseCount;
+        };
+
+        /// Branch of a tree with `compact_nodes`.  The prefix and the mask
+        /// share one field, holding the prefix with every bit below the
+        /// mask's bit set.  The mask's bit is the lowest clear bit, so a
+        /// branch of 32-bit keys takes 16 bytes.
+        template <typename Bits>
+        struct compact_branch : compact_node
+        {
+            compact_branch(Bits prefixMask, compact_ref left, compact_ref right)
+                : fLeft(left)
+                , fRight(right)
+                , fPrefixMask(prefixMask)
+            {}
+
+            Bits prefix() const
+            {
+                return static_cast<Bits>(fPrefixMask & (fPrefixMask + 1));
+            }
+
+            Bits mask() const
+            {
+                return static_cast<Bits>(~fPrefixMask & (fPrefixMask + 1));
+            }
+
+            /// @see not_mem
+            bool not_mem(Bits bits) const
+            {
+                auto m = mask();
+                // `m + (m - 1)` wraps to all bits set at the highest mask.
+                return ((bits ^ fPrefixMask) & static_cast<Bits>(~static_cast<Bits>(m + (m - 1)))) != 0;
+            }
+
+            bool right(Bits bits) const
+            {
+                return (bits & mask()) != 0;
+            }
+
+            compact_ref& child(bool right)
+            {
+                return right ? fRight : fLeft;
+            }
+
+            compact_ref fLeft;
+            compact_ref fRight;
+            Bits fPrefixMask;
+        };
+
+        template <typename Key, typename T>
+        struct compact_leaf : compact_node
+        {
+            typedef Key key_type;
+            typedef T mapped_type;
+            typedef std::pair<key_type const, mapped_type> value_type;
+
+            template <typename KeyArgs, typename MappedArgs>
+            compact_leaf(std::piecewise_construct_t, KeyArgs&& keyArgs, MappedArgs&& mappedArgs)
+                : fValue(std::piecewise_construct, std::forward<KeyArgs>(keyArgs), std::forward<MappedArgs>(mappedArgs))
+            {}
+
+            value_type fValue;
+        };
+
+        /// Storage for the nodes of one kind, found by index.  Slabs double
+        /// in size, starting small enough that a small tree stays small,
+        /// and never move, so nodes keep their addresses.  Freed slots are
+        /// kept on a list threaded through the slots and reused first.
+        template <typename Node, typename Allocator>
+        struct compact_pool
+        {
+            compact_pool()
+                : fSize(0)
+                , fFree(none)
+                , fSlabCount(0)
+            {}
+
+            compact_pool(compact_pool const&) = delete;
+            compact_pool& operator=(compact_pool const&) = delete;
+
+            /// Every node must already be destroyed.
+            ~compact_pool()
+            {
+                for (unsigned i = 0; i != fSlabCount; ++i) {
+                    Allocator::deallocate(fSlabs[i], slab_size(i) * sizeof(slot));
+                }
+            }
+
+            Node* get(std::uint32_t index) const
+            {
+                auto offset = index + first_slab_size;
+                auto slab = static_cast<unsigned>(log2(offset));
+                return reinterpret_cast<Node*>(fSlabs[slab - first_slab_bits] + (offset - (static_cast<std::uint32_t>(1) << slab)));
+            }
+
+            /// Return the index of an unconstructed slot.
+            std::uint32_t allocate(Allocator& alloc)
+            {
+                if (fFree != none) {
+                    auto index = fFree;
+                    fFree = *reinterpret_cast<std::uint32_t*>(get(index));
+                    return index;
+                }
+                if (fSize == capacity(fSlabCount)) {
+                    if (fSlabCount == max_slabs) {
+                        throw std::length_error("compact_nodes arena is full");
+                    }
+                    fSlabs[fSlabCount] = static_cast<slot*>(alloc.allocate(slab_size(fSlabCount) * sizeof(slot)));
+                    ++fSlabCount;
+                }
+                return fSize++;
+            }
+
+            /// Return the slot at `index`, whose node is destroyed.
+            void deallocate(std::uint32_t index)
+            {
+                ::new (static_cast<void*>(get(index))) std::uint32_t(fFree);
+                fFree = index;
+            }
+
+            /// Bytes of slabs held.
+            std::size_t capacity_bytes() const
+            {
+                return capacity(fSlabCount) * sizeof(slot);
+            }
+
+          private:
+            typedef typename std::aligned_storage<sizeof(Node), alignof(Node)>::type slot;
+
+            static const unsigned first_slab_bits = 6;
+            static const std::uint32_t first_slab_size = static_cast<std::uint32_t>(1) << first_slab_bits;
+            /// Keeps indices below `2^31 - first_slab_size`, so that every
+            /// reference fits in a `compact_ref` and none is `compact_null`.
+            static const unsigned max_slabs = 31 - first_slab_bits;
+            static const std::uint32_t none = ~static_cast<std::uint32_t>(0);
+
+            static std::size_t slab_size(unsigned slab)
+            {
+                return static_cast<std::size_t>(first_slab_size) << slab;
+            }
+
+            static std::uint32_t capacity(unsigned slabCount)
+            {
+                return first_slab_size * ((static_cast<std::uint32_t>(1) << slabCount) - 1);
+            }
+
+            std::uint32_t fSize;
+            std::uint32_t fFree;
+            unsigned fSlabCount;
+            slot* fSlabs[max_slabs];
+        };
+
+        /// The nodes of a tree with `compact_nodes` and of all its copies.
+        /// Use counts are not atomic and the pools are not locked, so the
+        /// trees sharing an arena must stay on one thread.
+        template <typename Key, typename T, typename Allocator>
+        struct compact_arena
+        {
+            typedef typename std::make_unsigned<Key>::type bits_type;
+            typedef compact_branch<bits_type> branch_type;
+            typedef compact_leaf<Key, T> leaf_type;
+
+            explicit compact_arena(Allocator const& alloc)
+                : fAllocator(alloc)
+            {}
+
+            branch_type* branch(compact_ref ref) const
+            {
+                return fBranches.get(compact_index(ref));
+            }
+
+            leaf_type* leaf(compact_ref ref) const
+            {
+                return fLeaves.get(compact_index(ref));
+            }
+
+            compact_node* node(compact_ref ref) const
+            {
+                if (compact_is_leaf(ref)) {
+                    return leaf(ref);
+                }
+                return branch(ref);
+            }
+
+            bool unique(compact_ref ref) const
+            {
+                return node(ref)->fUseCount == 1;
+            }
+
+            /// The lowest key bits under `ref`, enough to place it in a
+            /// parent.
+            bits_type bits(compact_ref ref) const
+            {
+                if (compact_is_leaf(ref)) {
+                    return static_cast<bits_type>(leaf(ref)->fValue.first);
+                }
+                return branch(ref)->prefix();
+            }
+
+            void retain(compact_ref ref)
+            {
+                ++node(ref)->fUseCount;
+            }
+
+            /// Release a use of `ref`.  If it was the last, `ref` and every
+            /// node only it uses are destroyed, with a worklist bounded as
+            /// in `node::destroy`.  Null children are skipped.
+            void release(compact_ref ref)
+            {
+                if (--node(ref)->fUseCount != 0) {
+                    return;
+                }
+                compact_ref stack[sizeof(bits_type) * CHAR_BIT + 1];
+                int depth = 0;
+                stack[depth++] = ref;
+                while (depth != 0) {
+                    ref = stack[--depth];
+                    if (compact_is_leaf(ref)) {
+                        leaf(ref)->~leaf_type();
+                        fLeaves.deallocate(compact_index(ref));
+                        continue;
+                    }
+                    auto aBranch = branch(ref);
+                    compact_ref children[] = {aBranch->fLeft, aBranch->fRight};
+                    for (auto child : children) {
+                        if (child != compact_null && --node(child)->fUseCount == 0) {
+                            stack[depth++] = child;
+                        }
+                    }
+                    aBranch->~branch_type();
+                    fBranches.deallocate(compact_index(ref));
+                }
+            }
+
+            /// A new leaf holding the value of `source`.
+            /// @see leaf_source
+            template <typename Source>
+            compact_ref make_leaf(Source& source)
+            {
+                auto index = fLeaves.allocate(fAllocator);
+                try {
+                    ::new (static_cast<void*>(fLeaves.get(index))) leaf_type(std::piecewise_construct, std::forward_as_tuple(source.fKey), std::move(source.fMappedArgs));
+                } catch (...) {
+                    fLeaves.deallocate(index);
+                    throw;
+                }
+                return index << 1 | 1;
+            }
+
+            /// A new branch taking a use of each child.
+            compact_ref make_branch(bits_type prefixMask, compact_ref left, compact_ref right)
+            {
+                auto index = fBranches.allocate(fAllocator);
+                ::new (static_cast<void*>(fBranches.get(index))) branch_type(prefixMask, left, right);
+                return index << 1;
+            }
+
+            /// A new branch over `ref1` and `ref2`, which hold keys beginning
+            /// with `bits1` and `bits2`, taking a use of each.
+            compact_ref join(bits_type bits1, compact_ref ref1, bits_type bits2, compact_ref ref2)
+            {
+                typedef typename std::common_type<bits_type, unsigned>::type promoted_type;
+                auto mask = static_cast<bits_type>(static_cast<promoted_type>(1) << log2(static_cast<promoted_type>(bits1 ^ bits2)));
+                auto prefixMask = static_cast<bits_type>((bits1 & static_cast<bits_type>(~static_cast<bits_type>(mask + (mask - 1)))) | (mask - 1));
+                if (bits1 & mask) {
+                    return make_branch(prefixMask, ref2, ref1);
+                }
+                return make_branch(prefixMask, ref1, ref2);
+            }
+
+            Allocator const& allocator() const
+            {
+                return fAllocator;
+            }
+
+            /// Bytes of slabs held by both pools.
+            std::size_t capacity_bytes() const
+            {
+                return fBranches.capacity_bytes() + fLeaves.capacity_bytes();
+            }
+
+          private:
+            Allocator fAllocator;
+            compact_pool<branch_type, Allocator> fBranches;
+            compact_pool<leaf_type, Allocator> fLeaves;
+        };
+
+        /// Forward iterator over a tree with `compact_nodes`.  The stack
+        /// holds the references of the right subtrees yet to be visited,
+        /// and is built lazily for iterators returned from `find` or
+        /// `insert`.
+        template <typename Arena, typename ValueType>
+        struct compact_iterator
+        {
+            template <typename, typename>
+            friend struct compact_iterator;
+
+            typedef std::forward_iterator_tag iterator_category;
+            typedef typename std::remove_const<ValueType>::type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef ValueType* pointer;
+            typedef ValueType& reference;
+
+            compact_iterator()
+                : fValue(nullptr)
+                , fArena(nullptr)
+                , fRoot(compact_null)
+                , fDepth(0)
+            {}
+
+            /// Construct an iterator pointing to the least value under
+            /// `root`.
+            compact_iterator(Arena const* arena, compact_ref root)
+                : fValue(nullptr)
+                , fArena(arena)
+                , fRoot(root)
+                , fDepth(0)
+            {
+                if (root != compact_null) {
+                    descend(root);
+                }
+            }
+
+            /// Construct an iterator pointing to `value` under `root`.
+            compact_iterator(Arena const* arena, compact_ref root, ValueType* value)
+                : fValue(value)
+                , fArena(arena)
+                , fRoot(root)
+                , fDepth(unbuilt)
+            {}
+
+            compact_iterator(compact_iterator const& i)
+                : fValue(i.fValue)
+                , fArena(i.fArena)
+                , fRoot(i.fRoot)
+                , fDepth(i.fDepth)
+            {
+                copy_stack(i);
+            }
+
+            template <typename OtherValueType>
+            compact_iterator(compact_iterator<Arena, OtherValueType> const& i)
+                : fValue(i.fValue)
+                , fArena(i.fArena)
+                , fRoot(i.fRoot)
+                , fDepth(i.fDepth)
+            {
+                copy_stack(i);
+            }
+
+            compact_iterator& operator=(compact_iterator const& i)
+            {
+                fValue = i.fValue;
+                fArena = i.fArena;
+                fRoot = i.fRoot;
+                fDepth = i.fDepth;
+                copy_stack(i);
+                return *this;
+            }
+
+            ValueType& operator*() const
+            {
+                return *fValue;
+            }
+
+            ValueType* operator->() const
+            {
+                return fValue;
+            }
+
+            compact_iterator& operator++()
+            {
+                if (fDepth == unbuilt) {
+                    build_stack();
+                }
+                if (fDepth == 0) {
+                    fValue = nullptr;
+                } else {
+                    descend(fStack[--fDepth]);
+                }
+                return *this;
+            }
+
+            compact_iterator operator++(int)
+            {
+                compact_iterator result(*this);
+                ++*this;
+                return result;
+            }
+
+            friend bool operator==(compact_iterator const& lhs, compact_iterator const& rhs)
+            {
+                return lhs.fValue == rhs.fValue;
+            }
+
+            friend bool operator!=(compact_iterator const& lhs, compact_iterator const& rhs)
+            {
+                return lhs.fValue != rhs.fValue;
+            }
+
+          private:
+            typedef typename Arena::bits_type bits_type;
+
+            static const int max_depth = sizeof(bits_type) * CHAR_BIT;
+
+            static const int unbuilt = -1;
+
+            template <typename OtherValueType>
+            void copy_stack(compact_iterator<Arena, OtherValueType> const& i)
+            {
+                if (fDepth > 0) {
+                    std::copy(i.fStack, i.fStack + fDepth, fStack);
+                }
+            }
+
+            void descend(compact_ref ref)
+            {
+                while (!compact_is_leaf(ref)) {
+                    auto branch = fArena->branch(ref);
+                    fStack[fDepth++] = branch->fRight;
+                    ref = branch->fLeft;
+                }
+                fValue = &fArena->leaf(ref)->fValue;
+            }
+
+            void build_stack()
+            {
+                fDepth = 0;
+                auto bits = static_cast<bits_type>(fValue->first);
+                auto ref = fRoot;
+                while (!compact_is_leaf(ref)) {
+                    auto branch = fArena->branch(ref);
+                    if (branch->right(bits)) {
+                        ref = branch->fRight;
+                    } else {
+                        fStack[fDepth++] = branch->fRight;
+                        ref = branch->fLeft;
+                    }
+                }
+            }
+
+            ValueType* fValue;
+            Arena const* fArena;
+            compact_ref fRoot;
+            int fDepth;
+            compact_ref fStack[max_depth];
+        };
+
+        /// Put `ref` in place of the node at `depth` on `path`, copying the
+        /// branches from `shared`, the depth of the first node shared with
+        /// another tree, down.  The use of `ref` is taken.  The node
+        /// replaced is released if any branch was copied, since the slot
+        /// rewritten then held the first shared node, and otherwise only if
+        /// `releaseOld`.
+        template <typename Arena>
+        void compact_replace(Arena& arena,
+                             compact_ref& root,
+                             typename Arena::branch_type* const* path,
+                             int depth,
+                             int shared,
+                             typename Arena::bits_type bits,
+                             compact_ref ref,
+                             bool releaseOld)
+        {
+            int i = depth - 1;
+            try {
+                for (; i >= shared; --i) {
+                    auto aBranch = path[i];
+                    auto right = aBranch->right(bits);
+                    auto sibling = aBranch->child(!right);
+                    ref = right ? arena.make_branch(aBranch->fPrefixMask, sibling, ref) : arena.make_branch(aBranch->fPrefixMask, ref, sibling);
+                    arena.retain(sibling);
+                }
+            } catch (...) {
+                arena.release(ref);
+                throw;
+            }
+            auto& slot = i < 0 ? root : path[i]->child(path[i]->right(bits));
+            auto old = slot;
+            slot = ref;
+            if (i != depth - 1 || releaseOld) {
+                arena.release(old);
+            }
+        }
+
+        /// Insert the value of `source` under `root`.  Branches above the
+        /// first shared node are updated in place, and the rest of the
+        /// path is copied.
+        /// @see insert_value
+        template <typename Arena, typename Source>
+        std::pair<typename Arena::leaf_type::value_type*, bool> compact_insert(Arena& arena, compact_ref& root, Source& source)
+        {
+            typedef typename Arena::bits_type bits_type;
+            typedef typename Arena::branch_type branch_type;
+            auto bits = static_cast<bits_type>(source.key());
+            branch_type* path[sizeof(bits_type) * CHAR_BIT];
+            int depth = 0;
+            int shared = -1;
+            auto ref = root;
+            for (;;) {
+                if (shared < 0 && !arena.unique(ref)) {
+                    shared = depth;
+                }
+                if (compact_is_leaf(ref)) {
+                    break;
+                }
+                auto aBranch = arena.branch(ref);
+                if (aBranch->not_mem(bits)) {
+                    break;
+                }
+                path[depth++] = aBranch;
+                ref = aBranch->child(aBranch->right(bits));
+            }
+            if (shared < 0) {
+                shared = depth + 1;
+            }
+            if (compact_is_leaf(ref)) {
+                auto& value = arena.leaf(ref)->fValue;
+                if (source.key() == value.first) {
+                    if (!Source::assigns::value) {
+                        return std::make_pair(&value, false);
+                    }
+                    if (shared > depth) {
+                        source.assign(value.second);
+                        return std::make_pair(&value, false);
+                    }
+                    auto leaf = arena.make_leaf(source);
+                    compact_replace(arena, root, path, depth, shared, bits, leaf, true);
+                    return std::make_pair(&arena.leaf(leaf)->fValue, false);
+                }
+            }
+            auto leaf = arena.make_leaf(source);
+            // The use of `ref` held by its slot moves into the new branch
+            // when the slot is rewritten in place.
+            auto inPlace = shared >= depth;
+            compact_ref joined;
+            try {
+                joined = arena.join(bits, leaf, arena.bits(ref), ref);
+            } catch (...) {
+                arena.release(leaf);
+                throw;
+            }
+            if (!inPlace) {
+                arena.retain(ref);
+            }
+            compact_replace(arena, root, path, depth, shared, bits, joined, false);
+            return std::make_pair(&arena.leaf(leaf)->fValue, true);
+        }
+
+        /// Erase `key` under `root`, returning the number of values erased.
+        /// @see compact_insert
+        template <typename Arena>
+        int compact_erase(Arena& arena, compact_ref& root, typename Arena::leaf_type::key_type const& key)
+        {
+            typedef typename Arena::bits_type bits_type;
+            typedef typename Arena::branch_type branch_type;
+            auto bits = static_cast<bits_type>(key);
+            branch_type* path[sizeof(bits_type) * CHAR_BIT];
+            int depth = 0;
+            int shared = -1;
+            auto ref = root;
+            while (!compact_is_leaf(ref)) {
+                auto aBranch = arena.branch(ref);
+                if (aBranch->not_mem(bits)) {
+                    return 0;
+                }
+                if (shared < 0 && aBranch->fUseCount != 1) {
+                    shared = depth;
+                }
+                path[depth++] = aBranch;
+                ref = aBranch->child(aBranch->right(bits));
+            }
+            if (key != arena.leaf(ref)->fValue.first) {
+                return 0;
+            }
+            if (depth == 0) {
+                root = compact_null;
+                arena.release(ref);
+                return 1;
+            }
+            if (shared < 0) {
+                shared = depth;
+            }
+            // The sibling of the leaf replaces their parent.  A parent on
+            // the unique part of the path is destroyed, so its use of the
+            // sibling moves to the parent's slot.
+            auto parent = path[depth - 1];
+            auto& sibling = parent->child(!parent->right(bits));
+            auto replacement = sibling;
+            if (shared >= depth) {
+                sibling = compact_null;
+            } else {
+                arena.retain(replacement);
+            }
+            compact_replace(arena, root, path, depth - 1, shared, bits, replacement, true);
+            return 1;
+        }
+
+        /// Return the value under `root` whose key is `key`, or `nullptr`.
+        template <typename Arena>
+        typename Arena::leaf_type::value_type* compact_find(Arena const& arena, compact_ref root, typename Arena::leaf_type::key_type const& key)
+        {
+            typedef typename Arena::bits_type bits_type;
+            auto bits = static_cast<bits_type>(key);
+            while (!compact_is_leaf(root)) {
+                auto branch = arena.branch(root);
+                if (branch->not_mem(bits)) {
+                    return nullptr;
+                }
+                root = branch->child(branch->right(bits));
+            }
+            auto& value = arena.leaf(root)->fValue;
+            if (key != value.first) {
+                return nullptr;
+            }
+            return &value;
+        }
+
+        /// `SharedRadixTree` whose nodes live in an arena shared by the tree
+        /// and its copies, and refer to one another by 32-bit index with
+        /// the kind of node in the low bit.  A branch of 32-bit keys takes
+        /// 16 bytes rather than 32, a leaf carries 4 bytes beside its value,
+        /// and nodes are packed into slabs without a header per node.  The
+        /// price is an indirection through the arena at each level.  Like
+        /// the binary layout, copies share nodes and copy paths on write,
+        /// but the arena is freed only with the last tree using it, and
+        /// reuses the storage of nodes freed before.  `Key` must be
+        /// integral and `RefCount` `single_threaded`.  `Prefix` and `Mask`
+        /// are unused, `Counts` must be `uncounted`, and `Metrics` must be
+        /// `no_metrics`.  The interface is that of `wide_nodes`.
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics
+            >
+        struct SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, compact_nodes, Metrics>
+        {
+            static_assert(std::is_integral<Key>::value, "compact_nodes requires integral keys");
+            static_assert(std::is_same<RefCount, single_threaded>::value, "compact_nodes requires single_threaded use counts");
+            static_assert(std::is_same<Counts, uncounted>::value, "compact_nodes does not support counted branches");
+            static_assert(std::is_same<Metrics, no_metrics>::value, "compact_nodes does not support metrics");
+
+          private:
+            typedef compact_arena<Key, T, Allocator> arena_type;
+            typedef typename arena_type::leaf_type leaf_type;
+
+          public:
+            typedef typename leaf_type::key_type key_type;
+            typedef typename leaf_type::mapped_type mapped_type;
+            typedef typename leaf_type::value_type value_type;
+            typedef compact_iterator<arena_type, value_type> iterator;
+            typedef compact_iterator<arena_type, value_type const> const_iterator;
+            typedef int size_type;
+            typedef key_less<Key, Prefix> key_compare;
+            typedef Allocator allocator_type;
+
+            SharedRadixTree()
+                : fRoot(compact_null)
+                , fSize(0)
+            {}
+
+            explicit SharedRadixTree(allocator_type const& alloc)
+                : fAllocator(alloc)
+                , fRoot(compact_null)
+                , fSize(0)
+            {}
+
+            SharedRadixTree(SharedRadixTree const& rhs)
+                : fAllocator(rhs.fAllocator)
+                , fArena(rhs.fArena)
+                , fRoot(rhs.fRoot)
+                , fSize(rhs.fSize)
+            {
+                if (fRoot != compact_null) {
+                    fArena->retain(fRoot);
+                }
+            }
+
+            SharedRadixTree(SharedRadixTree&& rhs)
+                : fAllocator(std::move(rhs.fAllocator))
+                , fArena(std::move(rhs.fArena))
+                , fRoot(rhs.fRoot)
+                , fSize(rhs.fSize)
+            {
+                rhs.fRoot = compact_null;
+                rhs.fSize = 0;
+            }
+
+            ~SharedRadixTree()
+            {
+                clear();
+            }
+
+            SharedRadixTree& operator=(SharedRadixTree rhs)
+            {
+                swap(rhs);
+                return *this;
+            }
+
+            void swap(SharedRadixTree& rhs)
+            {
+                using std::swap;
+                swap(fAllocator, rhs.fAllocator);
+                swap(fArena, rhs.fArena);
+                swap(fRoot, rhs.fRoot);
+                swap(fSize, rhs.fSize);
+            }
+
+            allocator_type get_allocator() const
+            {
+                return fAllocator;
+            }
+
+            key_compare key_comp() const
+            {
+                return key_compare();
+            }
+
+            /// `O(sizeof(Key))`
+            std::pair<iterator, bool> insert(value_type const& value)
+            {
+                auto source = make_leaf_source<leaf_type, std::false_type>(value.first, std::forward_as_tuple(value.second));
+                return insert_impl(source);
+            }
+
+            /// `O(sizeof(Key))`
+            std::pair<iterator, bool> insert(value_type&& value)
+            {
+                auto source = make_leaf_source<leaf_type, std::false_type>(value.first, std::forward_as_tuple(std::move(value.second)));
+                return insert_impl(source);
+            }
+
+            /// `O(sizeof(Key))`
+            template <typename... Args>
+            std::pair<iterator, bool> emplace(Args&&... args)
+            {
+                return insert(value_type(std::forward<Args>(args)...));
+            }
+
+            /// `O(sizeof(Key))`
+            template <typename... Args>
+            std::pair<iterator, bool> try_emplace(key_type const& key, Args&&... args)
+            {
+                auto source = make_leaf_source<leaf_type, std::false_type>(key, std::forward_as_tuple(std::forward<Args>(args)...));
+                return insert_impl(source);
+            }
+
+            /// `O(sizeof(Key))`
+            template <typename M>
+            std::pair<iterator, bool> insert_or_assign(key_type const& key, M&& obj)
+            {
+                auto source = make_leaf_source<leaf_type, std::true_type>(key, std::forward_as_tuple(std::forward<M>(obj)));
+                return insert_impl(source);
+            }
+
+            /// `O(sizeof(Key))`
+            iterator find(key_type const& key)
+            {
+                return find_impl(this, key);
+            }
+
+            /// `O(sizeof(Key))`
+            const_iterator find(key_type const& key) const
+            {
+                return find_impl(this, key);
+            }
+
+            /// `O(sizeof(Key))`
+            size_type erase(key_type const& key)
+            {
+                if (fRoot == compact_null) {
+                    return 0;
+                }
+                auto result = compact_erase(*fArena, fRoot, key);
+                fSize -= result;
+                return result;
+            }
+
+            /// `O(sizeof(Key))`
+            iterator begin()
+            {
+                return iterator(fArena.get(), fRoot);
+            }
+
+            /// `O(sizeof(Key))`
+            const_iterator begin() const
+            {
+                return const_iterator(fArena.get(), fRoot);
+            }
+
+            /// `O(sizeof(Key))`
+            const_iterator cbegin() const
+            {
+                return const_iterator(fArena.get(), fRoot);
+            }
+
+            /// `O(1)`
+            iterator end()
+            {
+                return iterator();
+            }
+
+            /// `O(1)`
+            const_iterator end() const
+            {
+                return const_iterator();
+            }
+
+            /// `O(1)`
+            const_iterator cend() const
+            {
+                return const_iterator();
+            }
+
+            /// `O(n)`
+            template <typename Function>
+            Function for_each(Function f) const
+            {
+                for (auto& value : *this) {
+                    f(value);
+                }
+                return f;
+            }
+
+            /// `O(n)`
+            void clear()
+            {
+                if (fRoot != compact_null) {
+                    auto root = fRoot;
+                    fRoot = compact_null;
+                    fArena->release(root);
+                }
+                fSize = 0;
+            }
+
+            /// `O(1)`
+            bool empty() const
+            {
+                return fRoot == compact_null;
+            }
+
+            /// `O(1)`
+            size_type size() const
+            {
+                return fSize;
+            }
+
+            /// Bytes of slabs held by the arena this tree shares with its
+            /// copies, including the storage of nodes freed since.  `O(1)`
+            std::size_t arena_bytes() const
+            {
+                return fArena ? fArena->capacity_bytes() : 0;
+            }
+
+          private:
+            template <typename Source>
+            std::pair<iterator, bool> insert_impl(Source& source)
+            {
+                if (!fArena) {
+                    fArena = std::make_shared<arena_type>(fAllocator);
+                }
+                if (fRoot == compact_null) {
+                    fRoot = fArena->make_leaf(source);
+                    fSize = 1;
+                    return std::make_pair(iterator(fArena.get(), fRoot, &fArena->leaf(fRoot)->fValue), true);
+                }
+                auto result = compact_insert(*fArena, fRoot, source);
+                if (result.second) {
+                    ++fSize;
+                }
+                return std::make_pair(iterator(fArena.get(), fRoot, result.first), result.second);
+            }
+
+            template <typename This>
+            static typename find_result<This>::type find_impl(This aThis, key_type const& aKey)
+            {
+                typedef typename find_result<This>::type result_type;
+                if (aThis->fRoot == compact_null) {
+                    return result_type();
+                }
+                if (auto value = compact_find(*aThis->fArena, aThis->fRoot, aKey)) {
+                    return result_type(aThis->fArena.get(), aThis->fRoot, value);
+                }
+                return result_type();
+            }
+
+            allocator_type fAllocator;
+            /// Created by the first insertion.  The nodes of `fRoot` must be
+            /// released before it.
+            std::shared_ptr<arena_type> fArena;
+            compact_ref fRoot;
+            size_type fSize;
+        };
+    }
+}
+
+#endif
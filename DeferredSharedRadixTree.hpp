@@ -0,0 +1,200 @@
+// Copyright 2015 The MathWorks, Inc.
+#ifndef _eml_general_DeferredSharedRadixTree_hpp
+#define _eml_general_DeferredSharedRadixTree_hpp
+
+#include "SharedRadixTree.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace EML
+{
+    namespace shared_radix_tree_detail
+    {
+        /// Destroys the trees handed to it a bounded number of nodes at a
+        /// time, so that dropping the last use of a large tree costs the
+        /// dropping thread `O(1)` rather than a stall proportional to the
+        /// tree.  A thread serving requests may call `step` once per
+        /// request; `background_reclaimer` calls it from a thread of its
+        /// own.  Not safe to use from several threads at once.
+        template <typename Tree>
+        struct deferred_reclaimer
+        {
+            typedef typename tree_access::node_of<Tree>::type node_type;
+            typedef typename Tree::allocator_type allocator_type;
+
+            deferred_reclaimer()
+            {
+                // The worklist of a tree is bounded as in `node::destroy`,
+                // so `step` never allocates.
+                fWork.reserve(sizeof(typename node_type::prefix_type) * CHAR_BIT + 1);
+            }
+
+            deferred_reclaimer(deferred_reclaimer const&) = delete;
+            deferred_reclaimer& operator=(deferred_reclaimer const&) = delete;
+
+            /// Destroys every node still pending.
+            ~deferred_reclaimer()
+            {
+                drain();
+            }
+
+            /// Give up `tree`'s use of its nodes.  If another tree still
+            /// shares them, nothing else happens.  Otherwise they are
+            /// destroyed by later calls to `step`.  `O(1)`
+            void retire(Tree tree)
+            {
+                // The allocator is kept until the last node is destroyed,
+                // since it may own their storage.
+                fRetired.push_back(retired{tree_access::allocator(tree), nullptr});
+                fRetired.back().fRoot = tree_access::release(tree).abandon();
+                if (!fRetired.back().fRoot) {
+                    fRetired.pop_back();
+                }
+            }
+
+            /// Destroy up to `budget` nodes, oldest trees first.  Return the
+            /// number destroyed.  `O(budget)`
+            std::size_t step(std::size_t budget)
+            {
+                std::size_t done = 0;
+                while (done != budget && !fRetired.empty()) {
+                    auto& front = fRetired.front();
+                    if (front.fRoot) {
+                        fWork.push_back(front.fRoot);
+                        front.fRoot = nullptr;
+                    }
+                    if (fWork.empty()) {
+                        fRetired.pop_front();
+                        continue;
+                    }
+                    auto aNode = fWork.back();
+                    fWork.pop_back();
+                    node_type::destroy_shallow(aNode, [this](node_type* child) {
+                        fWork.push_back(child);
+                    });
+                    ++done;
+                }
+                return done;
+            }
+
+            /// Destroy every pending node.  `O(k)` for `k` nodes pending
+            std::size_t drain()
+            {
+                std::size_t done = 0;
+                while (!empty()) {
+                    done += step(static_cast<std::size_t>(-1));
+                }
+                return done;
+            }
+
+            /// Whether any retired tree is not yet fully destroyed.  `O(1)`
+            bool empty() const
+            {
+                return fRetired.empty();
+            }
+
+          private:
+            struct retired
+            {
+                allocator_type fAllocator;
+                node_type* fRoot;
+            };
+
+            /// Retired trees, the first of which is being destroyed.
+            std::deque<retired> fRetired;
+            /// Dead nodes of the first tree not yet destroyed.
+            std::vector<node_type*> fWork;
+        };
+
+        /// Destroys the trees handed to it on a thread of its own, `slice`
+        /// nodes at a time, yielding between slices.  Retiring a tree only
+        /// moves it onto a queue under a lock.  Trees must use
+        /// `multi_threaded` use counts, since their nodes may be shared with
+        /// trees still in use on other threads, and an allocator allowing
+        /// concurrent allocation, since their nodes are freed on the
+        /// reclaimer thread.  With `pool_allocator`, the storage of
+        /// destroyed nodes goes to the reclaimer thread's free lists, and
+        /// returns to the other threads when this is destroyed.
+        template <typename Tree>
+        struct background_reclaimer
+        {
+            typedef typename tree_access::node_of<Tree>::type node_type;
+
+            static_assert(std::is_same<typename node_type::control_block_type::ref_count_type, multi_threaded>::value,
+                          "background_reclaimer requires multi_threaded use counts");
+            static_assert(concurrent_allocation<typename Tree::allocator_type>::value,
+                          "background_reclaimer requires an allocator allowing concurrent allocation");
+
+            explicit background_reclaimer(std::size_t slice = 4096)
+                : fSlice(slice)
+                , fStopping(false)
+            {
+                fThread = std::thread([this] { run(); });
+            }
+
+            background_reclaimer(background_reclaimer const&) = delete;
+            background_reclaimer& operator=(background_reclaimer const&) = delete;
+
+            /// Waits for every tree retired so far to be destroyed.
+            ~background_reclaimer()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(fMutex);
+                    fStopping = true;
+                }
+                fWake.notify_one();
+                fThread.join();
+            }
+
+            /// Hand `tree` to the reclaimer thread.  `O(1)`
+            void retire(Tree tree)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(fMutex);
+                    fInbox.push_back(std::move(tree));
+                }
+                fWake.notify_one();
+            }
+
+          private:
+            void run()
+            {
+                std::vector<Tree> trees;
+                for (;;) {
+                    {
+                        std::unique_lock<std::mutex> lock(fMutex);
+                        fWake.wait(lock, [this] { return fStopping || !fInbox.empty(); });
+                        if (fInbox.empty()) {
+                            return;
+                        }
+                        trees.swap(fInbox);
+                    }
+                    for (auto& tree : trees) {
+                        fReclaimer.retire(std::move(tree));
+                    }
+                    trees.clear();
+                    while (fReclaimer.step(fSlice) == fSlice) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+
+            std::size_t const fSlice;
+            std::mutex fMutex;
+            std::condition_variable fWake;
+            bool fStopping;
+            std::vector<Tree> fInbox;
+            deferred_reclaimer<Tree> fReclaimer;
+            std::thread fThread;
+        };
+    }
+
+    using shared_radix_tree_detail::deferred_reclaimer;
+    using shared_radix_tree_detail::background_reclaimer;
+}
+
+#endif
@@ -0,0 +1,458 @@
+// Copyright 2015 The MathWorks, Inc.
+#ifndef _eml_general_ParallelSharedRadixTree_hpp
+#define _eml_general_ParallelSharedRadixTree_hpp
+
+#include "SharedRadixTree.hpp"
+
+#include <future>
+#include <thread>
+
+namespace EML
+{
+    namespace shared_radix_tree_detail
+    {
+        /// Fork depth giving about four tasks per hardware thread, so that
+        /// unevenly sized subtrees still keep every core busy.
+        inline int default_parallel_depth()
+        {
+            auto threads = std::thread::hardware_concurrency();
+            int depth = 2;
+            for (; threads > 1; threads >>= 1) {
+                ++depth;
+            }
+            return depth;
+        }
+
+        /// Run `left` on this thread and `right` on another, returning once
+        /// both are done.  An exception from either is rethrown, after
+        /// waiting for the other.
+        template <typename Left, typename Right>
+        void fork_join(Left left, Right right)
+        {
+            auto future = std::async(std::launch::async, right);
+            try {
+                left();
+            } catch (...) {
+                future.wait();
+                throw;
+            }
+            future.get();
+        }
+
+        template <typename Node, typename Function>
+        void parallel_for_each_value(Node const* node, Function& f, int depth)
+        {
+            typedef typename Node::branch_type branch_type;
+            if (depth <= 0 || node->is_leaf()) {
+                for_each_value(node, f);
+                return;
+            }
+            auto branch = static_cast<branch_type const*>(node);
+            fork_join([&] { parallel_for_each_value(branch->left_child().get(), f, depth - 1); },
+                      [&] { parallel_for_each_value(branch->right_child().get(), f, depth - 1); });
+        }
+
+        /// Copy the shape of the tree under `node` into nodes of `Result`,
+        /// mapping each value to `f(value)`.
+        template <typename Result, typename Node, typename Function>
+        intrusive_shared_ptr<Result> parallel_transform_values(Node const* node,
+                                                               Function& f,
+                                                               typename Result::allocator_type& alloc,
+                                                               int depth)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            if (node->is_leaf()) {
+                auto& value = static_cast<leaf_type const*>(node)->get();
+                return allocate_shared<typename Result::leaf_type>(alloc, value.first, f(value));
+            }
+            auto branch = static_cast<branch_type const*>(node);
+            intrusive_shared_ptr<Result> leftChild;
+            intrusive_shared_ptr<Result> rightChild;
+            if (depth <= 0) {
+                leftChild = parallel_transform_values<Result>(branch->left_child().get(), f, alloc, 0);
+                rightChild = parallel_transform_values<Result>(branch->right_child().get(), f, alloc, 0);
+            } else {
+                fork_join([&] { leftChild = parallel_transform_values<Result>(branch->left_child().get(), f, alloc, depth - 1); },
+                          [&] { rightChild = parallel_transform_values<Result>(branch->right_child().get(), f, alloc, depth - 1); });
+            }
+            return allocate_shared<typename Result::branch_type>(alloc, branch->prefix(), branch->mask(), std::move(leftChild), std::move(rightChild));
+        }
+
+        /// The values under `tree` satisfying `pred`, adding their number to
+        /// `kept`.  Subtrees whose values all satisfy `pred` are kept as is.
+        template <typename Node, typename Predicate>
+        intrusive_shared_ptr<Node> parallel_filter_values(intrusive_shared_ptr<Node> const& tree,
+                                                          Predicate& pred,
+                                                          typename Node::allocator_type& alloc,
+                                                          int depth,
+                                                          typename Node::size_type& kept)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            if (tree->is_leaf()) {
+                if (pred(static_cast<leaf_type const*>(tree.get())->get())) {
+                    ++kept;
+                    return tree;
+                }
+                return nullptr;
+            }
+            auto branch = static_cast<branch_type const*>(tree.get());
+            intrusive_shared_ptr<Node> leftChild;
+            intrusive_shared_ptr<Node> rightChild;
+            if (depth <= 0) {
+                leftChild = parallel_filter_values(branch->left_child(), pred, alloc, 0, kept);
+                rightChild = parallel_filter_values(branch->right_child(), pred, alloc, 0, kept);
+            } else {
+                // Each side counts on its own, so no count is shared
+                // between threads.
+                typename Node::size_type rightKept = 0;
+                fork_join([&] { leftChild = parallel_filter_values(branch->left_child(), pred, alloc, depth - 1, kept); },
+                          [&] { rightChild = parallel_filter_values(branch->right_child(), pred, alloc, depth - 1, rightKept); });
+                kept += rightKept;
+            }
+            return rebuild(tree, std::move(leftChild), std::move(rightChild), alloc);
+        }
+
+        /// `merge`, forking wherever both trees split on the same bit.
+        /// Everywhere else, only one side of a `branch` is merged and there
+        /// is nothing to fork.  The number of keys of `tree2` not in `tree1`
+        /// is added to `added`.
+        template <typename Node, typename Combine>
+        intrusive_shared_ptr<Node> parallel_merge(intrusive_shared_ptr<Node> const& tree1,
+                                                  intrusive_shared_ptr<Node> const& tree2,
+                                                  Combine& combine,
+                                                  typename Node::allocator_type& alloc,
+                                                  int depth,
+                                                  typename Node::size_type& added)
+        {
+            typedef typename Node::branch_type branch_type;
+            if (depth <= 0 || tree1 == tree2 || tree1->is_leaf() || tree2->is_leaf()) {
+                return merge(tree1, tree2, combine, alloc, &added);
+            }
+            auto branch1 = static_cast<branch_type const*>(tree1.get());
+            auto branch2 = static_cast<branch_type const*>(tree2.get());
+            if (branch1->mask() == branch2->mask() && branch1->prefix() == branch2->prefix()) {
+                intrusive_shared_ptr<Node> leftChild;
+                intrusive_shared_ptr<Node> rightChild;
+                typename Node::size_type rightAdded = 0;
+                fork_join([&] { leftChild = parallel_merge(branch1->left_child(), branch2->left_child(), combine, alloc, depth - 1, added); },
+                          [&] { rightChild = parallel_merge(branch1->right_child(), branch2->right_child(), combine, alloc, depth - 1, rightAdded); });
+                added += rightAdded;
+                if (leftChild == branch2->left_child() && rightChild == branch2->right_child()) {
+                    return tree2;
+                }
+                return rebuild(tree1, std::move(leftChild), std::move(rightChild), alloc);
+            }
+            if (higher(branch1->mask(), branch2->mask()) && !not_mem(branch2->prefix(), branch1->prefix(), branch1->mask())) {
+                if (left(branch2->prefix(), branch1->mask())) {
+                    return rebuild(tree1, parallel_merge(branch1->left_child(), tree2, combine, alloc, depth, added), branch1->right_child(), alloc);
+                }
+                return rebuild(tree1, branch1->left_child(), parallel_merge(branch1->right_child(), tree2, combine, alloc, depth, added), alloc);
+            }
+            if (higher(branch2->mask(), branch1->mask()) && !not_mem(branch1->prefix(), branch2->prefix(), branch2->mask())) {
+                if (left(branch1->prefix(), branch2->mask())) {
+                    added += subtree_size(branch2->right_child().get());
+                    return rebuild(tree2, parallel_merge(tree1, branch2->left_child(), combine, alloc, depth, added), branch2->right_child(), alloc);
+                }
+                added += subtree_size(branch2->left_child().get());
+                return rebuild(tree2, branch2->left_child(), parallel_merge(tree1, branch2->right_child(), combine, alloc, depth, added), alloc);
+            }
+            added += subtree_size(tree2.get());
+            return make_branch(alloc, branch1->prefix(), tree1, branch2->prefix(), tree2);
+        }
+
+        /// `intersect`, forking wherever both trees split on the same bit.
+        /// The number of keys of `tree1` not in `tree2` is added to
+        /// `removed`.
+        template <typename Node, typename Combine>
+        intrusive_shared_ptr<Node> parallel_intersect(intrusive_shared_ptr<Node> const& tree1,
+                                                      intrusive_shared_ptr<Node> const& tree2,
+                                                      Combine& combine,
+                                                      typename Node::allocator_type& alloc,
+                                                      int depth,
+                                                      typename Node::size_type& removed)
+        {
+            typedef typename Node::branch_type branch_type;
+            if (depth <= 0 || !tree1 || !tree2 || tree1 == tree2 || tree1->is_leaf() || tree2->is_leaf()) {
+                return intersect(tree1, tree2, combine, alloc, removed);
+            }
+            auto branch1 = static_cast<branch_type const*>(tree1.get());
+            auto branch2 = static_cast<branch_type const*>(tree2.get());
+            if (branch1->mask() == branch2->mask() && branch1->prefix() == branch2->prefix()) {
+                intrusive_shared_ptr<Node> leftChild;
+                intrusive_shared_ptr<Node> rightChild;
+                typename Node::size_type rightRemoved = 0;
+                fork_join([&] { leftChild = parallel_intersect(branch1->left_child(), branch2->left_child(), combine, alloc, depth - 1, removed); },
+                          [&] { rightChild = parallel_intersect(branch1->right_child(), branch2->right_child(), combine, alloc, depth - 1, rightRemoved); });
+                removed += rightRemoved;
+                if (leftChild && rightChild && leftChild == branch2->left_child() && rightChild == branch2->right_child()) {
+                    return tree2;
+                }
+                return rebuild(tree1, std::move(leftChild), std::move(rightChild), alloc);
+            }
+            if (higher(branch1->mask(), branch2->mask()) && !not_mem(branch2->prefix(), branch1->prefix(), branch1->mask())) {
+                if (left(branch2->prefix(), branch1->mask())) {
+                    removed += subtree_size(branch1->right_child().get());
+                    return parallel_intersect(branch1->left_child(), tree2, combine, alloc, depth, removed);
+                }
+                removed += subtree_size(branch1->left_child().get());
+                return parallel_intersect(branch1->right_child(), tree2, combine, alloc, depth, removed);
+            }
+            if (higher(branch2->mask(), branch1->mask()) && !not_mem(branch1->prefix(), branch2->prefix(), branch2->mask())) {
+                if (left(branch1->prefix(), branch2->mask())) {
+                    return parallel_intersect(tree1, branch2->left_child(), combine, alloc, depth, removed);
+                }
+                return parallel_intersect(tree1, branch2->right_child(), combine, alloc, depth, removed);
+            }
+            removed += subtree_size(tree1.get());
+            return nullptr;
+        }
+
+        /// `difference`, forking wherever both trees split on the same bit.
+        /// The number of keys dropped from `tree1` is added to `removed`.
+        template <typename Node>
+        intrusive_shared_ptr<Node> parallel_difference(intrusive_shared_ptr<Node> const& tree1,
+                                                       intrusive_shared_ptr<Node> const& tree2,
+                                                       typename Node::allocator_type& alloc,
+                                                       int depth,
+                                                       typename Node::size_type& removed)
+        {
+            typedef typename Node::branch_type branch_type;
+            if (depth <= 0 || !tree1 || !tree2 || tree1 == tree2 || tree1->is_leaf() || tree2->is_leaf()) {
+                return difference(tree1, tree2, alloc, removed);
+            }
+            auto branch1 = static_cast<branch_type const*>(tree1.get());
+            auto branch2 = static_cast<branch_type const*>(tree2.get());
+            if (branch1->mask() == branch2->mask() && branch1->prefix() == branch2->prefix()) {
+                intrusive_shared_ptr<Node> leftChild;
+                intrusive_shared_ptr<Node> rightChild;
+                typename Node::size_type rightRemoved = 0;
+                fork_join([&] { leftChild = parallel_difference(branch1->left_child(), branch2->left_child(), alloc, depth - 1, removed); },
+                          [&] { rightChild = parallel_difference(branch1->right_child(), branch2->right_child(), alloc, depth - 1, rightRemoved); });
+                removed += rightRemoved;
+                return rebuild(tree1, std::move(leftChild), std::move(rightChild), alloc);
+            }
+            if (higher(branch1->mask(), branch2->mask()) && !not_mem(branch2->prefix(), branch1->prefix(), branch1->mask())) {
+                if (left(branch2->prefix(), branch1->mask())) {
+                    return rebuild(tree1, parallel_difference(branch1->left_child(), tree2, alloc, depth, removed), branch1->right_child(), alloc);
+                }
+                return rebuild(tree1, branch1->left_child(), parallel_difference(branch1->right_child(), tree2, alloc, depth, removed), alloc);
+            }
+            if (higher(branch2->mask(), branch1->mask()) && !not_mem(branch1->prefix(), branch2->prefix(), branch2->mask())) {
+                if (left(branch1->prefix(), branch2->mask())) {
+                    return parallel_difference(tree1, branch2->left_child(), alloc, depth, removed);
+                }
+                return parallel_difference(tree1, branch2->right_child(), alloc, depth, removed);
+            }
+            return tree1;
+        }
+
+        /// Replace the nodes of `tree` with `root` after `removed` of its
+        /// values were dropped.  A size yet to be counted stays so.
+        template <typename Tree>
+        void reset_after_removing(Tree& tree,
+                                  intrusive_shared_ptr<typename tree_access::node_of<Tree>::type> root,
+                                  typename Tree::size_type removed)
+        {
+            auto size = tree_access::stored_size(tree);
+            if (size != lazy_size<typename Tree::size_type>::unknown()) {
+                size -= removed;
+            }
+            tree_access::reset(tree, std::move(root), size);
+        }
+
+        /// The parallel operations below fork the two children of each
+        /// `branch` in the top `depth` levels of a tree onto separate
+        /// threads, and handle smaller subtrees serially.  Subtrees of one
+        /// tree are disjoint, so no node is touched by two threads, but
+        /// functions passed in are called concurrently, and `Allocator`
+        /// must allow concurrent allocation, as `new_allocator` and
+        /// `pool_allocator` do and `arena_allocator` does not.  Each
+        /// operation checks this with `concurrent_allocation`.
+
+        /// Call `f` with every value of `tree`, concurrently and in no
+        /// particular order.  `O(n / p + 2^depth)`
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics,
+            typename Function
+            >
+        Function parallel_for_each(SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics> const& tree,
+                                   Function f,
+                                   int depth = default_parallel_depth())
+        {
+            static_assert(concurrent_allocation<Allocator>::value, "parallel operations require an allocator allowing concurrent allocation");
+            if (auto& root = tree_access::root(tree)) {
+                parallel_for_each_value(root.get(), f, depth);
+            }
+            return f;
+        }
+
+        /// Return a tree of the same keys as `tree`, mapping each value to
+        /// `f(value)`.  `O(n / p + 2^depth)`
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics,
+            typename Function
+            >
+        SharedRadixTree<Key,
+                        typename std::decay<typename std::result_of<Function&(std::pair<Key const, T> const&)>::type>::type,
+                        Prefix,
+                        Mask,
+                        RefCount,
+                        Allocator,
+                        Counts,
+                        binary_nodes,
+                        Metrics>
+        parallel_transform(SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics> const& tree,
+                           Function f,
+                           int depth = default_parallel_depth())
+        {
+            static_assert(concurrent_allocation<Allocator>::value, "parallel operations require an allocator allowing concurrent allocation");
+            typedef SharedRadixTree<Key,
+                                    typename std::decay<typename std::result_of<Function&(std::pair<Key const, T> const&)>::type>::type,
+                                    Prefix,
+                                    Mask,
+                                    RefCount,
+                                    Allocator,
+                                    Counts,
+                                    binary_nodes,
+                                    Metrics> result_type;
+            typedef typename tree_access::node_of<result_type>::type result_node_type;
+            result_type result(tree.get_allocator());
+            if (auto& root = tree_access::root(tree)) {
+                tree_access::reset(result, parallel_transform_values<result_node_type>(root.get(), f, tree_access::allocator(result), depth), tree_access::stored_size(tree));
+            }
+            return result;
+        }
+
+        /// Return the values of `tree` satisfying `pred`.  Subtrees left
+        /// intact are shared with `tree`.  `O(n / p + 2^depth)`
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics,
+            typename Predicate
+            >
+        SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics>
+        parallel_filter(SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics> const& tree,
+                        Predicate pred,
+                        int depth = default_parallel_depth())
+        {
+            static_assert(concurrent_allocation<Allocator>::value, "parallel operations require an allocator allowing concurrent allocation");
+            SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics> result(tree.get_allocator());
+            if (auto& root = tree_access::root(tree)) {
+                typename SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics>::size_type kept = 0;
+                auto filtered = parallel_filter_values(root, pred, tree_access::allocator(result), depth, kept);
+                tree_access::reset(result, std::move(filtered), kept);
+            }
+            return result;
+        }
+
+        /// `SharedRadixTree::merge_with`, forking the merge of subtrees
+        /// both trees split alike.
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics,
+            typename Combine
+            >
+        void parallel_merge_with(SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics>& tree,
+                                 SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics> const& other,
+                                 Combine combine,
+                                 int depth = default_parallel_depth())
+        {
+            static_assert(concurrent_allocation<Allocator>::value, "parallel operations require an allocator allowing concurrent allocation");
+            auto& root = tree_access::root(tree);
+            auto& otherRoot = tree_access::root(other);
+            if (!otherRoot) {
+                return;
+            }
+            if (!root) {
+                tree_access::reset(tree, otherRoot, tree_access::stored_size(other));
+                return;
+            }
+            auto size = tree.size();
+            auto merged = parallel_merge(root, otherRoot, combine, tree_access::allocator(tree), depth, size);
+            tree_access::reset(tree, std::move(merged), size);
+        }
+
+        /// `SharedRadixTree::intersect_with`, forking the intersection of
+        /// subtrees both trees split alike.
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics,
+            typename Combine
+            >
+        void parallel_intersect_with(SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics>& tree,
+                                     SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics> const& other,
+                                     Combine combine,
+                                     int depth = default_parallel_depth())
+        {
+            static_assert(concurrent_allocation<Allocator>::value, "parallel operations require an allocator allowing concurrent allocation");
+            typename SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics>::size_type removed = 0;
+            auto intersected = parallel_intersect(tree_access::root(tree), tree_access::root(other), combine, tree_access::allocator(tree), depth, removed);
+            reset_after_removing(tree, std::move(intersected), removed);
+        }
+
+        /// `SharedRadixTree::difference`, forking the difference of subtrees
+        /// both trees split alike.
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics
+            >
+        void parallel_difference(SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics>& tree,
+                                 SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics> const& other,
+                                 int depth = default_parallel_depth())
+        {
+            static_assert(concurrent_allocation<Allocator>::value, "parallel operations require an allocator allowing concurrent allocation");
+            typename SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics>::size_type removed = 0;
+            auto remaining = parallel_difference(tree_access::root(tree), tree_access::root(other), tree_access::allocator(tree), depth, removed);
+            reset_after_removing(tree, std::move(remaining), removed);
+        }
+    }
+
+    using shared_radix_tree_detail::parallel_for_each;
+    using shared_radix_tree_detail::parallel_transform;
+    using shared_radix_tree_detail::parallel_filter;
+    using shared_radix_tree_detail::parallel_merge_with;
+    using shared_radix_tree_detail::parallel_intersect_with;
+    using shared_radix_tree_detail::parallel_difference;
+}
+
+#endif
@@ -0,0 +1,604 @@
+// Copyright 2015 The MathWorks, Inc.
+#ifndef _eml_general_SerializedSharedRadixTree_hpp
+#define _eml_general_SerializedSharedRadixTree_hpp
+
+#include "SharedRadixTree.hpp"
+
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <cstring>
+
+namespace EML
+{
+    namespace shared_radix_tree_detail
+    {
+        /// The serialized form of a tree is a `serialized_header` followed
+        /// by an array of `serialized_branch` records in preorder and an
+        /// array of values in key order, each starting at a multiple of
+        /// `serialized_alignment`.  Children are referred to by index
+        /// rather than by pointer, shifted left by one bit with the low bit
+        /// set for a value, so the bytes can be mapped at any address and
+        /// queried in place.  Integers are stored in the byte order of the
+        /// writer, which the reader checks.
+        std::size_t const serialized_alignment = 16;
+
+        struct serialized_header
+        {
+            char fMagic[8];
+            std::uint32_t fByteOrder;
+            std::uint32_t fVersion;
+            std::uint32_t fKeySize;
+            std::uint32_t fMappedSize;
+            std::uint32_t fValueSize;
+            std::uint32_t fBranchSize;
+            std::uint64_t fSize;
+            std::uint64_t fRoot;
+            std::uint64_t fBranchOffset;
+            std::uint64_t fValueOffset;
+        };
+
+        char const serialized_magic[8] = {'E', 'M', 'L', 'S', 'R', 'T', '\0', '\0'};
+        std::uint32_t const serialized_byte_order = 0x01020304;
+        std::uint32_t const serialized_version = 1;
+
+        template <typename Prefix, typename Mask>
+        struct serialized_branch
+        {
+            Prefix fPrefix;
+            Mask fMask;
+            std::uint64_t fLeft;
+            std::uint64_t fRight;
+        };
+
+        inline std::size_t serialized_align(std::size_t offset)
+        {
+            return (offset + serialized_alignment - 1) & ~(serialized_alignment - 1);
+        }
+
+        /// Construct the records for the nodes under `node` in `branches`
+        /// and `values`, starting at the indices `branch` and `value`, which
+        /// are advanced past them.  Return the reference to `node`.
+        template <typename Node, typename Branch>
+        std::uint64_t serialize_nodes(Node const* node,
+                                      Branch* branches,
+                                      typename Node::value_type* values,
+                                      std::uint64_t& branch,
+                                      std::uint64_t& value)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::value_type value_type;
+            if (node->is_leaf()) {
+                new (values + value) value_type(static_cast<leaf_type const*>(node)->get());
+                return value++ << 1 | 1;
+            }
+            auto source = static_cast<branch_type const*>(node);
+            auto index = branch++;
+            auto left = serialize_nodes(source->left_child().get(), branches, values, branch, value);
+            auto right = serialize_nodes(source->right_child().get(), branches, values, branch, value);
+            new (branches + index) Branch{source->prefix(), source->mask(), left, right};
+            return index << 1;
+        }
+
+        /// Serialize `tree` into a new buffer, which may be written to a file
+        /// as is and read back by a `SharedRadixTreeView` of the same `Key`,
+        /// `T`, `Prefix`, and `Mask` on a machine of the same byte order.
+        /// `Key`, `T`, `Prefix`, and `Mask` must be trivially copyable, and
+        /// `Prefix` and `Mask` integral, which leaves out pointer keys.
+        /// The shape of the tree is kept, so the view needs no rebuilding.
+        /// `O(n)`
+        template <typename Tree>
+        std::vector<char> serialize(Tree const& tree)
+        {
+            typedef typename tree_access::node_of<Tree>::type node_type;
+            typedef typename node_type::key_type key_type;
+            typedef typename node_type::mapped_type mapped_type;
+            typedef typename node_type::value_type value_type;
+            typedef typename node_type::prefix_type prefix_type;
+            typedef typename node_type::mask_type mask_type;
+            typedef serialized_branch<prefix_type, mask_type> branch_type;
+            static_assert(std::is_trivially_copyable<key_type>::value && std::is_trivially_copyable<mapped_type>::value,
+                          "serialize requires trivially copyable keys and values");
+            static_assert(std::is_integral<prefix_type>::value && std::is_integral<mask_type>::value,
+                          "serialize requires integral prefixes and masks");
+            static_assert(alignof(value_type) <= serialized_alignment && alignof(branch_type) <= serialized_alignment,
+                          "serialize requires values aligned to at most serialized_alignment");
+            std::uint64_t size = tree.size();
+            std::uint64_t branches = size == 0 ? 0 : size - 1;
+            auto branchOffset = serialized_align(sizeof(serialized_header));
+            auto valueOffset = serialized_align(branchOffset + branches * sizeof(branch_type));
+            std::vector<char> result(valueOffset + size * sizeof(value_type));
+            serialized_header header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.fMagic, serialized_magic, sizeof(header.fMagic));
+            header.fByteOrder = serialized_byte_order;
+            header.fVersion = serialized_version;
+            header.fKeySize = sizeof(key_type);
+            header.fMappedSize = sizeof(mapped_type);
+            header.fValueSize = sizeof(value_type);
+            header.fBranchSize = sizeof(branch_type);
+            header.fSize = size;
+            header.fBranchOffset = branchOffset;
+            header.fValueOffset = valueOffset;
+            if (auto& root = tree_access::root(tree)) {
+                std::uint64_t branch = 0;
+                std::uint64_t value = 0;
+                header.fRoot = serialize_nodes(root.get(),
+                                               reinterpret_cast<branch_type*>(result.data() + branchOffset),
+                                               reinterpret_cast<value_type*>(result.data() + valueOffset),
+                                               branch,
+                                               value);
+            }
+            std::memcpy(result.data(), &header, sizeof(header));
+            return result;
+        }
+
+        /// Read-only view of a serialized tree, queried in place without
+        /// copying or allocating.  The bytes are typically a file mapped
+        /// into memory with `mmap` or `MapViewOfFile`; they must be aligned
+        /// to `serialized_alignment`, as mapped pages and `serialize`'s
+        /// result are, and outlive the view.  The header is checked on
+        /// construction, which throws `std::invalid_argument` if the bytes
+        /// were not written by `serialize` for this view's types; the
+        /// records themselves are trusted.  Iterators are pointers to the
+        /// values in key order.
+        /// @see serialize
+        template <
+            typename Key,
+            typename T,
+            typename Prefix = typename default_prefix<Key>::type,
+            typename Mask = typename default_mask<Key>::type
+            >
+        struct SharedRadixTreeView
+        {
+            typedef Key key_type;
+            typedef T mapped_type;
+            typedef std::pair<key_type const, mapped_type> value_type;
+            typedef value_type const* iterator;
+            typedef value_type const* const_iterator;
+            typedef std::size_t size_type;
+            typedef key_less<Key, Prefix> key_compare;
+
+            SharedRadixTreeView()
+                : fBranches(nullptr)
+                , fValues(nullptr)
+                , fSize(0)
+                , fRoot(0)
+            {}
+
+            /// `O(1)`
+            SharedRadixTreeView(void const* data, std::size_t size)
+            {
+                serialized_header header;
+                if (size < sizeof(header) || reinterpret_cast<std::uintptr_t>(data) % serialized_alignment != 0) {
+                    throw std::invalid_argument("SharedRadixTreeView: bytes too short or misaligned");
+                }
+                std::memcpy(&header, data, sizeof(header));
+                if (std::memcmp(header.fMagic, serialized_magic, sizeof(header.fMagic)) != 0 ||
+                    header.fByteOrder != serialized_byte_order ||
+                    header.fVersion != serialized_version) {
+                    throw std::invalid_argument("SharedRadixTreeView: not a serialized tree of this byte order and version");
+                }
+                if (header.fKeySize != sizeof(key_type) ||
+                    header.fMappedSize != sizeof(mapped_type) ||
+                    header.fValueSize != sizeof(value_type) ||
+                    header.fBranchSize != sizeof(branch_type)) {
+                    throw std::invalid_argument("SharedRadixTreeView: serialized tree has different types");
+                }
+                auto branches = header.fSize == 0 ? 0 : header.fSize - 1;
+                if (header.fBranchOffset + branches * sizeof(branch_type) > header.fValueOffset ||
+                    header.fValueOffset + header.fSize * sizeof(value_type) > size ||
+                    header.fBranchOffset % serialized_alignment != 0 ||
+                    header.fValueOffset % serialized_alignment != 0 ||
+                    (header.fSize != 0 && (header.fRoot & 1 ? header.fSize != 1 : header.fRoot >> 1 >= branches))) {
+                    throw std::invalid_argument("SharedRadixTreeView: serialized tree is truncated or corrupt");
+                }
+                auto bytes = static_cast<char const*>(data);
+                fBranches = reinterpret_cast<branch_type const*>(bytes + header.fBranchOffset);
+                fValues = reinterpret_cast<value_type const*>(bytes + header.fValueOffset);
+                fSize = header.fSize;
+                fRoot = header.fRoot;
+            }
+
+            /// `O(min(log(n), sizeof(Key)))`
+            const_iterator find(key_type const& key) const
+            {
+                if (fSize == 0) {
+                    return end();
+                }
+                auto ref = fRoot;
+                while (!(ref & 1)) {
+                    auto& branch = fBranches[ref >> 1];
+                    if (not_mem(key, branch.fPrefix, branch.fMask)) {
+                        return end();
+                    }
+                    ref = left(static_cast<Prefix>(key), branch.fMask) ? branch.fLeft : branch.fRight;
+                }
+                auto value = fValues + (ref >> 1);
+                if (value->first != key) {
+                    return end();
+                }
+                return value;
+            }
+
+            /// `O(min(log(n), sizeof(Key)))`
+            size_type count(key_type const& key) const
+            {
+                return find(key) != end() ? 1 : 0;
+            }
+
+            /// Binary search of the values.  `O(log(n))`
+            const_iterator lower_bound(key_type const& key) const
+            {
+                return std::lower_bound(begin(), end(), key, [](value_type const& value, key_type const& key) {
+                    return key_compare()(value.first, key);
+                });
+            }
+
+            /// Binary search of the values.  `O(log(n))`
+            const_iterator upper_bound(key_type const& key) const
+            {
+                return std::upper_bound(begin(), end(), key, [](key_type const& key, value_type const& value) {
+                    return key_compare()(key, value.first);
+                });
+            }
+
+            /// `O(1)`
+            const_iterator begin() const
+            {
+                return fValues;
+            }
+
+            /// `O(1)`
+            const_iterator end() const
+            {
+                return fValues + fSize;
+            }
+
+            /// `O(1)`
+            bool empty() const
+            {
+                return fSize == 0;
+            }
+
+            /// `O(1)`
+            size_type size() const
+            {
+                return fSize;
+            }
+
+            key_compare key_comp() const
+            {
+                return key_compare();
+            }
+
+          private:
+            typedef serialized_branch<Prefix, Mask> branch_type;
+
+            branch_type const* fBranches;
+            value_type const* fValues;
+            size_type fSize;
+            std::uint64_t fRoot;
+        };
+
+        /// Copy the values of `view` into a mutable tree.  The values are
+        /// already in key order, so this is `Tree::from_sorted` and costs
+        /// one allocation per node, but no searching.  `O(n)`
+        template <typename Tree, typename Key, typename T, typename Prefix, typename Mask>
+        Tree thaw(SharedRadixTreeView<Key, T, Prefix, Mask> const& view,
+                  typename Tree::allocator_type const& alloc = typename Tree::allocator_type())
+        {
+            return Tree::from_sorted(view.begin(), view.end(), alloc);
+        }
+
+        /// A checkpoint is a header followed by the `leaf` records, the
+        /// `branch` records with children before parents, and the ids of
+        /// the nodes dropped since the previous checkpoint, all packed
+        /// without padding.  Nodes are identified by ids, starting at `1`,
+        /// that stay the same for as long as a node is in consecutive
+        /// checkpoints; `0` is the root of an empty tree.
+        struct checkpoint_header
+        {
+            char fMagic[8];
+            std::uint32_t fByteOrder;
+            std::uint32_t fVersion;
+            std::uint32_t fKeySize;
+            std::uint32_t fMappedSize;
+            std::uint32_t fPrefixSize;
+            /// `1` if the checkpoint does not depend on a previous one.
+            std::uint32_t fBase;
+            std::uint64_t fLeaves;
+            std::uint64_t fBranches;
+            std::uint64_t fDropped;
+            std::uint64_t fRoot;
+            /// The number of values in the tree.
+            std::uint64_t fSize;
+        };
+
+        char const checkpoint_magic[8] = {'E', 'M', 'L', 'S', 'R', 'T', 'C', '\0'};
+        std::uint32_t const checkpoint_version = 2;
+
+        template <typename T>
+        void checkpoint_put(std::vector<char>& out, T const& value)
+        {
+            auto bytes = reinterpret_cast<char const*>(&value);
+            out.insert(out.end(), bytes, bytes + sizeof(value));
+        }
+
+        /// Writes successive versions of a tree as checkpoints holding only
+        /// the nodes that were not in the previous checkpoint, along with
+        /// the ids of those that are no longer in it.  Versions derived
+        /// from one another share all but the paths to changed keys, so a
+        /// checkpoint costs `O(d * min(log(n), sizeof(Key)))` for `d`
+        /// changed keys rather than `O(n)`.  Nodes are identified by
+        /// address, which stays unique because the writer holds on to the
+        /// previously written root.  Only the last version is remembered,
+        /// so the ids of older versions are pruned as they are replaced.
+        /// `Key` and `T` must be trivially copyable.
+        /// @see checkpoint_reader
+        template <typename Tree>
+        struct checkpoint_writer
+        {
+            checkpoint_writer()
+                : fNextId(1)
+            {}
+
+            /// Return the checkpoint of `tree`.  `O(d * min(log(n), sizeof(Key)))`
+            std::vector<char> write(Tree const& tree)
+            {
+                static_assert(std::is_trivially_copyable<key_type>::value && std::is_trivially_copyable<mapped_type>::value,
+                              "checkpoint_writer requires trivially copyable keys and values");
+                static_assert(std::is_trivially_copyable<prefix_type>::value && std::is_trivially_copyable<mask_type>::value,
+                              "checkpoint_writer requires trivially copyable prefixes and masks");
+                std::vector<char> leaves;
+                std::vector<char> branches;
+                std::unordered_set<node_type const*> kept;
+                checkpoint_header header;
+                std::memset(&header, 0, sizeof(header));
+                header.fBase = fRoot ? 0 : 1;
+                auto& root = tree_access::root(tree);
+                if (root) {
+                    header.fRoot = write_nodes(root.get(), leaves, branches, kept, header);
+                }
+                std::vector<std::uint64_t> dropped;
+                if (fRoot) {
+                    drop_nodes(fRoot.get(), kept, dropped);
+                }
+                fRoot = root;
+                std::memcpy(header.fMagic, checkpoint_magic, sizeof(header.fMagic));
+                header.fByteOrder = serialized_byte_order;
+                header.fVersion = checkpoint_version;
+                header.fKeySize = sizeof(key_type);
+                header.fMappedSize = sizeof(mapped_type);
+                header.fPrefixSize = sizeof(prefix_type);
+                header.fDropped = dropped.size();
+                header.fSize = tree.size();
+                std::vector<char> result;
+                result.reserve(sizeof(header) + leaves.size() + branches.size() + dropped.size() * sizeof(std::uint64_t));
+                checkpoint_put(result, header);
+                result.insert(result.end(), leaves.begin(), leaves.end());
+                result.insert(result.end(), branches.begin(), branches.end());
+                for (auto id : dropped) {
+                    checkpoint_put(result, id);
+                }
+                return result;
+            }
+
+            /// Forget the previous checkpoint, so that the next one is
+            /// written in full and may start a new log.  Starting a new log
+            /// this way compacts away the history of the old one.  `O(n)`
+            void reset()
+            {
+                fIds.clear();
+                fRoot = nullptr;
+            }
+
+            /// The number of nodes in the previous checkpoint.  `O(1)`
+            std::size_t nodes() const
+            {
+                return fIds.size();
+            }
+
+          private:
+            typedef typename tree_access::node_of<Tree>::type node_type;
+            typedef typename node_type::branch_type branch_type;
+            typedef typename node_type::leaf_type leaf_type;
+            typedef typename node_type::key_type key_type;
+            typedef typename node_type::mapped_type mapped_type;
+            typedef typename node_type::prefix_type prefix_type;
+            typedef typename node_type::mask_type mask_type;
+
+            /// Write the records of the nodes under `node` that are not in
+            /// the previous checkpoint, adding the ones that are to `kept`.
+            /// Return the id of `node`.
+            std::uint64_t write_nodes(node_type const* node,
+                                      std::vector<char>& leaves,
+                                      std::vector<char>& branches,
+                                      std::unordered_set<node_type const*>& kept,
+                                      checkpoint_header& header)
+            {
+                auto found = fIds.find(node);
+                if (found != fIds.end()) {
+                    kept.insert(node);
+                    return found->second;
+                }
+                auto id = fNextId++;
+                if (node->is_leaf()) {
+                    auto& value = static_cast<leaf_type const*>(node)->get();
+                    checkpoint_put(leaves, id);
+                    checkpoint_put(leaves, value.first);
+                    checkpoint_put(leaves, value.second);
+                    ++header.fLeaves;
+                } else {
+                    auto branch = static_cast<branch_type const*>(node);
+                    auto left = write_nodes(branch->left_child().get(), leaves, branches, kept, header);
+                    auto right = write_nodes(branch->right_child().get(), leaves, branches, kept, header);
+                    checkpoint_put(branches, id);
+                    checkpoint_put(branches, branch->prefix());
+                    checkpoint_put(branches, branch->mask());
+                    checkpoint_put(branches, left);
+                    checkpoint_put(branches, right);
+                    ++header.fBranches;
+                }
+                fIds.emplace(node, id);
+                return id;
+            }
+
+            /// Forget the nodes under `node`, a root of the previous
+            /// checkpoint, that are not in `kept` subtrees, adding their ids
+            /// to `dropped`.  Only the replaced paths are visited.
+            void drop_nodes(node_type const* node,
+                            std::unordered_set<node_type const*> const& kept,
+                            std::vector<std::uint64_t>& dropped)
+            {
+                if (kept.count(node) != 0) {
+                    return;
+                }
+                auto found = fIds.find(node);
+                dropped.push_back(found->second);
+                fIds.erase(found);
+                if (!node->is_leaf()) {
+                    auto branch = static_cast<branch_type const*>(node);
+                    drop_nodes(branch->left_child().get(), kept, dropped);
+                    drop_nodes(branch->right_child().get(), kept, dropped);
+                }
+            }
+
+            std::unordered_map<node_type const*, std::uint64_t> fIds;
+            /// Keeps every node in `fIds` alive, so that no address is
+            /// reused by a new node while it is an id.
+            intrusive_shared_ptr<node_type> fRoot;
+            std::uint64_t fNextId;
+        };
+
+        /// Rebuilds the versions written by a `checkpoint_writer` from its
+        /// checkpoints, read in order since the writer's last `reset`.
+        /// Nodes shared by consecutive versions are shared again by the
+        /// trees returned.  Each checkpoint costs one allocation per new
+        /// node.  A checkpoint that does not fit the previous ones or this
+        /// tree's types throws `std::invalid_argument`, leaving the reader
+        /// as it was.
+        /// @see checkpoint_writer
+        template <typename Tree>
+        struct checkpoint_reader
+        {
+            typedef typename Tree::allocator_type allocator_type;
+
+            explicit checkpoint_reader(allocator_type const& alloc = allocator_type())
+                : fTree(alloc)
+            {}
+
+            /// Apply the checkpoint in `data` and return the version it
+            /// holds.  `O(d)` for `d` nodes in the checkpoint.
+            Tree read(void const* data, std::size_t size)
+            {
+                auto bytes = static_cast<char const*>(data);
+                auto end = bytes + size;
+                checkpoint_header header;
+                get(bytes, end, header);
+                if (std::memcmp(header.fMagic, checkpoint_magic, sizeof(header.fMagic)) != 0 ||
+                    header.fByteOrder != serialized_byte_order ||
+                    header.fVersion != checkpoint_version ||
+                    header.fKeySize != sizeof(key_type) ||
+                    header.fMappedSize != sizeof(mapped_type) ||
+                    header.fPrefixSize != sizeof(prefix_type)) {
+                    throw std::invalid_argument("checkpoint_reader: not a checkpoint of this tree type");
+                }
+                std::unordered_map<std::uint64_t, intrusive_shared_ptr<node_type>> added;
+                auto lookup = [&](std::uint64_t id) -> intrusive_shared_ptr<node_type> const& {
+                    auto found = added.find(id);
+                    if (found != added.end()) {
+                        return found->second;
+                    }
+                    auto old = header.fBase ? fNodes.end() : fNodes.find(id);
+                    if (old == fNodes.end()) {
+                        throw std::invalid_argument("checkpoint_reader: checkpoint refers to an unknown node");
+                    }
+                    return old->second;
+                };
+                auto& alloc = tree_access::allocator(fTree);
+                for (std::uint64_t i = 0; i != header.fLeaves; ++i) {
+                    std::uint64_t id;
+                    key_type key;
+                    mapped_type mapped;
+                    get(bytes, end, id);
+                    get(bytes, end, key);
+                    get(bytes, end, mapped);
+                    added.emplace(id, allocate_shared<leaf_type>(alloc, key, mapped));
+                }
+                for (std::uint64_t i = 0; i != header.fBranches; ++i) {
+                    std::uint64_t id;
+                    prefix_type prefix;
+                    mask_type mask;
+                    std::uint64_t left;
+                    std::uint64_t right;
+                    get(bytes, end, id);
+                    get(bytes, end, prefix);
+                    get(bytes, end, mask);
+                    get(bytes, end, left);
+                    get(bytes, end, right);
+                    added.emplace(id, allocate_shared<branch_type>(alloc, prefix, mask, lookup(left), lookup(right)));
+                }
+                intrusive_shared_ptr<node_type> root;
+                if (header.fRoot != 0) {
+                    root = lookup(header.fRoot);
+                }
+                std::vector<std::uint64_t> dropped(header.fDropped);
+                for (auto& id : dropped) {
+                    get(bytes, end, id);
+                }
+                if (header.fBase) {
+                    fNodes.clear();
+                }
+                for (auto id : dropped) {
+                    fNodes.erase(id);
+                }
+                for (auto& node : added) {
+                    fNodes.insert(std::move(node));
+                }
+                tree_access::reset(fTree, std::move(root), header.fSize);
+                return fTree;
+            }
+
+            /// The number of nodes in the last version read.  `O(1)`
+            std::size_t nodes() const
+            {
+                return fNodes.size();
+            }
+
+          private:
+            typedef typename tree_access::node_of<Tree>::type node_type;
+            typedef typename node_type::branch_type branch_type;
+            typedef typename node_type::leaf_type leaf_type;
+            typedef typename node_type::key_type key_type;
+            typedef typename node_type::mapped_type mapped_type;
+            typedef typename node_type::prefix_type prefix_type;
+            typedef typename node_type::mask_type mask_type;
+
+            template <typename T>
+            static void get(char const*& bytes, char const* end, T& value)
+            {
+                if (static_cast<std::size_t>(end - bytes) < sizeof(value)) {
+                    throw std::invalid_argument("checkpoint_reader: checkpoint is truncated");
+                }
+                std::memcpy(&value, bytes, sizeof(value));
+                bytes += sizeof(value);
+            }
+
+            /// The nodes of the last version read, by id.
+            std::unordered_map<std::uint64_t, intrusive_shared_ptr<node_type>> fNodes;
+            /// The last version read, which also holds the allocator.
+            Tree fTree;
+        };
+    }
+
+    using shared_radix_tree_detail::serialize;
+    using shared_radix_tree_detail::SharedRadixTreeView;
+    using shared_radix_tree_detail::thaw;
+    using shared_radix_tree_detail::checkpoint_writer;
+    using shared_radix_tree_detail::checkpoint_reader;
+}
+
+#endif
@@ -2,11 +2,20 @@
 #ifndef _eml_general_SharedRadixTree_hpp
 #define _eml_general_SharedRadixTree_hpp
 
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
+#include <climits>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 
 #ifdef _WIN32
@@ -80,6 +89,18 @@ namespace EML
 
 #endif
 
+        /// Hint that the cache line at `p` will be read soon.
+        inline void prefetch(void const* p)
+        {
+#if defined(_WIN32) && (defined(_M_IX86) || defined(_M_X64))
+            _mm_prefetch(static_cast<char const*>(p), _MM_HINT_T0);
+#elif defined(__GNUC__)
+            __builtin_prefetch(p);
+#else
+            (void)p;
+#endif
+        }
+
         template <typename>
         struct is_pointer_to_const;
 
@@ -102,6 +123,67 @@ namespace EML
             typedef T type;
         };
 
+        /// Use count policy for trees confined to a single thread.  A tree
+        /// and all of its copies must only be accessed from one thread at a
+        /// time.  This is the fastest policy.
+        struct single_threaded
+        {
+            typedef unsigned int count_type;
+
+            static unsigned int load(count_type const& count)
+            {
+                return count;
+            }
+
+            static void increment(count_type& count)
+            {
+                ++count;
+            }
+
+            static void increment(count_type& count, unsigned int n)
+            {
+                count += n;
+            }
+
+            /// Return `true` if the last use was released.
+            static bool decrement(count_type& count)
+            {
+                return --count == 0;
+            }
+        };
+
+        /// Use count policy for trees whose copies are handed to other
+        /// threads.  A new use can only be created from an existing one, so
+        /// increments are relaxed.  Decrements are acquire-release so that
+        /// the thread destroying a node observes every write made through
+        /// the other uses.  Note that a single tree object is still not safe
+        /// to mutate concurrently; only distinct copies are.
+        struct multi_threaded
+        {
+            typedef std::atomic<unsigned int> count_type;
+
+            static unsigned int load(count_type const& count)
+            {
+                return count.load(std::memory_order_acquire);
+            }
+
+            static void increment(count_type& count)
+            {
+                count.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            static void increment(count_type& count, unsigned int n)
+            {
+                count.fetch_add(n, std::memory_order_relaxed);
+            }
+
+            /// Return `true` if the last use was released.
+            static bool decrement(count_type& count)
+            {
+                return count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+            }
+        };
+
         /// A reference counting pointer.  The advantage of this over
         /// `std::shared_ptr` is both time and space.  Bumping a
         /// `std::shared_ptr` use count requires a `virtual` function call.
@@ -109,40 +191,65 @@ namespace EML
         /// direct call.  A `std::shared_ptr` requires two words of space.
         /// `intrusive_shared_ptr` only requires one.  These advantages are at
         /// the cost of usability.  `intrusive_shared_ptr` requires any `T` to
-        /// be a subclass of `control_block`.
+        /// be a subclass of `control_block` and to provide a `static`
+        /// `destroy(T*)` releasing its storage.  Whether use counts are atomic
+        /// is decided by the `control_block` policy of `T`.
         template <typename>
         struct intrusive_shared_ptr;
 
+        /// Defined in `AtomicSharedRadixTree.hpp`.
+        template <typename>
+        struct atomic_intrusive_shared_ptr;
+
         /// Control block for `intrusive_shared_ptr` containing a use count.
         /// Only `intrusive_shared_ptr` may modify the use count.  To be able
         /// to be used with `intrusive_shared_ptr`, a type must subclass
         /// `control_block`.
+        /// @see single_threaded
+        /// @see multi_threaded
+        template <typename RefCount>
         struct control_block
         {
             template <typename>
             friend struct intrusive_shared_ptr;
 
+            template <typename>
+            friend struct atomic_intrusive_shared_ptr;
+
+            typedef control_block control_block_type;
+            typedef RefCount ref_count_type;
+
             control_block()
                 : fUseCount(1)
             {}
 
             unsigned int use_count() const
             {
-                return fUseCount;
+                return RefCount::load(fUseCount);
             }
 
             bool unique() const
             {
-                return fUseCount == 1;
+                return use_count() == 1;
             }
 
           private:
-            unsigned int& use_count()
+            void retain()
             {
-                return fUseCount;
+                RefCount::increment(fUseCount);
             }
 
-            unsigned int fUseCount;
+            void retain(unsigned int n)
+            {
+                RefCount::increment(fUseCount, n);
+            }
+
+            bool release()
+            {
+                return RefCount::decrement(fUseCount);
+            }
+
+            typename RefCount::count_type fUseCount;
         };
 
         template <typename T>
@@ -168,7 +275,7 @@ namespace EML
                 : fPtr(rhs.fPtr)
             {
                 if (auto block = get_control_block()) {
-                    ++block->use_count();
+                    block->retain();
                 }
             }
 
@@ -177,7 +284,7 @@ namespace EML
                 : fPtr(rhs.fPtr)
             {
                 if (auto block = get_control_block()) {
-                    ++block->use_count();
+                    block->retain();
                 }
             }
 
@@ -202,12 +309,8 @@ namespace EML
 
             ~intrusive_shared_ptr()
             {
-                if (auto block = get_control_block()) {
-                    if (block->unique()) {
-                        delete fPtr;
-                    } else {
-                        --block->use_count();
-                    }
+                if (auto ptr = abandon()) {
+                    T::destroy(ptr);
                 }
             }
 
@@ -221,6 +324,11 @@ namespace EML
                 return fPtr;
             }
 
+            T* get() const
+            {
+                return fPtr;
+            }
+
             friend bool operator==(intrusive_shared_ptr const& lhs, intrusive_shared_ptr const& rhs)
             {
                 return lhs.fPtr == rhs.fPtr;
@@ -252,10 +360,37 @@ namespace EML
                 return true;
             }
 
+            /// Give up this use without releasing it and return the
+            /// pointer, which must later be adopted by
+            /// `intrusive_shared_ptr(U*)`.
+            T* detach()
+            {
+                auto result = fPtr;
+                fPtr = nullptr;
+                return result;
+            }
+
+            /// Give up this use.  If it was the last, return the pointer
+            /// without destroying it, for the caller to pass to
+            /// `T::destroy` now or later.  Otherwise return `nullptr`.
+            T* abandon()
+            {
+                auto result = fPtr;
+                fPtr = nullptr;
+                if (auto block = static_cast<typename T::control_block_type*>(result)) {
+                    // A unique use cannot race with another thread, so the
+                    // decrement is skipped entirely.
+                    if (block->unique() || block->release()) {
+                        return result;
+                    }
+                }
+                return nullptr;
+            }
+
           private:
-            control_block* get_control_block() const
+            typename T::control_block_type* get_control_block() const
             {
-                return static_cast<control_block*>(fPtr);
+                return static_cast<typename T::control_block_type*>(fPtr);
             }
 
             T* fPtr;
@@ -267,453 +402,1218 @@ namespace EML
             lhs.swap(rhs);
         }
 
-        template <
-            typename T,
-            typename Arg0,
-            typename Arg1
-            >
-        intrusive_shared_ptr<T> make_shared(Arg0&& arg0, Arg1&& arg1)
-        {
-            return intrusive_shared_ptr<T>(new T(std::forward<Arg0>(arg0),
-                                                 std::forward<Arg1>(arg1)));
-        }
-
-        template <
-            typename T,
-            typename Arg0,
-            typename Arg1,
-            typename Arg2,
-            typename Arg3
-            >
-        intrusive_shared_ptr<T> make_shared(Arg0&& arg0, Arg1&& arg1, Arg2&& arg2, Arg3&& arg3)
-        {
-            return intrusive_shared_ptr<T>(new T(std::forward<Arg0>(arg0),
-                                                 std::forward<Arg1>(arg1),
-                                                 std::forward<Arg2>(arg2),
-                                                 std::forward<Arg3>(arg3)));
-        }
-
-        template <typename ValueType>
-        struct iterator
+        /// Node allocator using the global `operator new`.  An `Allocator`
+        /// must provide a member `allocate(std::size_t)` returning storage
+        /// suitably aligned for any node, and a `static`
+        /// `deallocate(void*, std::size_t)`.  Deallocation is `static`
+        /// because a node may be released by any copy of the tree that
+        /// shares it, not only by the tree that allocated it.
+        struct new_allocator
         {
-            template <typename>
-            friend struct iterator;
-
-            iterator()
-                : fValue(nullptr)
-            {}
-
-            template <typename OtherValueType>
-            iterator(iterator<OtherValueType> const& i)
-                : fValue(i.fValue)
-            {}
-
-            explicit iterator(ValueType* value)
-                : fValue(value)
-            {}
+            void* allocate(std::size_t size)
+            {
+                return ::operator new(size);
+            }
 
-            ValueType& operator*() const
+            static void deallocate(void* p, std::size_t)
             {
-                return *fValue;
+                ::operator delete(p);
             }
+        };
 
-            ValueType* operator->() const
+        /// Node allocator keeping a free list per size class.  Sizes are
+        /// rounded up to a multiple of `alignof(std::max_align_t)`, so
+        /// `branch` and `leaf` nodes each land in their own class and a freed
+        /// node is reused by the next allocation of the same kind.  Free
+        /// lists are per thread, so neither allocation nor deallocation
+        /// usually takes a lock.  A node is freed to the thread releasing
+        /// its last use, which need not be the thread that allocated it, as
+        /// when a writer publishes versions that readers drop.  A thread's
+        /// free list for a class is therefore bounded: once it reaches
+        /// three batches of `batch_count` blocks, one batch is handed to a
+        /// global pool, from which threads that run out take batches back.  Storage is
+        /// carved from large chunks that are retained for the life of the
+        /// process.  The free lists of an exiting thread go to the global
+        /// pool, as do nodes released by a thread after its free lists are
+        /// gone, such as by the destructor of another `thread_local`.
+        struct pool_allocator
+        {
+            void* allocate(std::size_t size)
             {
-                return fValue;
+                if (size > max_size) {
+                    return ::operator new(size);
+                }
+                if (auto local = local_pool::get()) {
+                    return local->allocate(size_class(size));
+                }
+                return global_pool::get().allocate(size_class(size));
             }
 
-            friend bool operator==(iterator const& lhs, iterator const& rhs)
+            static void deallocate(void* p, std::size_t size)
             {
-                return lhs.fValue == rhs.fValue;
+                if (size > max_size) {
+                    ::operator delete(p);
+                    return;
+                }
+                if (auto local = local_pool::get()) {
+                    local->deallocate(p, size_class(size));
+                } else {
+                    global_pool::get().deallocate(p, size_class(size));
+                }
             }
 
-            friend bool operator!=(iterator const& lhs, iterator const& rhs)
+            /// The bytes of all chunks carved so far by any thread.
+            static std::size_t reserved()
             {
-                return lhs.fValue != rhs.fValue;
+                return chunks().load(std::memory_order_relaxed) * chunk_size;
             }
 
           private:
-            ValueType* fValue;
-        };
-
-        /// If `key` is definitely not contained by a branch having prefix
-        /// `prefix` and mask `mask`, return `true`.  This function may return
-        /// false negatives.
-        template <typename Key, typename Prefix, typename Mask>
-        bool not_mem(Key const& key, Prefix const& prefix, Mask const& mask)
-        {
-            return (key & (~(mask - static_cast<Mask>(1)) ^ mask)) != prefix;
-        }
+            static const std::size_t granularity = alignof(std::max_align_t);
+            static const std::size_t max_size = 16 * granularity;
+            static const std::size_t class_count = max_size / granularity;
+            static const std::size_t chunk_size = 64 * 1024;
+            /// The number of blocks moved between a thread and the global
+            /// pool at once.
+            static const std::size_t batch_count = 256;
+
+            /// A free block.  The first block of a batch in the global pool
+            /// also links to the next batch.
+            struct block
+            {
+                block* fNext;
+                block* fNextBatch;
+            };
+
+            static_assert(sizeof(block) <= granularity, "a free block must fit the smallest size class");
+
+            static std::size_t size_class(std::size_t size)
+            {
+                return (size + granularity - 1) / granularity - 1;
+            }
+
+            static std::atomic<std::size_t>& chunks()
+            {
+                static std::atomic<std::size_t> result(0);
+                return result;
+            }
+
+            /// Carve a new chunk into batches of blocks of class `i`, linked
+            /// through their first blocks.
+            static block* carve(std::size_t i)
+            {
+                auto size = (i + 1) * granularity;
+                auto chunk = static_cast<char*>(::operator new(chunk_size));
+                chunks().fetch_add(1, std::memory_order_relaxed);
+                block* result = nullptr;
+                block* batch = nullptr;
+                std::size_t count = 0;
+                for (auto p = chunk; p + size <= chunk + chunk_size; p += size) {
+                    auto free = reinterpret_cast<block*>(p);
+                    free->fNext = batch;
+                    batch = free;
+                    if (++count == batch_count) {
+                        batch->fNextBatch = result;
+                        result = batch;
+                        batch = nullptr;
+                        count = 0;
+                    }
+                }
+                if (batch) {
+                    batch->fNextBatch = result;
+                    result = batch;
+                }
+                return result;
+            }
 
-        /// If `key` may be in the left node of a branch, return true.
-        /// Otherwise, return false.
-        template <typename Prefix, typename Mask>
-        bool left(Prefix const& key, Mask const& mask)
-        {
-            return (key & mask) == static_cast<Prefix>(0);
-        }
+            /// Batches of free blocks handed over by threads holding too
+            /// many, or by threads that exited.
+            struct global_pool
+            {
+                global_pool()
+                {
+                    std::fill(fBatches, fBatches + class_count, nullptr);
+                }
 
-        /// The interface required by all nodes.
-        template <typename, typename, typename, typename>
-        struct node;
+                static global_pool& get()
+                {
+                    // Intentionally leaked so that nodes released during
+                    // static destruction can still be returned.
+                    static global_pool* instance = new global_pool;
+                    return *instance;
+                }
 
-        /// A branch node containing a prefix, a mask, a left node, and a right
-        /// node.
-        template <typename, typename, typename, typename>
-        struct branch;
+                /// Take a batch of class `i`, carving a new chunk if there
+                /// are none.
+                block* pop(std::size_t i)
+                {
+                    std::lock_guard<std::mutex> lock(fMutex);
+                    if (!fBatches[i]) {
+                        fBatches[i] = carve(i);
+                    }
+                    auto result = fBatches[i];
+                    fBatches[i] = result->fNextBatch;
+                    return result;
+                }
 
-        /// A leaf node containing a key-value pair.
-        template <typename, typename, typename, typename>
-        struct leaf;
+                /// Hand over the batch of class `i` starting at `batch`.
+                void push(block* batch, std::size_t i)
+                {
+                    std::lock_guard<std::mutex> lock(fMutex);
+                    batch->fNextBatch = fBatches[i];
+                    fBatches[i] = batch;
+                }
 
-        /// Construct a mask from two prefixes by finding the most significant
-        /// bit the prefixes differ at.  Only this bit is set in the result
-        /// mask.
-        template <typename Mask, typename Prefix>
-        Mask make_mask(Prefix prefix1, Prefix prefix2)
-        {
-            return static_cast<Mask>(1) << static_cast<Mask>(log2(prefix1 ^ prefix2));
-        }
+                /// Allocate for a thread whose free lists are gone.
+                void* allocate(std::size_t i)
+                {
+                    auto result = pop(i);
+                    if (auto rest = result->fNext) {
+                        push(rest, i);
+                    }
+                    return result;
+                }
 
-        /// Construct a prefix by zeroing out all the bits of the prefix at and
-        /// below the single bit set on the mask.
-        template <typename Prefix, typename Mask>
-        Prefix make_prefix(Prefix prefix, Mask mask)
-        {
-            return prefix & (~(mask - static_cast<Mask>(1)) ^ mask);
-        }
+                /// Deallocate for a thread whose free lists are gone, as a
+                /// batch of one block.
+                void deallocate(void* p, std::size_t i)
+                {
+                    auto free = static_cast<block*>(p);
+                    free->fNext = nullptr;
+                    push(free, i);
+                }
 
-        /// Construct a `intrusive_shared_ptr` to a `branch` from two prefixes
-        /// and two nodes.  This function determines which node should be the
-        /// left node and which node should be the right node.
-        template <typename Prefix, typename Mask, typename Key, typename T>
-        intrusive_shared_ptr<branch<Key, T, Prefix, Mask>> make_branch(Prefix const& prefix1,
-                                                                       intrusive_shared_ptr<node<Key, T, Prefix, Mask>> node1,
-                                                                       Prefix const& prefix2,
-                                                                       intrusive_shared_ptr<node<Key, T, Prefix, Mask>> node2)
-        {
-            auto mask = make_mask<Mask>(prefix1, prefix2);
-            auto prefix = make_prefix(prefix1, mask);
-            if (left(prefix1, mask)) {
-                return make_shared<branch<Key, T, Prefix, Mask>>(prefix,
-                                                                 mask,
-                                                                 std::move(node1),
-                                                                 std::move(node2));
-            }
-            return make_shared<branch<Key, T, Prefix, Mask>>(prefix,
-                                                             mask,
-                                                             std::move(node2),
-                                                             std::move(node1));
-        }
+              private:
+                std::mutex fMutex;
+                block* fBatches[class_count];
+            };
 
-        template <typename This>
-        struct find_result
-            : std::conditional<is_pointer_to_const<This>::value,
-                               typename remove_pointer<This>::type::const_iterator,
-                               typename remove_pointer<This>::type::iterator>
-        {};
+            struct local_pool
+            {
+                local_pool()
+                {
+                    std::fill(fFree, fFree + class_count, nullptr);
+                    std::fill(fCount, fCount + class_count, 0);
+                }
 
-        template <
-            typename Key,
-            typename T,
-            typename Prefix,
-            typename Mask
-            >
-        struct node : control_block
-        {
-            typedef node node_type;
-            typedef branch<Key, T, Prefix, Mask> branch_type;
-            typedef leaf<Key, T, Prefix, Mask> leaf_type;
-            typedef Key key_type;
-            typedef T mapped_type;
-            typedef std::pair<key_type const, mapped_type> value_type;
-            typedef shared_radix_tree_detail::iterator<value_type> iterator;
-            typedef shared_radix_tree_detail::iterator<value_type const> const_iterator;
-            typedef int size_type;
+                ~local_pool()
+                {
+                    destroyed() = true;
+                    auto& global = global_pool::get();
+                    for (std::size_t i = 0; i != class_count; ++i) {
+                        if (fFree[i]) {
+                            global.push(fFree[i], i);
+                        }
+                    }
+                }
 
-            virtual ~node() {}
+                /// The calling thread's free lists, or `nullptr` once they
+                /// were destroyed at thread exit.
+                static local_pool* get()
+                {
+                    if (destroyed()) {
+                        return nullptr;
+                    }
+                    static thread_local local_pool instance;
+                    return &instance;
+                }
 
-            /// Insert a value under this node.  This node's
-            /// `intrusive_shared_ptr` should be passed as an additional
-            /// argument.  The result is a `std::tuple` containing a
-            /// `intrusive_shared_ptr` that should replace this node, an
-            /// `iterator` pointing to the found or inserted value, and a
-            /// `bool` indicating if an insertion occurred.  The path up to but
-            /// not necessarily including this node's `intrusive_shared_ptr` is
-            /// required to be unique, possibly allowing for destructive
-            /// update.
-            /// @see insert_shared
-            virtual std::tuple<intrusive_shared_ptr<node>, iterator, bool> insert_unique(intrusive_shared_ptr<node> const&, value_type const&) = 0;
+                void* allocate(std::size_t i)
+                {
+                    if (!fFree[i]) {
+                        refill(i);
+                    }
+                    auto result = fFree[i];
+                    fFree[i] = result->fNext;
+                    --fCount[i];
+                    return result;
+                }
 
-            /// Similar to `insert_unique`, except the path up to this node is
-            /// known to not be unique.  Therefore, destructive updates may not
-            /// be used.
-            /// @see insert_unique
-            virtual std::tuple<intrusive_shared_ptr<node>, iterator, bool> insert_shared(intrusive_shared_ptr<node> const&, value_type const&) = 0;
+                void deallocate(void* p, std::size_t i)
+                {
+                    auto free = static_cast<block*>(p);
+                    free->fNext = fFree[i];
+                    fFree[i] = free;
+                    if (++fCount[i] == 3 * batch_count) {
+                        spill(i);
+                    }
+                }
 
-            virtual iterator find(Key const&) = 0;
+              private:
+                /// Whether the calling thread's `local_pool` was destroyed.
+                /// A `bool` has no destructor, so this remains readable
+                /// after `instance` is gone.
+                static bool& destroyed()
+                {
+                    static thread_local bool flag = false;
+                    return flag;
+                }
 
-            virtual const_iterator find(Key const&) const = 0;
+                /// Take a batch from the global pool.
+                void refill(std::size_t i)
+                {
+                    fFree[i] = global_pool::get().pop(i);
+                    fCount[i] = 0;
+                    for (auto free = fFree[i]; free; free = free->fNext) {
+                        ++fCount[i];
+                    }
+                }
 
-            virtual std::tuple<intrusive_shared_ptr<node>, size_type> erase_unique(intrusive_shared_ptr<node_type> const&, key_type const&) = 0;
+                /// Hand the most recently freed `batch_count` blocks to the
+                /// global pool.  `O(batch_count)`, once per `batch_count`
+                /// deallocations.
+                void spill(std::size_t i)
+                {
+                    auto batch = fFree[i];
+                    auto last = batch;
+                    for (std::size_t n = 1; n != batch_count; ++n) {
+                        last = last->fNext;
+                    }
+                    fFree[i] = last->fNext;
+                    last->fNext = nullptr;
+                    fCount[i] -= batch_count;
+                    global_pool::get().push(batch, i);
+                }
 
-            virtual std::tuple<intrusive_shared_ptr<node>, size_type> erase_shared(intrusive_shared_ptr<node_type> const&, key_type const&) = 0;
+                block* fFree[class_count];
+                std::size_t fCount[class_count];
+            };
         };
 
-        template <
-            typename Key,
-            typename T,
-            typename Prefix,
-            typename Mask
-            >
-        struct branch : node<Key, T, Prefix, Mask>
+        /// Whether a tree using `lhs` may keep nodes allocated by `rhs`.
+        /// Allocators whose nodes outlive the allocator itself always may.
+        template <typename Allocator>
+        bool shares_nodes(Allocator const&, Allocator const&)
         {
-            typedef node<Key, T, Prefix, Mask> node_type;
-            using typename node_type::branch_type;
-            using typename node_type::leaf_type;
-            using typename node_type::key_type;
-            using typename node_type::mapped_type;
-            using typename node_type::value_type;
-            using typename node_type::iterator;
-            using typename node_type::const_iterator;
-            using typename node_type::size_type;
+            return true;
+        }
 
-            template <
-                typename OtherPrefix,
-                typename OtherMask,
-                typename OtherLeft,
-                typename OtherRight
-                >
-            branch(OtherPrefix&& prefix, OtherMask&& mask, OtherLeft&& left, OtherRight&& right)
-                : fPrefix(std::forward<OtherPrefix>(prefix))
-                , fMask(std::forward<OtherMask>(mask))
-                , fLeft(std::forward<OtherLeft>(left))
-                , fRight(std::forward<OtherRight>(right))
+        /// Node allocator bumping a pointer through chunks owned by an arena.
+        /// Deallocation is a no-op; the arena's memory is released at once
+        /// when the last copy of the allocator is destroyed.  A
+        /// default-constructed allocator lazily creates its own arena, so
+        /// each tree gets a private arena shared only with its copies.  Every
+        /// node of a tree must be released before its arena, which holds as
+        /// long as nodes are only shared between copies of the same tree;
+        /// set operations copy the values of an operand from another arena
+        /// rather than share its nodes.
+        struct arena_allocator
+        {
+            explicit arena_allocator(std::size_t chunkSize = 64 * 1024)
+                : fChunkSize(chunkSize)
             {}
 
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool> insert_unique(intrusive_shared_ptr<node_type> const& ptr, value_type const& value) override final
+            void* allocate(std::size_t size)
             {
-                if (not_mem(value.first, fPrefix, fMask)) {
-                    return insert_not_mem(ptr, value);
-                }
-                if (left(static_cast<Prefix>(value.first), fMask)) {
-                    return insert_left(ptr, value);
+                if (!fArena) {
+                    fArena = std::make_shared<arena>();
                 }
-                return insert_right(ptr, value);
+                return fArena->allocate(size, fChunkSize);
             }
 
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool> insert_shared(intrusive_shared_ptr<node_type> const& ptr, value_type const& value) override final
-            {
-                if (not_mem(value.first, fPrefix, fMask)) {
-                    return insert_not_mem(ptr, value);
-                }
-                if (left(static_cast<Prefix>(value.first), fMask)) {
-                    return insert_left_shared(value);
-                }
-                return insert_right_shared(value);
-            }
+            static void deallocate(void*, std::size_t)
+            {}
 
-            iterator find(key_type const& key) override final
+            friend bool shares_nodes(arena_allocator const& lhs, arena_allocator const& rhs)
             {
-                return find_impl(this, key);
+                return lhs.fArena == rhs.fArena;
             }
 
-            const_iterator find(key_type const& key) const override final
+          private:
+            struct arena
             {
-                return find_impl(this, key);
-            }
+                arena()
+                    : fNext(nullptr)
+                    , fEnd(nullptr)
+                {}
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type> erase_unique(intrusive_shared_ptr<node_type> const& ptr, key_type const& key) override final
-            {
-                if (not_mem(key, fPrefix, fMask)) {
-                    return erase_not_mem(ptr);
-                }
-                if (left(static_cast<Prefix>(key), fMask)) {
-                    return erase_left(ptr, key);
+                ~arena()
+                {
+                    for (auto chunk : fChunks) {
+                        ::operator delete(chunk);
+                    }
                 }
-                return erase_right(ptr, key);
-            }
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type> erase_shared(intrusive_shared_ptr<node_type> const& ptr, key_type const& key) override final
-            {
-                if (not_mem(key, fPrefix, fMask)) {
-                    return erase_not_mem(ptr);
-                }
-                if (left(static_cast<Prefix>(key), fMask)) {
-                    return erase_left_shared(key);
+                void* allocate(std::size_t size, std::size_t chunkSize)
+                {
+                    static const std::size_t alignment = alignof(std::max_align_t);
+                    size = (size + alignment - 1) / alignment * alignment;
+                    if (static_cast<std::size_t>(fEnd - fNext) < size) {
+                        chunkSize = std::max(size, chunkSize);
+                        fChunks.reserve(fChunks.size() + 1);
+                        fNext = static_cast<char*>(::operator new(chunkSize));
+                        fEnd = fNext + chunkSize;
+                        fChunks.push_back(fNext);
+                    }
+                    auto result = fNext;
+                    fNext += size;
+                    return result;
                 }
-                return erase_right_shared(key);
-            }
 
-          private:
-            /// Insert `value` by constructing a new `branch` node and setting
-            /// `this` node and a new `leaf` containing `value` under it.
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool>
-            insert_not_mem(intrusive_shared_ptr<node_type> ptr, value_type const& value) const
-            {
-                auto leaf = make_shared<leaf_type>(value.first, value.second);
-                iterator i(&leaf->get());
-                auto branch = make_branch(static_cast<Prefix>(value.first), intrusive_shared_ptr<node_type>(std::move(leaf)), fPrefix, std::move(ptr));
-                return std::make_tuple(std::move(branch), i, true);
-            }
+                std::vector<void*> fChunks;
+                char* fNext;
+                char* fEnd;
+            };
 
-            /// Insert `value` by inserting `value` in `fLeft`, destructively
-            /// if `this` `ptr` is `unique`, non-destructively otherwise.
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool>
-            insert_left(intrusive_shared_ptr<node_type> const& ptr, value_type const& value)
-            {
-                if (ptr.unique()) {
-                    return insert_left_unique(ptr, value);
-                }
-                return insert_left_shared(value);
-            }
+            std::size_t fChunkSize;
+            std::shared_ptr<arena> fArena;
+        };
 
-            /// Insert `value` by inserting `value` in `fLeft` destructively.
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool>
-            insert_left_unique(intrusive_shared_ptr<node_type> ptr, value_type const& value)
-            {
-                iterator i;
-                bool inserted;
-                std::tie(fLeft, i, inserted) = fLeft->insert_unique(fLeft, value);
-                return std::make_tuple(std::move(ptr), i, inserted);
-            }
+        /// Whether copies of `Allocator` may allocate on several threads at
+        /// once, as the parallel operations do.  An allocator whose copies
+        /// share an unsynchronized arena may not.
+        template <typename Allocator>
+        struct concurrent_allocation : std::true_type
+        {};
 
-            /// Insert `value` by inserting `value` in `fLeft` non-
-            /// destructively.
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool>
-            insert_left_shared(value_type const& value) const
+        template <>
+        struct concurrent_allocation<arena_allocator> : std::false_type
+        {};
+
+        /// Construct a `T` in storage obtained from `alloc`.
+        template <
+            typename T,
+            typename Allocator,
+            typename Arg0,
+            typename Arg1
+            >
+        intrusive_shared_ptr<T> allocate_shared(Allocator& alloc, Arg0&& arg0, Arg1&& arg1)
+        {
+            auto p = alloc.allocate(sizeof(T));
+            try {
+                return intrusive_shared_ptr<T>(::new (p) T(std::forward<Arg0>(arg0),
+                                                           std::forward<Arg1>(arg1)));
+            } catch (...) {
+                Allocator::deallocate(p, sizeof(T));
+                throw;
+            }
+        }
+
+        /// Construct a `T` in storage obtained from `alloc`.
+        template <
+            typename T,
+            typename Allocator,
+            typename Arg0,
+            typename Arg1,
+            typename Arg2
+            >
+        intrusive_shared_ptr<T> allocate_shared(Allocator& alloc, Arg0&& arg0, Arg1&& arg1, Arg2&& arg2)
+        {
+            auto p = alloc.allocate(sizeof(T));
+            try {
+                return intrusive_shared_ptr<T>(::new (p) T(std::forward<Arg0>(arg0),
+                                                           std::forward<Arg1>(arg1),
+                                                           std::forward<Arg2>(arg2)));
+            } catch (...) {
+                Allocator::deallocate(p, sizeof(T));
+                throw;
+            }
+        }
+
+        /// Construct a `T` in storage obtained from `alloc`.
+        template <
+            typename T,
+            typename Allocator,
+            typename Arg0,
+            typename Arg1,
+            typename Arg2,
+            typename Arg3
+            >
+        intrusive_shared_ptr<T> allocate_shared(Allocator& alloc, Arg0&& arg0, Arg1&& arg1, Arg2&& arg2, Arg3&& arg3)
+        {
+            auto p = alloc.allocate(sizeof(T));
+            try {
+                return intrusive_shared_ptr<T>(::new (p) T(std::forward<Arg0>(arg0),
+                                                           std::forward<Arg1>(arg1),
+                                                           std::forward<Arg2>(arg2),
+                                                           std::forward<Arg3>(arg3)));
+            } catch (...) {
+                Allocator::deallocate(p, sizeof(T));
+                throw;
+            }
+        }
+
+        /// The type in which to do arithmetic on the bits of a `Mask`: the
+        /// unsigned counterpart of an integral `Mask`, for which subtracting
+        /// one from the sign bit or shifting one into it is undefined, and
+        /// `Mask` itself otherwise.
+        template <typename Mask, bool = std::is_integral<Mask>::value>
+        struct mask_bits
+        {
+            typedef Mask type;
+        };
+
+        template <typename Mask>
+        struct mask_bits<Mask, true>
+        {
+            typedef typename std::make_unsigned<Mask>::type type;
+        };
+
+        /// Return the bits more significant than the single bit set in
+        /// `mask`.
+        template <typename Mask>
+        Mask bits_above(Mask const& mask)
+        {
+            typedef typename mask_bits<Mask>::type bits_type;
+            auto bits = static_cast<bits_type>(mask);
+            return static_cast<Mask>(~(bits - static_cast<bits_type>(1)) ^ bits);
+        }
+
+        /// If `key` is definitely not contained by a branch having prefix
+        /// `prefix` and mask `mask`, return `true`.  This function may return
+        /// false negatives.
+        template <typename Key, typename Prefix, typename Mask>
+        bool not_mem(Key const& key, Prefix const& prefix, Mask const& mask)
+        {
+            return (key & bits_above(mask)) != prefix;
+        }
+
+        /// If `key` may be in the left node of a branch, return true.
+        /// Otherwise, return false.
+        template <typename Prefix, typename Mask>
+        bool left(Prefix const& key, Mask const& mask)
+        {
+            return (key & mask) == static_cast<Prefix>(0);
+        }
+
+        /// Compare two integral prefixes or masks as unsigned values.  This
+        /// is the order in which a tree visits its keys.
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value, bool>::type
+        unsigned_less(T lhs, T rhs)
+        {
+            typedef typename std::make_unsigned<T>::type unsigned_type;
+            return static_cast<unsigned_type>(lhs) < static_cast<unsigned_type>(rhs);
+        }
+
+        /// If the bit set in `mask1` is more significant than the bit set in
+        /// `mask2`, return `true`.  A `branch` masking a more significant bit
+        /// has a shorter prefix and sits higher in the tree.
+        template <typename Mask>
+        bool higher(Mask const& mask1, Mask const& mask2)
+        {
+            return unsigned_less(mask2, mask1);
+        }
+
+        /// Forward iterator visiting values in the unsigned order of their
+        /// keys' `Prefix` bits.  Besides the current value, an iterator holds
+        /// a fixed-depth stack of the `branch` nodes whose right subtrees
+        /// are yet to be visited.  The stack of an iterator returned from
+        /// `find` or `insert` is only built, from the root, once it is
+        /// incremented.  Like the values they point to, iterators are
+        /// invalidated by any modification of the tree.
+        template <typename Node, typename ValueType>
+        struct iterator
+        {
+            template <typename, typename>
+            friend struct iterator;
+
+            typedef std::forward_iterator_tag iterator_category;
+            typedef typename std::remove_const<ValueType>::type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef ValueType* pointer;
+            typedef ValueType& reference;
+
+            iterator()
+                : fValue(nullptr)
+                , fRoot(nullptr)
+                , fDepth(0)
+            {}
+
+            /// Construct an iterator pointing to the least value under
+            /// `root`.
+            explicit iterator(Node const* root)
+                : fValue(nullptr)
+                , fRoot(root)
+                , fDepth(0)
             {
-                intrusive_shared_ptr<node_type> left;
-                iterator i;
-                bool inserted;
-                std::tie(left, i, inserted) = fLeft->insert_shared(fLeft, value);
-                auto branch = make_shared<branch_type>(fPrefix, fMask, std::move(left), fRight);
-                return std::make_tuple(std::move(branch), i, inserted);
+                if (root) {
+                    descend(root);
+                }
             }
 
-            /// Insert `value` by inserting `value` in `fRight`, destructively
-            /// if `this` `ptr` is `unique`, non-destructively otherwise.
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool>
-            insert_right(intrusive_shared_ptr<node_type> const& ptr, value_type const& value)
+            /// Construct an iterator pointing to `value` under `root`.
+            iterator(Node const* root, ValueType* value)
+                : fValue(value)
+                , fRoot(root)
+                , fDepth(unbuilt)
+            {}
+
+            /// Construct an iterator pointing to the least value under
+            /// `root` whose key's prefix is not less than `bound`, or greater
+            /// than `bound` if `strict` is `true`.
+            iterator(Node const* root, typename Node::prefix_type const& bound, bool strict)
+                : fValue(nullptr)
+                , fRoot(root)
+                , fDepth(0)
             {
-                if (ptr.unique()) {
-                    return insert_right_unique(ptr, value);
+                if (root) {
+                    seek(root, bound, strict);
                 }
-                return insert_right_shared(value);
             }
 
-            /// Insert `value` by inserting `value` in `fRight` destructively.
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool>
-            insert_right_unique(intrusive_shared_ptr<node_type> ptr, value_type const& value)
+            iterator(iterator const& i)
+                : fValue(i.fValue)
+                , fRoot(i.fRoot)
+                , fDepth(i.fDepth)
             {
-                iterator i;
-                bool inserted;
-                std::tie(fRight, i, inserted) = fRight->insert_unique(fRight, value);
-                return std::make_tuple(std::move(ptr), i, inserted);
+                copy_stack(i);
             }
 
-            /// Insert `value` by inserting `value` in `fRight` non-
-            /// destructively.
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool>
-            insert_right_shared(value_type const& value) const
+            template <typename OtherValueType>
+            iterator(iterator<Node, OtherValueType> const& i)
+                : fValue(i.fValue)
+                , fRoot(i.fRoot)
+                , fDepth(i.fDepth)
             {
-                intrusive_shared_ptr<node_type> right;
-                iterator i;
-                bool inserted;
-                std::tie(right, i, inserted) = fRight->insert_shared(fRight, value);
-                auto branch = make_shared<branch_type>(fPrefix, fMask, fLeft, std::move(right));
-                return std::make_tuple(std::move(branch), i, inserted);
+                copy_stack(i);
             }
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type>
-            erase_not_mem(intrusive_shared_ptr<node_type> ptr)
+            iterator& operator=(iterator const& i)
             {
-                return std::make_tuple(std::move(ptr), 0);
+                fValue = i.fValue;
+                fRoot = i.fRoot;
+                fDepth = i.fDepth;
+                copy_stack(i);
+                return *this;
             }
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type>
-            erase_left(intrusive_shared_ptr<node_type> const& ptr, key_type const& key)
+            ValueType& operator*() const
             {
-                if (ptr.unique()) {
-                    return erase_left_unique(ptr, key);
+                return *fValue;
+            }
+
+            ValueType* operator->() const
+            {
+                return fValue;
+            }
+
+            iterator& operator++()
+            {
+                if (fDepth == unbuilt) {
+                    build_stack();
                 }
-                return erase_left_shared(key);
+                skip();
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                iterator result(*this);
+                ++*this;
+                return result;
+            }
+
+            friend bool operator==(iterator const& lhs, iterator const& rhs)
+            {
+                return lhs.fValue == rhs.fValue;
             }
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type>
-            erase_left_unique(intrusive_shared_ptr<node_type> const& ptr, key_type const& key)
+            friend bool operator!=(iterator const& lhs, iterator const& rhs)
             {
-                intrusive_shared_ptr<node_type> left;
-                size_type result;
-                std::tie(left, result) = fLeft->erase_unique(fLeft, key);
-                if (left) {
-                    fLeft = std::move(left);
-                    return std::make_tuple(ptr, result);
+                return lhs.fValue != rhs.fValue;
+            }
+
+          private:
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::prefix_type prefix_type;
+
+            /// Every `branch` on a path masks a lower bit than its parent, so
+            /// a path cannot hold more `branch` nodes than `Prefix` has bits.
+            static const int max_depth = sizeof(prefix_type) * CHAR_BIT;
+
+            static const int unbuilt = -1;
+
+            template <typename OtherValueType>
+            void copy_stack(iterator<Node, OtherValueType> const& i)
+            {
+                if (fDepth > 0) {
+                    std::copy(i.fStack, i.fStack + fDepth, fStack);
                 }
-                return std::make_tuple(fRight, result);
             }
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type>
-            erase_left_shared(key_type const& key)
+            /// Walk to the least value under `node`, pushing every `branch`
+            /// passed on the way.
+            void descend(Node const* node)
             {
-                intrusive_shared_ptr<node_type> left;
-                size_type result;
-                std::tie(left, result) = fLeft->erase_shared(fLeft, key);
-                if (left) {
-                    auto branch = make_shared<branch_type>(fPrefix, fMask, std::move(left), fRight);
-                    return std::make_tuple(std::move(branch), result);
+                while (!node->is_leaf()) {
+                    auto branch = static_cast<branch_type const*>(node);
+                    fStack[fDepth++] = branch;
+                    node = branch->left_child().get();
+                }
+                fValue = &static_cast<leaf_type*>(const_cast<Node*>(node))->get();
+            }
+
+            /// Walk towards `bound`, pushing every `branch` left on the way,
+            /// and stop at the first value past it.  Either the walk leaves
+            /// the path of `bound` at a subtree whose keys all compare on
+            /// one side of `bound`, or it reaches a `leaf`.
+            void seek(Node const* node, prefix_type const& bound, bool strict)
+            {
+                while (!node->is_leaf()) {
+                    auto branch = static_cast<branch_type const*>(node);
+                    if (not_mem(bound, branch->prefix(), branch->mask())) {
+                        if (unsigned_less(bound, branch->prefix())) {
+                            descend(branch);
+                        } else {
+                            skip();
+                        }
+                        return;
+                    }
+                    if (left(bound, branch->mask())) {
+                        fStack[fDepth++] = branch;
+                        node = branch->left_child().get();
+                    } else {
+                        node = branch->right_child().get();
+                    }
+                }
+                auto leaf = static_cast<leaf_type*>(const_cast<Node*>(node));
+                auto prefix = static_cast<prefix_type>(leaf->get().first);
+                if (strict ? unsigned_less(bound, prefix) : !unsigned_less(prefix, bound)) {
+                    fValue = &leaf->get();
+                } else {
+                    skip();
                 }
-                return std::make_tuple(fRight, result);
             }
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type>
-            erase_right(intrusive_shared_ptr<node_type> const& ptr, key_type const& key)
+            /// Move to the least value after every subtree passed so far.
+            void skip()
             {
-                if (ptr.unique()) {
-                    return erase_right_unique(ptr, key);
+                if (fDepth == 0) {
+                    fValue = nullptr;
+                } else {
+                    descend(fStack[--fDepth]->right_child().get());
                 }
-                return erase_right_shared(key);
             }
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type>
-            erase_right_unique(intrusive_shared_ptr<node_type> const& ptr, key_type const& key)
+            /// Rebuild the stack by walking from the root to `fValue`.
+            void build_stack()
             {
-                intrusive_shared_ptr<node_type> right;
-                size_type result;
-                std::tie(right, result) = fRight->erase_unique(fRight, key);
-                if (right) {
-                    fRight = std::move(right);
-                    return std::make_tuple(ptr, result);
+                fDepth = 0;
+                auto node = fRoot;
+                while (!node->is_leaf()) {
+                    auto branch = static_cast<branch_type const*>(node);
+                    if (left(static_cast<prefix_type>(fValue->first), branch->mask())) {
+                        fStack[fDepth++] = branch;
+                        node = branch->left_child().get();
+                    } else {
+                        node = branch->right_child().get();
+                    }
                 }
-                return std::make_tuple(fLeft, result);
             }
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type>
-            erase_right_shared(key_type const& key)
+            ValueType* fValue;
+            Node const* fRoot;
+            int fDepth;
+            branch_type const* fStack[max_depth];
+        };
+
+        /// Order keys by the unsigned value of their `Prefix`, which is the
+        /// order in which a tree visits them.
+        template <typename Key, typename Prefix>
+        struct key_less
+        {
+            bool operator()(Key const& lhs, Key const& rhs) const
             {
-                intrusive_shared_ptr<node_type> right;
-                size_type result;
-                std::tie(right, result) = fRight->erase_shared(fRight, key);
-                if (right) {
-                    auto branch = make_shared<branch_type>(fPrefix, fMask, fLeft, std::move(right));
-                    return std::make_tuple(std::move(branch), result);
+                return unsigned_less(static_cast<Prefix>(lhs), static_cast<Prefix>(rhs));
+            }
+        };
+
+        /// `Counts` policy that stores nothing in a `branch` beyond its
+        /// children.  A tree's `size` is still `O(1)`, but set operations
+        /// count the values of the subtrees they move between trees one by
+        /// one, rather than reading the count of their roots, and the trees
+        /// returned by `split` and `subtree` count their values on their
+        /// first `size`.
+        struct uncounted
+        {
+            typedef std::false_type is_counted;
+
+            template <typename Size>
+            struct branch_base
+            {
+                template <typename Node>
+                void count_children(Node const*, Node const*)
+                {}
+
+                void adjust_count(Size)
+                {}
+            };
+        };
+
+        /// `Counts` policy that stores the number of values under each
+        /// `branch`.  This costs a word per `branch`, keeps `size` exact in
+        /// `O(1)` after every operation, and enables `nth` and `rank`.
+        struct counted
+        {
+            typedef std::true_type is_counted;
+
+            template <typename Size>
+            struct branch_base
+            {
+                template <typename Node>
+                void count_children(Node const* left, Node const* right)
+                {
+                    fCount = size_of(left) + size_of(right);
+                }
+
+                void adjust_count(Size delta)
+                {
+                    fCount += delta;
+                }
+
+                Size count() const
+                {
+                    return fCount;
+                }
+
+              private:
+                template <typename Node>
+                static Size size_of(Node const* node)
+                {
+                    typedef typename Node::branch_type branch_type;
+                    if (node->is_leaf()) {
+                        return 1;
+                    }
+                    return static_cast<branch_type const*>(node)->count();
+                }
+
+                Size fCount;
+            };
+        };
+
+        /// The events reported to a `Metrics` policy.
+        enum class tree_event : unsigned char
+        {
+            /// An `insert` or `erase` on a non-empty tree.
+            write,
+            /// A `write` whose root was shared with another tree, so that
+            /// at least the root had to be copied.
+            shared_write,
+            /// A `branch` updated in place on a path of unique nodes.
+            branch_update,
+            /// A `branch` copied because it was shared with another tree.
+            branch_copy,
+            /// A `branch` constructed, whether by copying or otherwise.
+            branch_create,
+            /// A `leaf` constructed.
+            leaf_create,
+            /// A node destroyed when its last use was released.
+            node_free,
+            /// A key looked up by `find` or by a set operation.
+            lookup
+        };
+
+        int const tree_event_count = 8;
+
+        inline char const* tree_event_name(tree_event event)
+        {
+            static char const* const names[tree_event_count] = {
+                "write",
+                "shared_write",
+                "branch_update",
+                "branch_copy",
+                "branch_create",
+                "leaf_create",
+                "node_free",
+                "lookup"
+            };
+            return names[static_cast<int>(event)];
+        }
+
+        /// `Metrics` policy that counts nothing.  Every hook is an empty
+        /// inline function, so an uninstrumented tree compiles to the same
+        /// code as before the hooks existed.
+        struct no_metrics
+        {
+            static void count(tree_event)
+            {}
+
+            static void count_lookup(int)
+            {}
+
+            template <typename Root>
+            static void count_write(Root const&)
+            {}
+        };
+
+        /// `Metrics` policy that counts every `tree_event`, and every lookup
+        /// by the number of `branch` nodes it passed, in process-wide
+        /// relaxed atomic counters.  All trees using this policy share the
+        /// counters; a policy with the same static members and separate
+        /// counters may be written for each map worth telling apart.  Each
+        /// event costs an uncontended atomic increment on a shared cache
+        /// line, which is cheap next to the allocation most of them stand
+        /// for but not free on a hot `find`.
+        struct atomic_metrics
+        {
+            typedef std::uint64_t value_type;
+
+            /// Lookups passing more `branch` nodes than this are counted at
+            /// this depth.
+            enum { max_depth = 64 };
+
+            static void count(tree_event event)
+            {
+                events()[static_cast<int>(event)].fetch_add(1, std::memory_order_relaxed);
+            }
+
+            static void count_lookup(int depth)
+            {
+                count(tree_event::lookup);
+                depths()[depth < max_depth ? depth : max_depth].fetch_add(1, std::memory_order_relaxed);
+            }
+
+            /// Count a `write` to the tree whose root is `root`.  The use
+            /// count is only read here, so an uninstrumented tree does not
+            /// pay for it.
+            template <typename Root>
+            static void count_write(Root const& root)
+            {
+                count(tree_event::write);
+                if (!root.unique()) {
+                    count(tree_event::shared_write);
                 }
-                return std::make_tuple(fLeft, result);
             }
 
-            /// Implementation of both `const` and non-`const` `find`.
-            template <typename This>
-            static typename find_result<This>::type find_impl(This aThis, key_type const& aKey)
+            static value_type get(tree_event event)
+            {
+                return events()[static_cast<int>(event)].load(std::memory_order_relaxed);
+            }
+
+            static value_type lookups_at_depth(int depth)
+            {
+                return depths()[depth < max_depth ? depth : max_depth].load(std::memory_order_relaxed);
+            }
+
+            /// Call `f(tree_event_name(event), get(event))` for every event,
+            /// for export to a metrics system.
+            template <typename Function>
+            static Function for_each(Function f)
+            {
+                for (int i = 0; i != tree_event_count; ++i) {
+                    auto event = static_cast<tree_event>(i);
+                    f(tree_event_name(event), get(event));
+                }
+                return f;
+            }
+
+            /// Zero every counter.  Events counted concurrently may or may
+            /// not survive.
+            static void reset()
+            {
+                for (int i = 0; i != tree_event_count; ++i) {
+                    events()[i].store(0, std::memory_order_relaxed);
+                }
+                for (int i = 0; i <= max_depth; ++i) {
+                    depths()[i].store(0, std::memory_order_relaxed);
+                }
+            }
+
+          private:
+            typedef std::atomic<value_type> counter_type;
+
+            /// Zero initialized static storage, so no guard is needed.
+            static counter_type* events()
+            {
+                static counter_type result[tree_event_count];
+                return result;
+            }
+
+            static counter_type* depths()
+            {
+                static counter_type result[max_depth + 1];
+                return result;
+            }
+        };
+
+        /// The interface required by all nodes.
+        template <typename, typename, typename, typename, typename, typename, typename, typename>
+        struct node;
+
+        /// A branch node containing a prefix, a mask, a left node, and a right
+        /// node.
+        template <typename, typename, typename, typename, typename, typename, typename, typename>
+        struct branch;
+
+        /// A leaf node containing a key-value pair.
+        template <typename, typename, typename, typename, typename, typename, typename, typename>
+        struct leaf;
+
+        /// Construct a mask from two prefixes by finding the most significant
+        /// bit the prefixes differ at.  Only this bit is set in the result
+        /// mask.
+        template <typename Mask, typename Prefix>
+        Mask make_mask(Prefix prefix1, Prefix prefix2)
+        {
+            typedef typename mask_bits<Mask>::type bits_type;
+            return static_cast<Mask>(static_cast<bits_type>(1) << static_cast<bits_type>(log2(prefix1 ^ prefix2)));
+        }
+
+        /// Construct a prefix by zeroing out all the bits of the prefix at and
+        /// below the single bit set on the mask.
+        template <typename Prefix, typename Mask>
+        Prefix make_prefix(Prefix prefix, Mask mask)
+        {
+            return prefix & bits_above(mask);
+        }
+
+        /// Construct a `intrusive_shared_ptr` to a `branch` from two prefixes
+        /// and two nodes.  This function determines which node should be the
+        /// left node and which node should be the right node.
+        template <typename Prefix, typename Mask, typename Key, typename T, typename RefCount, typename Allocator, typename Counts, typename Metrics>
+        intrusive_shared_ptr<branch<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics>> make_branch(Allocator& alloc,
+                                                                                            Prefix const& prefix1,
+                                                                                            intrusive_shared_ptr<node<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics>> node1,
+                                                                                            Prefix const& prefix2,
+                                                                                            intrusive_shared_ptr<node<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics>> node2)
+        {
+            typedef branch<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics> branch_type;
+            auto mask = make_mask<Mask>(prefix1, prefix2);
+            auto prefix = make_prefix(prefix1, mask);
+            if (left(prefix1, mask)) {
+                return allocate_shared<branch_type>(alloc,
+                                                    prefix,
+                                                    mask,
+                                                    std::move(node1),
+                                                    std::move(node2));
+            }
+            return allocate_shared<branch_type>(alloc,
+                                                prefix,
+                                                mask,
+                                                std::move(node2),
+                                                std::move(node1));
+        }
+
+        /// The value inserted by a call to `insert_value`.  `make` constructs a `leaf` from the key and the
+        /// arguments of the mapped value, forwarding the arguments, so it may
+        /// be called at most once.  If `Assigns` is `std::true_type`, a key
+        /// that is already present has its mapped value replaced with the
+        /// single argument, by `assign` or by a new `leaf` from `make`.
+        template <typename Leaf, typename Assigns, typename MappedArgs>
+        struct leaf_source
+        {
+            typedef Assigns assigns;
+
+            typename Leaf::key_type const& key() const
             {
-                if (not_mem(aKey, aThis->fPrefix, aThis->fMask)) {
-                    return typename find_result<This>::type();
+                return fKey;
+            }
+
+            template <typename Allocator>
+            intrusive_shared_ptr<Leaf> make(Allocator& alloc)
+            {
+                return allocate_shared<Leaf>(alloc, std::piecewise_construct, std::forward_as_tuple(fKey), std::move(fMappedArgs));
+            }
+
+            void assign(typename Leaf::mapped_type& mapped)
+            {
+                assign(mapped, assigns());
+            }
+
+            typename Leaf::key_type const& fKey;
+            MappedArgs fMappedArgs;
+
+          private:
+            void assign(typename Leaf::mapped_type& mapped, std::true_type)
+            {
+                mapped = std::get<0>(std::move(fMappedArgs));
+            }
+
+            void assign(typename Leaf::mapped_type&, std::false_type)
+            {}
+        };
+
+        template <typename Leaf, typename Assigns, typename MappedArgs>
+        leaf_source<Leaf, Assigns, MappedArgs> make_leaf_source(typename Leaf::key_type const& key, MappedArgs mappedArgs)
+        {
+            leaf_source<Leaf, Assigns, MappedArgs> result = {key, std::move(mappedArgs)};
+            return result;
+        }
+
+        template <typename This>
+        struct find_result
+            : std::conditional<is_pointer_to_const<This>::value,
+                               typename remove_pointer<This>::type::const_iterator,
+                               typename remove_pointer<This>::type::iterator>
+        {};
+
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics
+            >
+        struct node : control_block<RefCount>
+        {
+            typedef node node_type;
+            typedef branch<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics> branch_type;
+            typedef leaf<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics> leaf_type;
+            typedef Key key_type;
+            typedef T mapped_type;
+            typedef std::pair<key_type const, mapped_type> value_type;
+            typedef Prefix prefix_type;
+            typedef Mask mask_type;
+            typedef Allocator allocator_type;
+            typedef Counts counts_type;
+            typedef Metrics metrics_type;
+            typedef shared_radix_tree_detail::iterator<node, value_type> iterator;
+            typedef shared_radix_tree_detail::iterator<node, value_type const> const_iterator;
+            typedef int size_type;
+
+            /// The kind of a node is stored in a byte next to the use count
+            /// rather than found through a vtable.  This saves a word per
+            /// node and replaces the indirect call at every level of the tree
+            /// with a predictable branch.
+            enum kind_type : unsigned char
+            {
+                branch_kind,
+                leaf_kind
+            };
+
+            bool is_leaf() const
+            {
+                return fKind == leaf_kind;
+            }
+
+            /// Destroy `aNode` and every node only it uses, returning their
+            /// storage to `Allocator`.  Called by `intrusive_shared_ptr` when
+            /// the last use is released.  Dead nodes are kept on a worklist
+            /// rather than the call stack.  Each level of a path holds at
+            /// most one pending sibling, and masks strictly decrease down a
+            /// path, so the worklist is bounded by the width of `Prefix`.
+            /// `O(k)` for `k` nodes destroyed
+            static void destroy(node* aNode)
+            {
+                node* stack[sizeof(Prefix) * CHAR_BIT + 1];
+                int depth = 0;
+                stack[depth++] = aNode;
+                while (depth != 0) {
+                    destroy_shallow(stack[--depth], [&](node* child) {
+                        stack[depth++] = child;
+                    });
                 }
-                if (left(static_cast<Prefix>(aKey), aThis->fMask)) {
-                    return aThis->fLeft->find(aKey);
+            }
+
+            /// Destroy `aNode` alone, whose last use has been released.  The
+            /// uses of its children are released too, and each child whose
+            /// last use that was is passed to `f(node*)` to be destroyed in
+            /// turn, so that a caller may spread the work of destroying a
+            /// large tree.  `O(1)`
+            template <typename Function>
+            static void destroy_shallow(node* aNode, Function&& f)
+            {
+                Metrics::count(tree_event::node_free);
+                if (aNode->is_leaf()) {
+                    static_cast<leaf_type*>(aNode)->~leaf_type();
+                    Allocator::deallocate(aNode, sizeof(leaf_type));
+                } else {
+                    auto branch = static_cast<branch_type*>(aNode);
+                    if (auto child = branch->child(false).abandon()) {
+                        f(child);
+                    }
+                    if (auto child = branch->child(true).abandon()) {
+                        f(child);
+                    }
+                    branch->~branch_type();
+                    Allocator::deallocate(aNode, sizeof(branch_type));
                 }
-                return aThis->fRight->find(aKey);
             }
 
+          protected:
+            explicit node(kind_type kind)
+                : fKind(kind)
+            {}
+
+            ~node() {}
+
+            node(node const&) = delete;
+            node& operator=(node const&) = delete;
+
+          private:
+            kind_type const fKind;
+        };
+
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics
+            >
+        struct branch
+            : node<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics>
+            , Counts::template branch_base<typename node<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics>::size_type>
+        {
+            typedef node<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics> node_type;
+            using typename node_type::branch_type;
+            using typename node_type::leaf_type;
+            using typename node_type::key_type;
+            using typename node_type::mapped_type;
+            using typename node_type::value_type;
+            using typename node_type::iterator;
+            using typename node_type::const_iterator;
+            using typename node_type::size_type;
+
+            template <
+                typename OtherPrefix,
+                typename OtherMask,
+                typename OtherLeft,
+                typename OtherRight
+                >
+            branch(OtherPrefix&& prefix, OtherMask&& mask, OtherLeft&& left, OtherRight&& right)
+                : node_type(node_type::branch_kind)
+                , fPrefix(std::forward<OtherPrefix>(prefix))
+                , fMask(std::forward<OtherMask>(mask))
+                , fLeft(std::forward<OtherLeft>(left))
+                , fRight(std::forward<OtherRight>(right))
+            {
+                this->count_children(fLeft.get(), fRight.get());
+                Metrics::count(tree_event::branch_create);
+            }
+
+            Prefix const& prefix() const
+            {
+                return fPrefix;
+            }
+
+            Mask const& mask() const
+            {
+                return fMask;
+            }
+
+            intrusive_shared_ptr<node_type> const& left_child() const
+            {
+                return fLeft;
+            }
+
+            intrusive_shared_ptr<node_type> const& right_child() const
+            {
+                return fRight;
+            }
+
+            /// The child on `right`'s side, which `insert_value` and
+            /// `erase_value` rewrite in place once this `branch` is known to
+            /// be unique.
+            intrusive_shared_ptr<node_type>& child(bool right)
+            {
+                return right ? fRight : fLeft;
+            }
+
+            intrusive_shared_ptr<node_type> const& child(bool right) const
+            {
+                return right ? fRight : fLeft;
+            }
+
+          private:
             /// If a key does not match `fPrefix` above the bit set by `fMask`,
             /// such a key cannot be contained under this node.
             Prefix fPrefix;
@@ -721,19 +1621,23 @@ namespace EML
             /// may be contained in `fLeft`.  Otherwise, it may be contained
             /// in `fRight`.
             Mask fMask;
-            intrusive_shared_ptr<node<key_type, mapped_type, Prefix, Mask>> fLeft;
-            intrusive_shared_ptr<node<key_type, mapped_type, Prefix, Mask>> fRight;
+            intrusive_shared_ptr<node<key_type, mapped_type, Prefix, Mask, RefCount, Allocator, Counts, Metrics>> fLeft;
+            intrusive_shared_ptr<node<key_type, mapped_type, Prefix, Mask, RefCount, Allocator, Counts, Metrics>> fRight;
         };
 
         template <
             typename Key,
             typename T,
             typename Prefix,
-            typename Mask
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics
             >
-        struct leaf : node<Key, T, Prefix, Mask>
+        struct leaf : node<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics>
         {
-            typedef node<Key, T, Prefix, Mask> node_type;
+            typedef node<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics> node_type;
             using typename node_type::leaf_type;
             using typename node_type::key_type;
             using typename node_type::mapped_type;
@@ -744,71 +1648,943 @@ namespace EML
 
             template <typename OtherKey, typename U>
             leaf(OtherKey&& key, U&& mapped)
-                : fValue(std::forward<OtherKey>(key), std::forward<U>(mapped))
-            {}
-
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool> insert_unique(intrusive_shared_ptr<node_type> const& ptr, value_type const& value) override final
+                : node_type(node_type::leaf_kind)
+                , fValue(std::forward<OtherKey>(key), std::forward<U>(mapped))
             {
-                return insert_shared(ptr, value);
+                Metrics::count(tree_event::leaf_create);
             }
 
-            std::tuple<intrusive_shared_ptr<node_type>, iterator, bool> insert_shared(intrusive_shared_ptr<node_type> const& ptr, value_type const& value) override final
+            template <typename KeyArgs, typename MappedArgs>
+            leaf(std::piecewise_construct_t, KeyArgs&& keyArgs, MappedArgs&& mappedArgs)
+                : node_type(node_type::leaf_kind)
+                , fValue(std::piecewise_construct, std::forward<KeyArgs>(keyArgs), std::forward<MappedArgs>(mappedArgs))
             {
-                if (value.first == fValue.first) {
-                    return std::make_tuple(ptr, iterator(&fValue), false);
-                }
-                auto leaf = make_shared<leaf_type>(value.first, value.second);
-                iterator i(&leaf->get());
-                auto branch = make_branch<Prefix>(value.first, intrusive_shared_ptr<node_type>(std::move(leaf)), fValue.first, ptr);
-                return std::make_tuple(std::move(branch), i, true);
+                Metrics::count(tree_event::leaf_create);
             }
 
-            iterator find(key_type const& key) override final
+            value_type& get()
             {
-                return find_impl(this, key);
+                return fValue;
             }
 
-            const_iterator find(key_type const& key) const override final
+            value_type const& get() const
             {
-                return find_impl(this, key);
+                return fValue;
             }
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type> erase_unique(intrusive_shared_ptr<node_type> const& ptr, key_type const& key) override final
-            {
-                return erase_shared(ptr, key);
+          private:
+            value_type fValue;
+        };
+
+        /// Insert the value of `source` under `root`, returning a pointer
+        /// to the found or inserted value and whether it was inserted.  The
+        /// path is walked once, in two loops rather than by recursion.  The
+        /// first follows the path while its nodes are unique to this tree,
+        /// rewriting no more than the child of the last one.  The second
+        /// follows the rest of the path, whose nodes are all shared, since
+        /// they are under the first shared one, and then copies it bottom
+        /// up.  Nodes are only copied when the tree changes.
+        template <typename Node, typename Source>
+        std::pair<typename Node::value_type*, bool> insert_value(intrusive_shared_ptr<Node>& root,
+                                                                 Source& source,
+                                                                 typename Node::allocator_type& alloc)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::prefix_type prefix_type;
+            typedef typename Node::metrics_type metrics_type;
+            typedef typename Node::value_type value_type;
+            enum { max_depth = sizeof(prefix_type) * CHAR_BIT };
+            auto& key = source.key();
+            branch_type* unique[max_depth];
+            int uniqueDepth = 0;
+            auto slot = &root;
+            while (slot->unique() && !(*slot)->is_leaf()) {
+                auto branch = static_cast<branch_type*>(slot->get());
+                if (not_mem(key, branch->prefix(), branch->mask())) {
+                    break;
+                }
+                unique[uniqueDepth++] = branch;
+                slot = &branch->child(!left(static_cast<prefix_type>(key), branch->mask()));
+            }
+            if (slot->unique() && (*slot)->is_leaf()) {
+                auto& value = static_cast<leaf_type*>(slot->get())->get();
+                if (key == value.first) {
+                    source.assign(value.second);
+                    return std::make_pair(&value, false);
+                }
+            }
+            branch_type const* path[max_depth];
+            int depth = 0;
+            intrusive_shared_ptr<Node> const* bottom = slot;
+            while (!(*bottom)->is_leaf()) {
+                auto branch = static_cast<branch_type const*>(bottom->get());
+                if (not_mem(key, branch->prefix(), branch->mask())) {
+                    break;
+                }
+                path[depth++] = branch;
+                bottom = &branch->child(!left(static_cast<prefix_type>(key), branch->mask()));
+            }
+            intrusive_shared_ptr<Node> replacement;
+            value_type* result;
+            bool inserted;
+            if ((*bottom)->is_leaf() && key == static_cast<leaf_type const*>(bottom->get())->get().first) {
+                auto& value = static_cast<leaf_type*>(bottom->get())->get();
+                if (!Source::assigns::value) {
+                    return std::make_pair(&value, false);
+                }
+                auto leaf = source.make(alloc);
+                result = &leaf->get();
+                replacement = std::move(leaf);
+                inserted = false;
+            } else {
+                auto bottomPrefix = (*bottom)->is_leaf()
+                    ? static_cast<prefix_type>(static_cast<leaf_type const*>(bottom->get())->get().first)
+                    : static_cast<branch_type const*>(bottom->get())->prefix();
+                auto leaf = source.make(alloc);
+                result = &leaf->get();
+                replacement = make_branch(alloc, static_cast<prefix_type>(key), intrusive_shared_ptr<Node>(std::move(leaf)), bottomPrefix, *bottom);
+                inserted = true;
+            }
+            while (depth > 0) {
+                auto branch = path[--depth];
+                metrics_type::count(tree_event::branch_copy);
+                if (left(static_cast<prefix_type>(key), branch->mask())) {
+                    replacement = allocate_shared<branch_type>(alloc, branch->prefix(), branch->mask(), std::move(replacement), branch->right_child());
+                } else {
+                    replacement = allocate_shared<branch_type>(alloc, branch->prefix(), branch->mask(), branch->left_child(), std::move(replacement));
+                }
             }
+            *slot = std::move(replacement);
+            if (inserted) {
+                for (int i = 0; i != uniqueDepth; ++i) {
+                    metrics_type::count(tree_event::branch_update);
+                    unique[i]->adjust_count(1);
+                }
+            } else if (uniqueDepth > 0) {
+                // Only the child of the last unique `branch` was rewritten.
+                metrics_type::count(tree_event::branch_update);
+            }
+            return std::make_pair(result, inserted);
+        }
 
-            std::tuple<intrusive_shared_ptr<node_type>, size_type> erase_shared(intrusive_shared_ptr<node_type> const& ptr, key_type const& key) override final
-            {
-                if (key == fValue.first) {
-                    return std::make_tuple(intrusive_shared_ptr<node_type>(), 1);
+        /// Erase `key` under `root`, returning the number of values erased.
+        /// Like `insert_value`, the unique part of the path is updated in
+        /// place and the shared part copied.
+        template <typename Node>
+        typename Node::size_type erase_value(intrusive_shared_ptr<Node>& root,
+                                             typename Node::key_type const& key,
+                                             typename Node::allocator_type& alloc)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::prefix_type prefix_type;
+            typedef typename Node::metrics_type metrics_type;
+            enum { max_depth = sizeof(prefix_type) * CHAR_BIT };
+            intrusive_shared_ptr<Node>* unique[max_depth];
+            int uniqueDepth = 0;
+            auto slot = &root;
+            while (slot->unique() && !(*slot)->is_leaf()) {
+                auto branch = static_cast<branch_type*>(slot->get());
+                if (not_mem(key, branch->prefix(), branch->mask())) {
+                    return 0;
+                }
+                unique[uniqueDepth++] = slot;
+                slot = &branch->child(!left(static_cast<prefix_type>(key), branch->mask()));
+            }
+            branch_type const* path[max_depth];
+            int depth = 0;
+            auto node = slot->get();
+            while (!node->is_leaf()) {
+                auto branch = static_cast<branch_type const*>(node);
+                if (not_mem(key, branch->prefix(), branch->mask())) {
+                    return 0;
                 }
-                return std::make_tuple(ptr, 0);
+                path[depth++] = branch;
+                node = branch->child(!left(static_cast<prefix_type>(key), branch->mask())).get();
+            }
+            if (key != static_cast<leaf_type const*>(node)->get().first) {
+                return 0;
             }
+            // The `leaf`'s parent is replaced by the `leaf`'s sibling.
+            intrusive_shared_ptr<Node> replacement;
+            if (depth > 0) {
+                auto parent = path[--depth];
+                replacement = parent->child(left(static_cast<prefix_type>(key), parent->mask()));
+                while (depth > 0) {
+                    auto branch = path[--depth];
+                    metrics_type::count(tree_event::branch_copy);
+                    if (left(static_cast<prefix_type>(key), branch->mask())) {
+                        replacement = allocate_shared<branch_type>(alloc, branch->prefix(), branch->mask(), std::move(replacement), branch->right_child());
+                    } else {
+                        replacement = allocate_shared<branch_type>(alloc, branch->prefix(), branch->mask(), branch->left_child(), std::move(replacement));
+                    }
+                }
+            }
+            if (replacement || uniqueDepth == 0) {
+                *slot = std::move(replacement);
+            } else {
+                auto parentSlot = unique[--uniqueDepth];
+                auto parent = static_cast<branch_type*>(parentSlot->get());
+                auto sibling = std::move(parent->child(left(static_cast<prefix_type>(key), parent->mask())));
+                *parentSlot = std::move(sibling);
+            }
+            for (int i = 0; i != uniqueDepth; ++i) {
+                metrics_type::count(tree_event::branch_update);
+                static_cast<branch_type*>(unique[i]->get())->adjust_count(-1);
+            }
+            return 1;
+        }
 
-            value_type& get()
-            {
-                return fValue;
+        /// Return the `leaf` under `node` whose key is `key`, or `nullptr`.
+        /// The tree is walked in a loop rather than by recursing through
+        /// each node.  Defining `EML_SHARED_RADIX_TREE_PREFETCH` starts
+        /// loading both children of a `branch` before deciding which to
+        /// follow, trading memory bandwidth for latency.
+        template <typename Node>
+        typename Node::leaf_type* find_leaf(Node* node, typename Node::key_type const& key)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::prefix_type prefix_type;
+            typedef typename Node::metrics_type metrics_type;
+            int depth = 0;
+            while (!node->is_leaf()) {
+                auto branch = static_cast<branch_type const*>(node);
+#if defined(EML_SHARED_RADIX_TREE_PREFETCH)
+                prefetch(branch->left_child().get());
+                prefetch(branch->right_child().get());
+#endif
+                ++depth;
+                if (not_mem(key, branch->prefix(), branch->mask())) {
+                    metrics_type::count_lookup(depth);
+                    return nullptr;
+                }
+                if (left(static_cast<prefix_type>(key), branch->mask())) {
+                    node = branch->left_child().get();
+                } else {
+                    node = branch->right_child().get();
+                }
+            }
+            metrics_type::count_lookup(depth);
+            auto leaf = static_cast<leaf_type*>(node);
+            if (key != leaf->get().first) {
+                return nullptr;
             }
+            return leaf;
+        }
 
-            value_type const& get() const
-            {
-                return fValue;
+        /// Call `f` with every value under `node` in order.
+        template <typename Node, typename Function>
+        void for_each_value(Node const* node, Function& f)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            while (!node->is_leaf()) {
+                auto branch = static_cast<branch_type const*>(node);
+                for_each_value(branch->left_child().get(), f);
+                node = branch->right_child().get();
+            }
+            f(static_cast<leaf_type const*>(node)->get());
+        }
+
+        /// The key of a `leaf` or the prefix of a `branch`.
+        template <typename Node>
+        typename Node::prefix_type node_prefix(Node const* node)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::prefix_type prefix_type;
+            if (node->is_leaf()) {
+                return static_cast<prefix_type>(static_cast<leaf_type const*>(node)->get().first);
+            }
+            return static_cast<branch_type const*>(node)->prefix();
+        }
+
+        /// Return the smallest subtree of `tree` holding every key whose
+        /// leading `bits` bits equal those of `prefix`, or `nullptr` if
+        /// there is none.  Once the walk reaches a `branch` masking a bit
+        /// below the leading `bits`, all keys under it agree on those bits,
+        /// so the `branch` is either the result or disjoint from it.
+        template <typename Node>
+        intrusive_shared_ptr<Node> find_subtree(intrusive_shared_ptr<Node> const& tree,
+                                                typename Node::prefix_type const& prefix,
+                                                int bits)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::mask_type mask_type;
+            typedef typename mask_bits<mask_type>::type bits_type;
+            static const int width = sizeof(typename Node::prefix_type) * CHAR_BIT;
+            if (!tree || bits <= 0) {
+                return tree;
+            }
+            auto one = static_cast<bits_type>(1);
+            auto lowest = static_cast<mask_type>(bits >= width ? one : one << static_cast<bits_type>(width - bits));
+            auto high = bits_above(lowest) ^ lowest;
+            auto node = &tree;
+            while (!(*node)->is_leaf()) {
+                auto branch = static_cast<branch_type const*>(node->get());
+                if (higher(lowest, branch->mask())) {
+                    break;
+                }
+                if (not_mem(prefix, branch->prefix(), branch->mask())) {
+                    return nullptr;
+                }
+                node = left(prefix, branch->mask()) ? &branch->left_child() : &branch->right_child();
+            }
+            if ((node_prefix(node->get()) & high) != (prefix & high)) {
+                return nullptr;
+            }
+            return *node;
+        }
+
+        /// Shape and memory use of a tree, as returned by
+        /// `SharedRadixTree::stats`.  Depths count the `branch` nodes above
+        /// a `leaf`.  Bytes are those of the nodes themselves, excluding
+        /// allocator overhead and memory owned by keys or mapped values.
+        struct tree_stats
+        {
+            tree_stats()
+                : fBranches(0)
+                , fLeaves(0)
+                , fMaxDepth(0)
+                , fAverageDepth(0)
+                , fBytes(0)
+                , fSharedBytes(0)
+            {}
+
+            std::size_t fBranches;
+            std::size_t fLeaves;
+            std::size_t fMaxDepth;
+            double fAverageDepth;
+            /// The number of `leaf` nodes at each depth.
+            std::vector<std::size_t> fDepths;
+            std::size_t fBytes;
+            /// Bytes of nodes also reachable from another tree, because
+            /// their use count or that of an ancestor is greater than one.
+            /// The other `fBytes - fSharedBytes` bytes would be freed along
+            /// with this tree.
+            std::size_t fSharedBytes;
+        };
+
+        template <typename Node>
+        void collect_stats(Node const* node, std::size_t depth, bool shared, tree_stats& stats)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            shared = shared || !node->unique();
+            while (!node->is_leaf()) {
+                auto branch = static_cast<branch_type const*>(node);
+                ++stats.fBranches;
+                stats.fBytes += sizeof(branch_type);
+                if (shared) {
+                    stats.fSharedBytes += sizeof(branch_type);
+                }
+                ++depth;
+                collect_stats(branch->left_child().get(), depth, shared, stats);
+                node = branch->right_child().get();
+                shared = shared || !node->unique();
+            }
+            ++stats.fLeaves;
+            stats.fBytes += sizeof(leaf_type);
+            if (shared) {
+                stats.fSharedBytes += sizeof(leaf_type);
+            }
+            if (stats.fDepths.size() <= depth) {
+                stats.fDepths.resize(depth + 1);
+            }
+            ++stats.fDepths[depth];
+        }
+
+        /// Look up every key in `[first, last)` under `root`, calling `f`
+        /// with the matching `leaf` or `nullptr` for each key in turn.  Keys
+        /// are looked up in groups whose walks are advanced one level at a
+        /// time, and every child is prefetched a whole round before it is
+        /// read, so the cache misses of one walk overlap with the others.
+        template <typename Node, typename InputIterator, typename Function>
+        void find_leaves(Node* root, InputIterator first, InputIterator last, Function& f)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::key_type key_type;
+            typedef typename Node::prefix_type prefix_type;
+            static const int group_size = 16;
+            key_type keys[group_size];
+            Node* nodes[group_size];
+            while (first != last) {
+                int size = 0;
+                for (; size != group_size && first != last; ++first, ++size) {
+                    keys[size] = *first;
+                    nodes[size] = root;
+                }
+                for (bool advanced = true; advanced;) {
+                    advanced = false;
+                    for (int i = 0; i != size; ++i) {
+                        auto node = nodes[i];
+                        if (!node || node->is_leaf()) {
+                            continue;
+                        }
+                        auto branch = static_cast<branch_type const*>(node);
+                        if (not_mem(keys[i], branch->prefix(), branch->mask())) {
+                            nodes[i] = nullptr;
+                            continue;
+                        }
+                        if (left(static_cast<prefix_type>(keys[i]), branch->mask())) {
+                            node = branch->left_child().get();
+                        } else {
+                            node = branch->right_child().get();
+                        }
+                        prefetch(node);
+                        nodes[i] = node;
+                        advanced = true;
+                    }
+                }
+                for (int i = 0; i != size; ++i) {
+                    auto leaf = static_cast<leaf_type*>(nodes[i]);
+                    f(leaf && leaf->get().first == keys[i] ? leaf : nullptr);
+                }
+            }
+        }
+
+        /// The number of values under `node`, stored in a `counted` tree.
+        /// `O(1)`
+        template <typename Node>
+        typename Node::size_type subtree_size(Node const* node, std::true_type)
+        {
+            typedef typename Node::branch_type branch_type;
+            if (node->is_leaf()) {
+                return 1;
+            }
+            return static_cast<branch_type const*>(node)->count();
+        }
+
+        /// The number of values under `node`, counted one by one.  `O(n)`
+        template <typename Node>
+        typename Node::size_type subtree_size(Node const* node, std::false_type)
+        {
+            typename Node::size_type result = 0;
+            auto count = [&result](typename Node::value_type const&) { ++result; };
+            for_each_value(node, count);
+            return result;
+        }
+
+        template <typename Node>
+        typename Node::size_type subtree_size(Node const* node)
+        {
+            return subtree_size(node, typename Node::counts_type::is_counted());
+        }
+
+        /// Return the `leaf` holding the `n`th smallest key under the
+        /// `counted` `node`, where `n` is less than the number of values
+        /// under it.
+        template <typename Node>
+        typename Node::leaf_type* nth_leaf(Node* node, typename Node::size_type n)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            while (!node->is_leaf()) {
+                auto branch = static_cast<branch_type const*>(node);
+                auto leftSize = subtree_size(branch->left_child().get(), std::true_type());
+                if (n < leftSize) {
+                    node = branch->left_child().get();
+                } else {
+                    n -= leftSize;
+                    node = branch->right_child().get();
+                }
+            }
+            return static_cast<leaf_type*>(node);
+        }
+
+        /// The number of keys under the `counted` `node` that are less than
+        /// `key` in `key_less` order, whether or not `key` itself is present.
+        template <typename Node>
+        typename Node::size_type rank_of(Node const* node, typename Node::key_type const& key)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::prefix_type prefix_type;
+            auto prefix = static_cast<prefix_type>(key);
+            typename Node::size_type result = 0;
+            while (!node->is_leaf()) {
+                auto branch = static_cast<branch_type const*>(node);
+                if (not_mem(key, branch->prefix(), branch->mask())) {
+                    if (unsigned_less(branch->prefix(), prefix)) {
+                        result += branch->count();
+                    }
+                    return result;
+                }
+                if (left(prefix, branch->mask())) {
+                    node = branch->left_child().get();
+                } else {
+                    result += subtree_size(branch->left_child().get(), std::true_type());
+                    node = branch->right_child().get();
+                }
+            }
+            if (unsigned_less(static_cast<prefix_type>(static_cast<leaf_type const*>(node)->get().first), prefix)) {
+                ++result;
+            }
+            return result;
+        }
+
+        /// Return a `branch` like `aBranch` with the children `left` and
+        /// `right`, reusing `aBranch` itself if neither child changed.  If
+        /// either child is empty, the other replaces the `branch`
+        /// altogether, preserving path compression.
+        template <typename Node>
+        intrusive_shared_ptr<Node> rebuild(intrusive_shared_ptr<Node> const& aBranch,
+                                           intrusive_shared_ptr<Node> left,
+                                           intrusive_shared_ptr<Node> right,
+                                           typename Node::allocator_type& alloc)
+        {
+            typedef typename Node::branch_type branch_type;
+            if (!left) {
+                return right;
+            }
+            if (!right) {
+                return left;
+            }
+            auto branch = static_cast<branch_type const*>(aBranch.get());
+            if (left == branch->left_child() && right == branch->right_child()) {
+                return aBranch;
+            }
+            return allocate_shared<branch_type>(alloc, branch->prefix(), branch->mask(), std::move(left), std::move(right));
+        }
+
+        /// Union of the `leaf` `aLeaf` with `tree`.  If the key of `aLeaf`
+        /// is also in `tree`, the two mapped values are combined, passing
+        /// the value of `aLeaf` first if `leafFirst` is `true`.  Otherwise,
+        /// one is added to `*added` unless it is `nullptr`.
+        template <typename Node, typename Combine>
+        intrusive_shared_ptr<Node> merge_leaf(intrusive_shared_ptr<Node> const& aLeaf,
+                                              intrusive_shared_ptr<Node> const& tree,
+                                              bool leafFirst,
+                                              Combine& combine,
+                                              typename Node::allocator_type& alloc,
+                                              typename Node::size_type* added)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::prefix_type prefix_type;
+            auto& value = static_cast<leaf_type const*>(aLeaf.get())->get();
+            auto prefix = static_cast<prefix_type>(value.first);
+            if (tree->is_leaf()) {
+                auto& other = static_cast<leaf_type const*>(tree.get())->get();
+                if (value.first != other.first) {
+                    if (added) {
+                        ++*added;
+                    }
+                    return make_branch(alloc, prefix, aLeaf, static_cast<prefix_type>(other.first), tree);
+                }
+                if (aLeaf == tree) {
+                    return tree;
+                }
+                return allocate_shared<leaf_type>(alloc,
+                                                  value.first,
+                                                  leafFirst ? combine(value.second, other.second) : combine(other.second, value.second));
+            }
+            auto branch = static_cast<branch_type const*>(tree.get());
+            if (not_mem(prefix, branch->prefix(), branch->mask())) {
+                if (added) {
+                    ++*added;
+                }
+                return make_branch(alloc, prefix, aLeaf, branch->prefix(), tree);
+            }
+            if (left(prefix, branch->mask())) {
+                return rebuild(tree, merge_leaf(aLeaf, branch->left_child(), leafFirst, combine, alloc, added), branch->right_child(), alloc);
+            }
+            return rebuild(tree, branch->left_child(), merge_leaf(aLeaf, branch->right_child(), leafFirst, combine, alloc, added), alloc);
+        }
+
+        /// Union of `tree1` and `tree2`.  The mapped values of a key in both
+        /// are replaced by `combine(value1, value2)`, except within subtrees
+        /// the two trees share, which are returned as is.  Unless `added` is
+        /// `nullptr`, the number of keys of `tree2` not in `tree1` is added
+        /// to `*added`.  Only subtrees of `tree2` missing from `tree1` are
+        /// counted, which takes no longer than merging them did in an
+        /// `uncounted` tree, and `O(1)` each in a `counted` one.
+        template <typename Node, typename Combine>
+        intrusive_shared_ptr<Node> merge(intrusive_shared_ptr<Node> const& tree1,
+                                         intrusive_shared_ptr<Node> const& tree2,
+                                         Combine& combine,
+                                         typename Node::allocator_type& alloc,
+                                         typename Node::size_type* added)
+        {
+            typedef typename Node::branch_type branch_type;
+            if (tree1 == tree2) {
+                return tree1;
+            }
+            if (tree1->is_leaf()) {
+                if (added) {
+                    // `merge_leaf` adds back the key of `tree1` if it is
+                    // not in `tree2`.
+                    *added += subtree_size(tree2.get()) - 1;
+                }
+                return merge_leaf(tree1, tree2, true, combine, alloc, added);
+            }
+            if (tree2->is_leaf()) {
+                return merge_leaf(tree2, tree1, false, combine, alloc, added);
+            }
+            auto branch1 = static_cast<branch_type const*>(tree1.get());
+            auto branch2 = static_cast<branch_type const*>(tree2.get());
+            if (branch1->mask() == branch2->mask() && branch1->prefix() == branch2->prefix()) {
+                auto leftChild = merge(branch1->left_child(), branch2->left_child(), combine, alloc, added);
+                auto rightChild = merge(branch1->right_child(), branch2->right_child(), combine, alloc, added);
+                if (leftChild == branch2->left_child() && rightChild == branch2->right_child()) {
+                    return tree2;
+                }
+                return rebuild(tree1, std::move(leftChild), std::move(rightChild), alloc);
+            }
+            if (higher(branch1->mask(), branch2->mask()) && !not_mem(branch2->prefix(), branch1->prefix(), branch1->mask())) {
+                if (left(branch2->prefix(), branch1->mask())) {
+                    return rebuild(tree1, merge(branch1->left_child(), tree2, combine, alloc, added), branch1->right_child(), alloc);
+                }
+                return rebuild(tree1, branch1->left_child(), merge(branch1->right_child(), tree2, combine, alloc, added), alloc);
+            }
+            if (higher(branch2->mask(), branch1->mask()) && !not_mem(branch1->prefix(), branch2->prefix(), branch2->mask())) {
+                // The other child of `branch2` is disjoint from `tree1`.
+                if (left(branch1->prefix(), branch2->mask())) {
+                    if (added) {
+                        *added += subtree_size(branch2->right_child().get());
+                    }
+                    return rebuild(tree2, merge(tree1, branch2->left_child(), combine, alloc, added), branch2->right_child(), alloc);
+                }
+                if (added) {
+                    *added += subtree_size(branch2->left_child().get());
+                }
+                return rebuild(tree2, branch2->left_child(), merge(tree1, branch2->right_child(), combine, alloc, added), alloc);
+            }
+            if (added) {
+                *added += subtree_size(tree2.get());
+            }
+            return make_branch(alloc, branch1->prefix(), tree1, branch2->prefix(), tree2);
+        }
+
+        /// Split `tree` into the keys whose prefixes are less than `bound`
+        /// and the rest, adding the number of the former to `*less` unless
+        /// it is `nullptr`.  Only the `branch` nodes on the path of `bound`
+        /// are rebuilt; every subtree off the path goes whole to one side.
+        template <typename Node>
+        std::pair<intrusive_shared_ptr<Node>, intrusive_shared_ptr<Node>>
+        split_at(intrusive_shared_ptr<Node> const& tree,
+                 typename Node::prefix_type const& bound,
+                 typename Node::allocator_type& alloc,
+                 typename Node::size_type* less)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef intrusive_shared_ptr<Node> pointer;
+            if (tree->is_leaf()) {
+                if (unsigned_less(node_prefix(tree.get()), bound)) {
+                    if (less) {
+                        ++*less;
+                    }
+                    return std::make_pair(tree, pointer());
+                }
+                return std::make_pair(pointer(), tree);
+            }
+            auto branch = static_cast<branch_type const*>(tree.get());
+            if (not_mem(bound, branch->prefix(), branch->mask())) {
+                if (unsigned_less(bound, branch->prefix())) {
+                    return std::make_pair(pointer(), tree);
+                }
+                if (less) {
+                    *less += subtree_size(tree.get());
+                }
+                return std::make_pair(tree, pointer());
+            }
+            if (left(bound, branch->mask())) {
+                auto halves = split_at(branch->left_child(), bound, alloc, less);
+                return std::make_pair(std::move(halves.first),
+                                      rebuild(tree, std::move(halves.second), branch->right_child(), alloc));
+            }
+            if (less) {
+                *less += subtree_size(branch->left_child().get());
+            }
+            auto halves = split_at(branch->right_child(), bound, alloc, less);
+            return std::make_pair(rebuild(tree, branch->left_child(), std::move(halves.first), alloc),
+                                  std::move(halves.second));
+        }
+
+        /// Intersection of `tree1` and `tree2`.  The mapped values of the
+        /// remaining keys are `combine(value1, value2)`, except within
+        /// subtrees the two trees share, which are returned as is.  Either
+        /// tree may be empty.  The number of keys of `tree1` not in `tree2`
+        /// is added to `removed`.
+        template <typename Node, typename Combine>
+        intrusive_shared_ptr<Node> intersect(intrusive_shared_ptr<Node> const& tree1,
+                                             intrusive_shared_ptr<Node> const& tree2,
+                                             Combine& combine,
+                                             typename Node::allocator_type& alloc,
+                                             typename Node::size_type& removed)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            if (!tree1) {
+                return nullptr;
+            }
+            if (!tree2) {
+                removed += subtree_size(tree1.get());
+                return nullptr;
+            }
+            if (tree1 == tree2) {
+                return tree1;
+            }
+            if (tree1->is_leaf() || tree2->is_leaf()) {
+                bool leafFirst = tree1->is_leaf();
+                auto& aLeaf = leafFirst ? tree1 : tree2;
+                auto& value = static_cast<leaf_type const*>(aLeaf.get())->get();
+                auto other = find_leaf((leafFirst ? tree2 : tree1).get(), value.first);
+                // Every key of `tree1` but the one found is dropped.
+                removed += subtree_size(tree1.get()) - (other ? 1 : 0);
+                if (!other) {
+                    return nullptr;
+                }
+                if (other == aLeaf.get()) {
+                    return aLeaf;
+                }
+                return allocate_shared<leaf_type>(alloc,
+                                                  value.first,
+                                                  leafFirst ? combine(value.second, other->get().second) : combine(other->get().second, value.second));
+            }
+            auto branch1 = static_cast<branch_type const*>(tree1.get());
+            auto branch2 = static_cast<branch_type const*>(tree2.get());
+            if (branch1->mask() == branch2->mask() && branch1->prefix() == branch2->prefix()) {
+                auto leftChild = intersect(branch1->left_child(), branch2->left_child(), combine, alloc, removed);
+                auto rightChild = intersect(branch1->right_child(), branch2->right_child(), combine, alloc, removed);
+                if (leftChild && rightChild && leftChild == branch2->left_child() && rightChild == branch2->right_child()) {
+                    return tree2;
+                }
+                return rebuild(tree1, std::move(leftChild), std::move(rightChild), alloc);
+            }
+            if (higher(branch1->mask(), branch2->mask()) && !not_mem(branch2->prefix(), branch1->prefix(), branch1->mask())) {
+                if (left(branch2->prefix(), branch1->mask())) {
+                    removed += subtree_size(branch1->right_child().get());
+                    return intersect(branch1->left_child(), tree2, combine, alloc, removed);
+                }
+                removed += subtree_size(branch1->left_child().get());
+                return intersect(branch1->right_child(), tree2, combine, alloc, removed);
+            }
+            if (higher(branch2->mask(), branch1->mask()) && !not_mem(branch1->prefix(), branch2->prefix(), branch2->mask())) {
+                if (left(branch1->prefix(), branch2->mask())) {
+                    return intersect(tree1, branch2->left_child(), combine, alloc, removed);
+                }
+                return intersect(tree1, branch2->right_child(), combine, alloc, removed);
+            }
+            removed += subtree_size(tree1.get());
+            return nullptr;
+        }
+
+        /// `tree1` without the keys of `tree2`.  Subtrees of `tree1` disjoint
+        /// from `tree2` are returned as is.  Either tree may be empty.  The
+        /// number of keys dropped from `tree1` is added to `removed`.
+        template <typename Node>
+        intrusive_shared_ptr<Node> difference(intrusive_shared_ptr<Node> const& tree1,
+                                              intrusive_shared_ptr<Node> const& tree2,
+                                              typename Node::allocator_type& alloc,
+                                              typename Node::size_type& removed)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            if (!tree1 || !tree2) {
+                return tree1;
+            }
+            if (tree1 == tree2) {
+                removed += subtree_size(tree1.get());
+                return nullptr;
+            }
+            if (tree1->is_leaf()) {
+                if (find_leaf(tree2.get(), static_cast<leaf_type const*>(tree1.get())->get().first)) {
+                    ++removed;
+                    return nullptr;
+                }
+                return tree1;
+            }
+            if (tree2->is_leaf()) {
+                // The copy makes `tree1` shared, so nothing is erased in
+                // place.
+                auto result = tree1;
+                removed += erase_value(result, static_cast<leaf_type const*>(tree2.get())->get().first, alloc);
+                return result;
+            }
+            auto branch1 = static_cast<branch_type const*>(tree1.get());
+            auto branch2 = static_cast<branch_type const*>(tree2.get());
+            if (branch1->mask() == branch2->mask() && branch1->prefix() == branch2->prefix()) {
+                return rebuild(tree1,
+                               difference(branch1->left_child(), branch2->left_child(), alloc, removed),
+                               difference(branch1->right_child(), branch2->right_child(), alloc, removed),
+                               alloc);
+            }
+            if (higher(branch1->mask(), branch2->mask()) && !not_mem(branch2->prefix(), branch1->prefix(), branch1->mask())) {
+                if (left(branch2->prefix(), branch1->mask())) {
+                    return rebuild(tree1, difference(branch1->left_child(), tree2, alloc, removed), branch1->right_child(), alloc);
+                }
+                return rebuild(tree1, branch1->left_child(), difference(branch1->right_child(), tree2, alloc, removed), alloc);
+            }
+            if (higher(branch2->mask(), branch1->mask()) && !not_mem(branch1->prefix(), branch2->prefix(), branch2->mask())) {
+                if (left(branch1->prefix(), branch2->mask())) {
+                    return difference(tree1, branch2->left_child(), alloc, removed);
+                }
+                return difference(tree1, branch2->right_child(), alloc, removed);
+            }
+            return tree1;
+        }
+
+        /// Callbacks of `diff`, bundled to keep the recursion's signature
+        /// short.
+        template <typename OnAdded, typename OnRemoved, typename OnChanged>
+        struct diff_callbacks
+        {
+            OnAdded& fAdded;
+            OnRemoved& fRemoved;
+            OnChanged& fChanged;
+        };
+
+        /// Report every value of `tree1` as removed and every value of
+        /// `tree2` as added, in key order.  The two trees are disjoint.
+        template <typename Node, typename Callbacks>
+        void diff_disjoint(Node const* tree1, Node const* tree2, Callbacks& callbacks)
+        {
+            if (unsigned_less(node_prefix(tree1), node_prefix(tree2))) {
+                for_each_value(tree1, callbacks.fRemoved);
+                for_each_value(tree2, callbacks.fAdded);
+            } else {
+                for_each_value(tree2, callbacks.fAdded);
+                for_each_value(tree1, callbacks.fRemoved);
             }
+        }
 
-          private:
-            /// Implementation of both `const` and non-`const` `find`.
-            template <typename This>
-            static typename find_result<This>::type find_impl(This aThis, key_type const& aKey)
-            {
-                if (aKey != aThis->fValue.first) {
-                    return typename find_result<This>::type();
+        /// Compare `tree1` with `tree2`, either of which may be empty,
+        /// reporting differences in key order.  Descending both trees
+        /// together skips every subtree the two share, so two versions of a
+        /// tree are compared in `O(d * min(log(n), sizeof(Key)))` for `d`
+        /// differing keys.
+        template <typename Node, typename Callbacks>
+        void diff_nodes(Node const* tree1, Node const* tree2, Callbacks& callbacks)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            if (tree1 == tree2) {
+                return;
+            }
+            if (!tree1) {
+                for_each_value(tree2, callbacks.fAdded);
+                return;
+            }
+            if (!tree2) {
+                for_each_value(tree1, callbacks.fRemoved);
+                return;
+            }
+            if (tree1->is_leaf() && tree2->is_leaf()) {
+                auto& value1 = static_cast<leaf_type const*>(tree1)->get();
+                auto& value2 = static_cast<leaf_type const*>(tree2)->get();
+                if (value1.first == value2.first) {
+                    callbacks.fChanged(value1, value2);
+                } else {
+                    diff_disjoint(tree1, tree2, callbacks);
+                }
+                return;
+            }
+            auto prefix1 = node_prefix(tree1);
+            auto prefix2 = node_prefix(tree2);
+            if (!tree1->is_leaf() && !tree2->is_leaf()) {
+                auto branch1 = static_cast<branch_type const*>(tree1);
+                auto branch2 = static_cast<branch_type const*>(tree2);
+                if (branch1->mask() == branch2->mask() && prefix1 == prefix2) {
+                    diff_nodes(branch1->left_child().get(), branch2->left_child().get(), callbacks);
+                    diff_nodes(branch1->right_child().get(), branch2->right_child().get(), callbacks);
+                    return;
+                }
+            }
+            if (!tree1->is_leaf()) {
+                auto branch1 = static_cast<branch_type const*>(tree1);
+                if ((tree2->is_leaf() || higher(branch1->mask(), static_cast<branch_type const*>(tree2)->mask())) &&
+                    !not_mem(prefix2, prefix1, branch1->mask())) {
+                    if (left(prefix2, branch1->mask())) {
+                        diff_nodes(branch1->left_child().get(), tree2, callbacks);
+                        for_each_value(branch1->right_child().get(), callbacks.fRemoved);
+                    } else {
+                        for_each_value(branch1->left_child().get(), callbacks.fRemoved);
+                        diff_nodes(branch1->right_child().get(), tree2, callbacks);
+                    }
+                    return;
+                }
+            }
+            if (!tree2->is_leaf()) {
+                auto branch2 = static_cast<branch_type const*>(tree2);
+                if ((tree1->is_leaf() || higher(branch2->mask(), static_cast<branch_type const*>(tree1)->mask())) &&
+                    !not_mem(prefix1, prefix2, branch2->mask())) {
+                    if (left(prefix1, branch2->mask())) {
+                        diff_nodes(tree1, branch2->left_child().get(), callbacks);
+                        for_each_value(branch2->right_child().get(), callbacks.fAdded);
+                    } else {
+                        for_each_value(branch2->left_child().get(), callbacks.fAdded);
+                        diff_nodes(tree1, branch2->right_child().get(), callbacks);
+                    }
+                    return;
                 }
-                return typename find_result<This>::type(&aThis->fValue);
             }
+            diff_disjoint(tree1, tree2, callbacks);
+        }
 
-            value_type fValue;
-        };
+        /// Build a tree from values in strictly increasing `key_less` order
+        /// in one pass.  The tree is the Cartesian tree of the masks between
+        /// neighbouring keys, so it is built bottom-up while keeping the
+        /// unfinished right spine on a stack: each new key closes every
+        /// pending `branch` masking a less significant bit than its own mask.
+        /// Exactly one node is allocated per `branch` and `leaf`.  Values
+        /// with the same key as their predecessor are skipped.  The number
+        /// of values kept is stored in `size`.
+        template <typename Node, typename InputIterator>
+        intrusive_shared_ptr<Node> build_sorted(InputIterator first,
+                                                InputIterator last,
+                                                typename Node::allocator_type& alloc,
+                                                typename Node::size_type& size)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::key_type key_type;
+            typedef typename Node::prefix_type prefix_type;
+            typedef typename Node::mask_type mask_type;
+
+            struct spine_entry
+            {
+                prefix_type fPrefix;
+                mask_type fMask;
+                intrusive_shared_ptr<Node> fLeft;
+            };
+
+            size = 0;
+            if (first == last) {
+                return nullptr;
+            }
+            std::vector<spine_entry> spine;
+            spine.reserve(sizeof(prefix_type) * CHAR_BIT);
+            intrusive_shared_ptr<Node> current = allocate_shared<leaf_type>(alloc, first->first, first->second);
+            size = 1;
+            key_type previous = first->first;
+            for (++first; first != last; ++first) {
+                if (first->first == previous) {
+                    continue;
+                }
+                auto prefix = static_cast<prefix_type>(previous);
+                auto mask = make_mask<mask_type>(prefix, static_cast<prefix_type>(first->first));
+                while (!spine.empty() && higher(mask, spine.back().fMask)) {
+                    auto& entry = spine.back();
+                    current = allocate_shared<branch_type>(alloc, entry.fPrefix, entry.fMask, std::move(entry.fLeft), std::move(current));
+                    spine.pop_back();
+                }
+                spine_entry entry = {make_prefix(prefix, mask), mask, std::move(current)};
+                spine.push_back(std::move(entry));
+                current = allocate_shared<leaf_type>(alloc, first->first, first->second);
+                ++size;
+                previous = first->first;
+            }
+            while (!spine.empty()) {
+                auto& entry = spine.back();
+                current = allocate_shared<branch_type>(alloc, entry.fPrefix, entry.fMask, std::move(entry.fLeft), std::move(current));
+                spine.pop_back();
+            }
+            return current;
+        }
 
         /// Prefix implementation for pointer types.
         struct ptr_prefix;
@@ -845,6 +2621,11 @@ namespace EML
                 return lhs.fValue != rhs.fValue;
             }
 
+            friend bool unsigned_less(ptr_prefix lhs, ptr_prefix rhs)
+            {
+                return lhs.fValue < rhs.fValue;
+            }
+
             std::uintptr_t get() const
             {
                 return fValue;
@@ -888,6 +2669,21 @@ namespace EML
                 return ptr_mask(lhs.fValue ^ rhs.fValue);
             }
 
+            friend bool operator==(ptr_mask lhs, ptr_mask rhs)
+            {
+                return lhs.fValue == rhs.fValue;
+            }
+
+            friend bool operator!=(ptr_mask lhs, ptr_mask rhs)
+            {
+                return lhs.fValue != rhs.fValue;
+            }
+
+            friend bool unsigned_less(ptr_mask lhs, ptr_mask rhs)
+            {
+                return lhs.fValue < rhs.fValue;
+            }
+
           private:
             std::uintptr_t fValue;
         };
@@ -897,6 +2693,98 @@ namespace EML
             return ptr_prefix(lhs.fValue & rhs.fValue);
         }
 
+        /// Grants the algorithms built on `SharedRadixTree` access to its
+        /// nodes.
+        struct tree_access;
+
+        /// The number of values of a tree, which may be `unknown` until it
+        /// is first asked for.  An `uncounted` tree cannot count the values
+        /// of a subtree it shares in less than `O(k)`, so `split` and
+        /// `subtree` leave the sizes of their results unknown, and `size`
+        /// counts them once.  Since `size` is `const`, threads reading one
+        /// tree may race to store the count; the size is a relaxed atomic
+        /// so that they may, and its loads and stores are plain moves.
+        template <typename Size>
+        struct lazy_size
+        {
+            static Size unknown()
+            {
+                return static_cast<Size>(-1);
+            }
+
+            explicit lazy_size(Size size)
+                : fSize(size)
+            {}
+
+            lazy_size(lazy_size const& rhs)
+                : fSize(rhs.get())
+            {}
+
+            lazy_size& operator=(lazy_size const& rhs)
+            {
+                set(rhs.get());
+                return *this;
+            }
+
+            /// The size, or `unknown()`.
+            Size get() const
+            {
+                return fSize.load(std::memory_order_relaxed);
+            }
+
+            void set(Size size)
+            {
+                fSize.store(size, std::memory_order_relaxed);
+            }
+
+            bool known() const
+            {
+                return get() != unknown();
+            }
+
+            /// Add `delta` to a known size.  An unknown size stays unknown.
+            void add(Size delta)
+            {
+                auto size = get();
+                if (size != unknown()) {
+                    set(size + delta);
+                }
+            }
+
+          private:
+            std::atomic<Size> fSize;
+        };
+
+        /// `Layout` of a tree whose `branch` nodes split on a single bit.
+        /// This is the only layout supporting the whole interface.
+        struct binary_nodes
+        {};
+
+        /// `Layout` of a tree whose branches split on `Bits` bits at once,
+        /// storing only their present children.  Defined in
+        /// `WideSharedRadixTree.hpp`.
+        template <unsigned Bits>
+        struct wide_nodes
+        {};
+
+        /// `Layout` of a tree whose nodes live in slabs of an arena shared by
+        /// the tree and its copies, referring to one another by 32-bit
+        /// index.  Defined in `CompactSharedRadixTree.hpp`.
+        struct compact_nodes
+        {};
+
+        /// The default `Prefix` implementation for `Key`.
+        template <typename Key>
+        struct default_prefix
+            : std::conditional<std::is_pointer<Key>::value, ptr_prefix, Key>
+        {};
+
+        /// The default `Mask` implementation for `Key`.
+        template <typename Key>
+        struct default_mask
+            : std::conditional<std::is_pointer<Key>::value, ptr_mask, Key>
+        {};
+
         template <
             typename Key,
             typename T,
@@ -904,22 +2792,44 @@ namespace EML
             /// operations, implementation of `log2`, and explicit conversion
             /// from `Key`.
             /// @see ptr_prefix
-            typename Prefix = typename std::conditional<
-                std::is_pointer<Key>::value,
-                ptr_prefix,
-                Key>::type,
+            typename Prefix = typename default_prefix<Key>::type,
             /// Mask implementation.  This type must support common bit
             /// operations.
             /// @see ptr_mask
-            typename Mask = typename std::conditional<
-                std::is_pointer<Key>::value,
-                ptr_mask,
-                Key>::type
+            typename Mask = typename default_mask<Key>::type,
+            /// Use count policy.  `multi_threaded` allows copies of a tree to
+            /// be handed to other threads at the cost of atomic use counts.
+            /// @see single_threaded
+            /// @see multi_threaded
+            typename RefCount = single_threaded,
+            /// Node allocator.  Every copy of a tree allocates with a copy of
+            /// this allocator.
+            /// @see new_allocator
+            /// @see pool_allocator
+            /// @see arena_allocator
+            typename Allocator = new_allocator,
+            /// Per-branch bookkeeping.  `counted` stores the number of values
+            /// under each `branch`, enabling `nth` and `rank`.
+            /// @see uncounted
+            /// @see counted
+            typename Counts = uncounted,
+            /// Node layout.
+            /// @see binary_nodes
+            /// @see wide_nodes
+            /// @see compact_nodes
+            typename Layout = binary_nodes,
+            /// Instrumentation of mutations and lookups.
+            /// @see no_metrics
+            /// @see atomic_metrics
+            typename Metrics = no_metrics
             >
         struct SharedRadixTree
         {
+            static_assert(std::is_same<Layout, binary_nodes>::value,
+                          "the header defining this Layout must be included");
+
           private:
-            typedef node<Key, T, Prefix, Mask> node_type;
+            typedef node<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Metrics> node_type;
             typedef typename node_type::branch_type branch_type;
             typedef typename node_type::leaf_type leaf_type;
 
@@ -930,22 +2840,117 @@ namespace EML
             typedef typename node_type::iterator iterator;
             typedef typename node_type::const_iterator const_iterator;
             typedef typename node_type::size_type size_type;
+            typedef key_less<Key, Prefix> key_compare;
+            typedef Allocator allocator_type;
 
             SharedRadixTree()
+                : fSize(0)
             {}
 
-            /// `O(min(log(n), sizeof(Key)))`
+            explicit SharedRadixTree(allocator_type const& alloc)
+                : fAllocator(alloc)
+                , fSize(0)
+            {}
+
+            SharedRadixTree(SharedRadixTree const&) = default;
+
+            SharedRadixTree(SharedRadixTree&& rhs)
+                : fAllocator(std::move(rhs.fAllocator))
+                , fNode(std::move(rhs.fNode))
+                , fSize(rhs.fSize)
+            {
+                rhs.fSize.set(0);
+            }
+
+            /// Nodes are released before the allocator is replaced, since the
+            /// allocator may own their storage.
+            SharedRadixTree& operator=(SharedRadixTree rhs)
+            {
+                swap(rhs);
+                return *this;
+            }
+
+            void swap(SharedRadixTree& rhs)
+            {
+                using std::swap;
+                swap(fAllocator, rhs.fAllocator);
+                swap(fNode, rhs.fNode);
+                swap(fSize, rhs.fSize);
+            }
+
+            allocator_type get_allocator() const
+            {
+                return fAllocator;
+            }
+
+            /// Build a tree from the values in `[first, last)`, which must be
+            /// in strictly increasing `key_comp()` order.  For signed keys,
+            /// this places negative keys after non-negative ones.  A value
+            /// whose key equals its predecessor's is skipped.  Unlike
+            /// repeated `insert`, this allocates each node exactly once and
+            /// never walks the tree.  `O(n)`
+            template <typename InputIterator>
+            static SharedRadixTree from_sorted(InputIterator first,
+                                               InputIterator last,
+                                               allocator_type const& alloc = allocator_type())
+            {
+                SharedRadixTree result(alloc);
+                size_type size = 0;
+                result.fNode = build_sorted<node_type>(first, last, result.fAllocator, size);
+                result.fSize.set(size);
+                return result;
+            }
+
+            key_compare key_comp() const
+            {
+                return key_compare();
+            }
+
+            /// Nodes shared with other trees are copied along the path to
+            /// the new value, after which they are unique to this tree and
+            /// later updates below them modify them in place.  If the key
+            /// is present, nothing is copied.  `O(min(log(n), sizeof(Key)))`
             std::pair<iterator, bool> insert(value_type const& value)
             {
-                if (fNode) {
-                    std::pair<iterator, bool> result;
-                    std::tie(fNode, result.first, result.second) = fNode->insert_unique(fNode, value);
-                    return result;
-                }
-                auto leaf = make_shared<leaf_type>(value.first, value.second);
-                iterator i(&leaf->get());
-                fNode = std::move(leaf);
-                return std::make_pair(i, true);
+                auto source = make_leaf_source<leaf_type, std::false_type>(value.first, std::forward_as_tuple(value.second));
+                return insert_impl(source);
+            }
+
+            /// Like `insert`, but moves the mapped value into a new `leaf`.
+            /// `O(min(log(n), sizeof(Key)))`
+            std::pair<iterator, bool> insert(value_type&& value)
+            {
+                auto source = make_leaf_source<leaf_type, std::false_type>(value.first, std::forward_as_tuple(std::move(value.second)));
+                return insert_impl(source);
+            }
+
+            /// Construct a `value_type` from `args` and insert it, moving its
+            /// mapped value into the tree.  `O(min(log(n), sizeof(Key)))`
+            template <typename... Args>
+            std::pair<iterator, bool> emplace(Args&&... args)
+            {
+                return insert(value_type(std::forward<Args>(args)...));
+            }
+
+            /// Construct a mapped value from `args` directly in a new `leaf`
+            /// if `key` is absent.  Otherwise, `args` are left untouched.
+            /// `O(min(log(n), sizeof(Key)))`
+            template <typename... Args>
+            std::pair<iterator, bool> try_emplace(key_type const& key, Args&&... args)
+            {
+                auto source = make_leaf_source<leaf_type, std::false_type>(key, std::forward_as_tuple(std::forward<Args>(args)...));
+                return insert_impl(source);
+            }
+
+            /// Insert `obj` under `key`, or assign it to the mapped value of
+            /// `key` if present.  An existing `leaf` is assigned in place if
+            /// no other tree shares it, and replaced along with the shared
+            /// part of its path otherwise.  `O(min(log(n), sizeof(Key)))`
+            template <typename M>
+            std::pair<iterator, bool> insert_or_assign(key_type const& key, M&& obj)
+            {
+                auto source = make_leaf_source<leaf_type, std::true_type>(key, std::forward_as_tuple(std::forward<M>(obj)));
+                return insert_impl(source);
             }
 
             /// `O(min(log(n), sizeof(Key)))`
@@ -960,17 +2965,112 @@ namespace EML
                 return find_impl(this, key);
             }
 
+            /// Return an iterator to the first value whose key is not less
+            /// than `key` in `key_comp()` order.  `O(min(log(n), sizeof(Key)))`
+            iterator lower_bound(key_type const& key)
+            {
+                return iterator(fNode.get(), static_cast<Prefix>(key), false);
+            }
+
+            /// `O(min(log(n), sizeof(Key)))`
+            const_iterator lower_bound(key_type const& key) const
+            {
+                return const_iterator(fNode.get(), static_cast<Prefix>(key), false);
+            }
+
+            /// Return an iterator to the first value whose key is greater
+            /// than `key` in `key_comp()` order.
+            /// `O(min(log(n), sizeof(Key)))`
+            iterator upper_bound(key_type const& key)
+            {
+                return iterator(fNode.get(), static_cast<Prefix>(key), true);
+            }
+
+            /// `O(min(log(n), sizeof(Key)))`
+            const_iterator upper_bound(key_type const& key) const
+            {
+                return const_iterator(fNode.get(), static_cast<Prefix>(key), true);
+            }
+
+            /// `O(min(log(n), sizeof(Key)))`
+            std::pair<iterator, iterator> equal_range(key_type const& key)
+            {
+                return std::make_pair(lower_bound(key), upper_bound(key));
+            }
+
+            /// `O(min(log(n), sizeof(Key)))`
+            std::pair<const_iterator, const_iterator> equal_range(key_type const& key) const
+            {
+                return std::make_pair(lower_bound(key), upper_bound(key));
+            }
+
+            /// Return a tree holding the values whose keys agree with
+            /// `prefix` on their leading `bits` bits, such as every pointer
+            /// into one page.  The result shares the matching subtree, so
+            /// nothing is copied.  The size of the result of an `uncounted`
+            /// tree is counted by its first `size`.
+            /// `O(min(log(n), sizeof(Key)))`
+            SharedRadixTree subtree(key_type const& prefix, int bits) const
+            {
+                SharedRadixTree result(fAllocator);
+                result.fNode = find_subtree(fNode, static_cast<Prefix>(prefix), bits);
+                if (result.fNode == fNode) {
+                    result.fSize = fSize;
+                } else if (result.fNode) {
+                    result.fSize.set(Counts::is_counted::value ? subtree_size(result.fNode.get()) : size_type_unknown());
+                }
+                return result;
+            }
+
+            /// Write the result of `find` for every key in `[first, last)`
+            /// to `out`, in order, returning the end of the output.  Rather
+            /// than walking the tree for one key after another, lookups are
+            /// interleaved so that a cache miss on one key is overlapped with
+            /// progress on others, which raises throughput on trees much
+            /// larger than the cache.  `O(k * min(log(n), sizeof(Key)))`
+            template <typename InputIterator, typename OutputIterator>
+            OutputIterator find_many(InputIterator first, InputIterator last, OutputIterator out)
+            {
+                return find_many_impl(this, first, last, out);
+            }
+
+            template <typename InputIterator, typename OutputIterator>
+            OutputIterator find_many(InputIterator first, InputIterator last, OutputIterator out) const
+            {
+                return find_many_impl(this, first, last, out);
+            }
+
+            /// If `key` is absent, nothing is copied.
             /// `O(min(log(n), sizeof(Key)))`
             size_type erase(key_type const& key)
             {
                 if (fNode) {
-                    size_type result;
-                    std::tie(fNode, result) = fNode->erase_unique(fNode, key);
+                    Metrics::count_write(fNode);
+                    auto result = erase_value(fNode, key, fAllocator);
+                    fSize.add(-result);
                     return result;
                 }
                 return 0;
             }
 
+            /// `O(sizeof(Key))`
+            iterator begin()
+            {
+                return iterator(fNode.get());
+            }
+
+            /// `O(sizeof(Key))`
+            const_iterator begin() const
+            {
+                return const_iterator(fNode.get());
+            }
+
+            /// `O(sizeof(Key))`
+            const_iterator cbegin() const
+            {
+                return const_iterator(fNode.get());
+            }
+
             /// `O(1)`
             iterator end()
             {
@@ -989,10 +3089,23 @@ namespace EML
                 return const_iterator();
             }
 
+            /// Call `f` with every value in the same order as iteration.  This
+            /// avoids maintaining an iterator's stack, so it is the faster way
+            /// to scan the whole tree.  `O(n)`
+            template <typename Function>
+            Function for_each(Function f) const
+            {
+                if (fNode) {
+                    for_each_value(fNode.get(), f);
+                }
+                return f;
+            }
+
             /// `O(n)`
             void clear()
             {
                 fNode = nullptr;
+                fSize.set(0);
             }
 
             /// `O(1)`
@@ -1001,18 +3114,350 @@ namespace EML
                 return !fNode;
             }
 
+            /// Count the nodes of this tree, their depths, and the bytes they
+            /// occupy, including how many of those bytes are shared with
+            /// other trees.  `O(n)`
+            tree_stats stats() const
+            {
+                tree_stats result;
+                if (fNode) {
+                    collect_stats(fNode.get(), 0, false, result);
+                    std::size_t depths = 0;
+                    for (std::size_t depth = 0; depth != result.fDepths.size(); ++depth) {
+                        depths += depth * result.fDepths[depth];
+                    }
+                    result.fMaxDepth = result.fDepths.size() - 1;
+                    result.fAverageDepth = static_cast<double>(depths) / result.fLeaves;
+                }
+                return result;
+            }
+
+            /// `O(1)`, except that the first call on the result of `split` or
+            /// `subtree` of an `uncounted` tree counts its values in `O(n)`.
+            size_type size() const
+            {
+                auto size = fSize.get();
+                if (size == size_type_unknown()) {
+                    size = fNode ? subtree_size(fNode.get()) : 0;
+                    fSize.set(size);
+                }
+                return size;
+            }
+
+            /// Return the value with the `n`th smallest key in `key_comp()`
+            /// order, or `end()` if there are not that many values.  Requires
+            /// a `counted` tree.  `O(min(log(n), sizeof(Key)))`
+            iterator nth(size_type n)
+            {
+                return nth_impl(this, n);
+            }
+
+            /// `O(min(log(n), sizeof(Key)))`
+            const_iterator nth(size_type n) const
+            {
+                return nth_impl(this, n);
+            }
+
+            /// Return the number of keys less than `key` in `key_comp()`
+            /// order.  Requires a `counted` tree.
+            /// `O(min(log(n), sizeof(Key)))`
+            size_type rank(key_type const& key) const
+            {
+                static_assert(Counts::is_counted::value, "rank requires a counted tree");
+                if (!fNode) {
+                    return 0;
+                }
+                return rank_of(fNode.get(), key);
+            }
+
+            /// Insert every value of `other`.  The mapped value of a key in
+            /// both trees becomes `combine(mine, theirs)`.  Subtrees this
+            /// tree shares with `other` are kept as is without calling
+            /// `combine`, and all other nodes of both trees are reused where
+            /// possible, so merging trees derived from a common snapshot
+            /// costs `O(d * min(log(n), sizeof(Key)))` for `d` differing
+            /// keys.  In general, `O(m + n)`.  If `other` allocates from an
+            /// arena other than this tree's, its values are copied into this
+            /// tree's arena first.
+            template <typename Combine>
+            void merge_with(SharedRadixTree const& other, Combine combine)
+            {
+                size_type added = 0;
+                merge_impl(other, combine, fSize.known() ? &added : nullptr);
+                fSize.add(added);
+            }
+
+            /// Erase every key not in `other`.  The mapped value of each
+            /// remaining key becomes `combine(mine, theirs)`, except within
+            /// subtrees shared with `other`, which are kept as is.  Only
+            /// nodes this tree already shares are kept from `other`, so
+            /// `other` may allocate from another arena.
+            /// @see merge_with
+            template <typename Combine>
+            void intersect_with(SharedRadixTree const& other, Combine combine)
+            {
+                size_type removed = 0;
+                fNode = intersect(fNode, other.fNode, combine, fAllocator, removed);
+                fSize.add(-removed);
+            }
+
+            /// Split this tree at `key` into the values whose keys are less
+            /// than `key` in `key_comp()` order and the values whose keys are
+            /// not.  Both trees share every node off the path of `key`, so
+            /// only `O(min(log(n), sizeof(Key)))` nodes are allocated.  When
+            /// neither tree is empty, their sizes in an `uncounted` tree are
+            /// counted by their first `size`.  `O(min(log(n), sizeof(Key)))`
+            std::pair<SharedRadixTree, SharedRadixTree> split(key_type const& key) const
+            {
+                std::pair<SharedRadixTree, SharedRadixTree> result{SharedRadixTree(fAllocator), SharedRadixTree(fAllocator)};
+                if (fNode) {
+                    size_type less = 0;
+                    auto halves = split_at(fNode, static_cast<Prefix>(key), result.first.fAllocator, Counts::is_counted::value ? &less : nullptr);
+                    result.first.fNode = std::move(halves.first);
+                    result.second.fNode = std::move(halves.second);
+                    if (!result.first.fNode) {
+                        result.second.fSize = fSize;
+                    } else if (!result.second.fNode) {
+                        result.first.fSize = fSize;
+                    } else if (Counts::is_counted::value) {
+                        result.first.fSize.set(less);
+                        result.second.fSize.set(size() - less);
+                    } else {
+                        result.first.fSize.set(size_type_unknown());
+                        result.second.fSize.set(size_type_unknown());
+                    }
+                }
+                return result;
+            }
+
+            /// Insert every value of `other`, whose keys should all be absent
+            /// from this tree.  When the keys of one tree all precede those
+            /// of the other in `key_comp()` order, as for the two halves of a
+            /// `split`, only the `branch` nodes along the boundary between
+            /// them are rebuilt, taking `O(min(log(n), sizeof(Key)))`.  A key
+            /// in both trees keeps the value of this tree.  If both sizes are
+            /// known, the keys added are counted as by `merge_with`, so the
+            /// size stays exact; in an `uncounted` tree, that takes `O(m)`.
+            /// Otherwise, the size is left to be counted by the next `size`.
+            void join(SharedRadixTree const& other)
+            {
+                auto first = [](mapped_type const& mine, mapped_type const&) { return mine; };
+                auto counting = fSize.known() && other.fSize.known();
+                auto wasEmpty = !fNode;
+                size_type added = 0;
+                merge_impl(other, first, counting ? &added : nullptr);
+                if (wasEmpty) {
+                    return;
+                }
+                if (counting) {
+                    fSize.add(added);
+                } else if (other.fNode) {
+                    fSize.set(size_type_unknown());
+                }
+            }
+
+            /// Erase every key in `other`.  Subtrees shared with `other` are
+            /// dropped whole, and subtrees disjoint from `other` are kept.
+            /// No node of `other` is kept, so `other` may allocate from
+            /// another arena.
+            /// @see merge_with
+            void difference(SharedRadixTree const& other)
+            {
+                size_type removed = 0;
+                fNode = shared_radix_tree_detail::difference(fNode, other.fNode, fAllocator, removed);
+                fSize.add(-removed);
+            }
+
           private:
+            friend struct tree_access;
+
+            /// Implementation of all insertions, constructing values with
+            /// `source`.
+            /// @see leaf_source
+            template <typename Source>
+            std::pair<iterator, bool> insert_impl(Source& source)
+            {
+                if (fNode) {
+                    Metrics::count_write(fNode);
+                    value_type* i;
+                    bool inserted;
+                    std::tie(i, inserted) = insert_value(fNode, source, fAllocator);
+                    if (inserted) {
+                        fSize.add(1);
+                    }
+                    return std::make_pair(iterator(fNode.get(), i), inserted);
+                }
+                auto leaf = source.make(fAllocator);
+                auto i = &leaf->get();
+                fNode = std::move(leaf);
+                fSize.set(1);
+                return std::make_pair(iterator(fNode.get(), i), true);
+            }
+
+            /// Implementation of both `const` and non-`const` `find`.
             template <typename This>
             static typename find_result<This>::type find_impl(This aThis, key_type const& aKey)
             {
-                if (aThis->fNode) {
-                    return aThis->fNode->find(aKey);
+                typedef typename find_result<This>::type result_type;
+                if (!aThis->fNode) {
+                    return result_type();
                 }
-                return typename find_result<This>::type();
+                if (auto leaf = find_leaf(aThis->fNode.get(), aKey)) {
+                    return result_type(aThis->fNode.get(), &leaf->get());
+                }
+                return result_type();
+            }
+
+            /// Implementation of both `const` and non-`const` `find_many`.
+            template <typename This, typename InputIterator, typename OutputIterator>
+            static OutputIterator find_many_impl(This aThis, InputIterator first, InputIterator last, OutputIterator out)
+            {
+                typedef typename find_result<This>::type result_type;
+                if (!aThis->fNode) {
+                    for (; first != last; ++first) {
+                        *out++ = result_type();
+                    }
+                    return out;
+                }
+                auto root = aThis->fNode.get();
+                auto f = [root, &out](leaf_type* leaf) {
+                    *out++ = leaf ? result_type(root, &leaf->get()) : result_type();
+                };
+                find_leaves(root, first, last, f);
+                return out;
+            }
+
+            /// Implementation of both `const` and non-`const` `nth`.
+            template <typename This>
+            static typename find_result<This>::type nth_impl(This aThis, size_type n)
+            {
+                static_assert(Counts::is_counted::value, "nth requires a counted tree");
+                typedef typename find_result<This>::type result_type;
+                if (n < 0 || n >= aThis->size()) {
+                    return result_type();
+                }
+                return result_type(aThis->fNode.get(), &nth_leaf(aThis->fNode.get(), n)->get());
+            }
+
+            /// Union with the nodes of `other`, copying them first if this
+            /// tree cannot share them.  If this tree is empty, it takes the
+            /// size of `other`.  Otherwise, the number of keys only in
+            /// `other` is added to `*added` unless it is `nullptr`.
+            template <typename Combine>
+            void merge_impl(SharedRadixTree const& other, Combine& combine, size_type* added)
+            {
+                auto theirs = other.fNode;
+                auto theirSize = other.fSize;
+                if (theirs && !shares_nodes(fAllocator, other.fAllocator)) {
+                    size_type size = 0;
+                    theirs = build_sorted<node_type>(other.begin(), other.end(), fAllocator, size);
+                    theirSize.set(size);
+                }
+                if (!fNode) {
+                    fNode = std::move(theirs);
+                    fSize = theirSize;
+                } else if (theirs) {
+                    fNode = merge(fNode, theirs, combine, fAllocator, added);
+                }
+            }
+
+            static size_type size_type_unknown()
+            {
+                return lazy_size<size_type>::unknown();
             }
 
+            /// Declared before `fNode` so that it is destroyed after it.
+            allocator_type fAllocator;
             intrusive_shared_ptr<node_type> fNode;
+            mutable lazy_size<size_type> fSize;
         };
+
+        struct tree_access
+        {
+            template <typename Tree>
+            struct node_of
+            {
+                typedef typename Tree::node_type type;
+            };
+
+            template <typename Tree>
+            static intrusive_shared_ptr<typename Tree::node_type> const& root(Tree const& tree)
+            {
+                return tree.fNode;
+            }
+
+            template <typename Tree>
+            static typename Tree::allocator_type& allocator(Tree& tree)
+            {
+                return tree.fAllocator;
+            }
+
+            /// Take the nodes of `tree`, leaving it empty.
+            template <typename Tree>
+            static intrusive_shared_ptr<typename Tree::node_type> release(Tree& tree)
+            {
+                auto result = std::move(tree.fNode);
+                tree.clear();
+                return result;
+            }
+
+            /// The stored size of `tree`, which may be `unknown`, so that it
+            /// may be handed on without counting.
+            /// @see lazy_size
+            template <typename Tree>
+            static typename Tree::size_type stored_size(Tree const& tree)
+            {
+                return tree.fSize.get();
+            }
+
+            /// Replace the nodes of `tree` with `root`, holding `size` values,
+            /// or an `unknown` number of them.
+            template <typename Tree>
+            static void reset(Tree& tree, intrusive_shared_ptr<typename Tree::node_type> root, typename Tree::size_type size)
+            {
+                tree.fNode = std::move(root);
+                tree.fSize.set(size);
+            }
+        };
+
+        /// Compare two versions of a tree, calling `onAdded(value)` for each
+        /// value only in `after`, `onRemoved(value)` for each value only in
+        /// `before`, and `onChanged(valueBefore, valueAfter)` for each key in
+        /// both whose `leaf` nodes differ, all in key order.  Subtrees the
+        /// two versions share are skipped without being visited, so versions
+        /// derived from one another are compared in
+        /// `O(d * min(log(n), sizeof(Key)))` for `d` changed keys.  A key
+        /// whose mapped value was rewritten with an equal value is still
+        /// reported as changed.
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            typename Metrics,
+            typename OnAdded,
+            typename OnRemoved,
+            typename OnChanged
+            >
+        void diff(SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics> const& before,
+                  SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, binary_nodes, Metrics> const& after,
+                  OnAdded onAdded,
+                  OnRemoved onRemoved,
+                  OnChanged onChanged)
+        {
+            diff_callbacks<OnAdded, OnRemoved, OnChanged> callbacks = {onAdded, onRemoved, onChanged};
+            diff_nodes(tree_access::root(before).get(), tree_access::root(after).get(), callbacks);
+        }
+
+        template <typename Key, typename T, typename Prefix, typename Mask, typename RefCount, typename Allocator, typename Counts, typename Layout, typename Metrics>
+        void swap(SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Layout, Metrics>& lhs,
+                  SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, Layout, Metrics>& rhs)
+        {
+            lhs.swap(rhs);
+        }
     }
 
     /// Map from `Key` to `T` implemented as a radix tree with path
@@ -1020,6 +3465,40 @@ namespace EML
     /// time, while copying is constant time.  The methods of this class follow
     /// the `AssociativeContainer` concept where possible.
     using shared_radix_tree_detail::SharedRadixTree;
+
+    using shared_radix_tree_detail::diff;
+    using shared_radix_tree_detail::tree_stats;
+
+    /// `SharedRadixTree` with the default policies.
+    template <typename Key, typename T>
+    using shared_scalar_map = SharedRadixTree<Key, T>;
+
+    /// `SharedRadixTree` whose copies may be published to other threads.
+    /// Each copy may be read and written by the thread holding it without
+    /// synchronizing with the threads holding the other copies.
+    template <typename Key, typename T>
+    using ConcurrentSharedRadixTree = SharedRadixTree<
+        Key,
+        T,
+        typename shared_radix_tree_detail::default_prefix<Key>::type,
+        typename shared_radix_tree_detail::default_mask<Key>::type,
+        shared_radix_tree_detail::multi_threaded>;
+
+    using shared_radix_tree_detail::single_threaded;
+    using shared_radix_tree_detail::multi_threaded;
+    using shared_radix_tree_detail::new_allocator;
+    using shared_radix_tree_detail::pool_allocator;
+    using shared_radix_tree_detail::arena_allocator;
+    using shared_radix_tree_detail::concurrent_allocation;
+    using shared_radix_tree_detail::uncounted;
+    using shared_radix_tree_detail::counted;
+    using shared_radix_tree_detail::binary_nodes;
+    using shared_radix_tree_detail::wide_nodes;
+    using shared_radix_tree_detail::compact_nodes;
+    using shared_radix_tree_detail::tree_event;
+    using shared_radix_tree_detail::tree_event_name;
+    using shared_radix_tree_detail::no_metrics;
+    using shared_radix_tree_detail::atomic_metrics;
 }
 
 #endif
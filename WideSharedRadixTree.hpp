@@ -0,0 +1,995 @@
+// Copyright 2015 The MathWorks, Inc.
+#ifndef _eml_general_WideSharedRadixTree_hpp
+#define _eml_general_WideSharedRadixTree_hpp
+
+#include "SharedRadixTree.hpp"
+
+namespace EML
+{
+    namespace shared_radix_tree_detail
+    {
+#if defined(__GNUC__)
+
+        inline int popcount(std::uint32_t arg)
+        {
+            return __builtin_popcount(arg);
+        }
+
+        inline int popcount(std::uint64_t arg)
+        {
+            return __builtin_popcountll(arg);
+        }
+
+#else
+
+        inline int popcount(std::uint32_t arg)
+        {
+            arg = arg - ((arg >> 1) & 0x55555555u);
+            arg = (arg & 0x33333333u) + ((arg >> 2) & 0x33333333u);
+            return static_cast<int>((((arg + (arg >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24);
+        }
+
+        inline int popcount(std::uint64_t arg)
+        {
+            return popcount(static_cast<std::uint32_t>(arg)) + popcount(static_cast<std::uint32_t>(arg >> 32));
+        }
+
+#endif
+
+        /// The unsigned bits of a key of a wide tree, ordered as `key_less`
+        /// orders keys.
+        template <typename Key>
+        struct wide_key_bits
+            : std::conditional<std::is_pointer<Key>::value,
+                               std::uintptr_t,
+                               typename std::make_unsigned<typename std::conditional<std::is_pointer<Key>::value, int, Key>::type>::type>
+        {};
+
+        template <typename Key>
+        typename wide_key_bits<Key>::type to_wide_key_bits(Key key, std::false_type)
+        {
+            return static_cast<typename wide_key_bits<Key>::type>(key);
+        }
+
+        template <typename Key>
+        typename wide_key_bits<Key>::type to_wide_key_bits(Key key, std::true_type)
+        {
+            return reinterpret_cast<std::uintptr_t>(key);
+        }
+
+        template <typename Key>
+        typename wide_key_bits<Key>::type to_wide_key_bits(Key key)
+        {
+            return to_wide_key_bits(key, std::is_pointer<Key>());
+        }
+
+        template <typename, typename, typename, typename, unsigned>
+        struct wide_node;
+
+        template <typename, typename, typename, typename, unsigned>
+        struct wide_branch;
+
+        template <typename, typename, typename, typename, unsigned>
+        struct wide_leaf;
+
+        /// Node of a tree with `wide_nodes<Bits>`.  Like `node`, the kind is
+        /// stored in a byte next to the use count.
+        template <
+            typename Key,
+            typename T,
+            typename RefCount,
+            typename Allocator,
+            unsigned Bits
+            >
+        struct wide_node : control_block<RefCount>
+        {
+            typedef wide_node node_type;
+            typedef wide_branch<Key, T, RefCount, Allocator, Bits> branch_type;
+            typedef wide_leaf<Key, T, RefCount, Allocator, Bits> leaf_type;
+            typedef Key key_type;
+            typedef T mapped_type;
+            typedef std::pair<key_type const, mapped_type> value_type;
+            typedef typename wide_key_bits<Key>::type bits_type;
+            typedef Allocator allocator_type;
+            typedef int size_type;
+
+            enum kind_type : unsigned char
+            {
+                branch_kind,
+                leaf_kind
+            };
+
+            bool is_leaf() const
+            {
+                return fKind == leaf_kind;
+            }
+
+            /// Destroy `aNode` and every node only it uses, returning their
+            /// storage to `Allocator`.  As with `node::destroy`, dead nodes
+            /// are kept on a worklist, holding at most `2^Bits - 1` pending
+            /// siblings for each level of a path.  `O(k)` for `k` nodes
+            /// destroyed
+            static void destroy(wide_node* aNode)
+            {
+                static const unsigned levels = (sizeof(bits_type) * CHAR_BIT + Bits - 1) / Bits;
+                wide_node* stack[levels * ((1u << Bits) - 1) + 1];
+                int depth = 0;
+                stack[depth++] = aNode;
+                while (depth != 0) {
+                    destroy_shallow(stack[--depth], [&](wide_node* child) {
+                        stack[depth++] = child;
+                    });
+                }
+            }
+
+            /// Destroy `aNode` alone, passing each child whose last use it
+            /// held to `f(wide_node*)`.  @see node::destroy_shallow
+            template <typename Function>
+            static void destroy_shallow(wide_node* aNode, Function&& f)
+            {
+                if (aNode->is_leaf()) {
+                    static_cast<leaf_type*>(aNode)->~leaf_type();
+                    Allocator::deallocate(aNode, sizeof(leaf_type));
+                } else {
+                    branch_type::destroy_shallow(static_cast<branch_type*>(aNode), f);
+                }
+            }
+
+          protected:
+            explicit wide_node(kind_type kind)
+                : fKind(kind)
+            {}
+
+            ~wide_node() {}
+
+            wide_node(wide_node const&) = delete;
+            wide_node& operator=(wide_node const&) = delete;
+
+          private:
+            kind_type const fKind;
+
+          protected:
+            /// The level of a `wide_branch`, kept here to fill the padding
+            /// after `fKind`.
+            unsigned char fShift;
+        };
+
+        /// Branch splitting on the `Bits` bits of a key starting at `shift`.
+        /// Only present children are stored, in a variable-length array
+        /// following the branch, indexed by the number of bits set in
+        /// `bitmap` below the child's bit.  Every `wide_branch` has at least
+        /// two children, so paths stay compressed.
+        template <
+            typename Key,
+            typename T,
+            typename RefCount,
+            typename Allocator,
+            unsigned Bits
+            >
+        struct wide_branch : wide_node<Key, T, RefCount, Allocator, Bits>
+        {
+            typedef wide_node<Key, T, RefCount, Allocator, Bits> node_type;
+            using typename node_type::bits_type;
+            typedef typename std::conditional<(Bits <= 5), std::uint32_t, std::uint64_t>::type bitmap_type;
+
+            static const unsigned bits = Bits;
+            static const unsigned fanout = 1u << Bits;
+            static const unsigned key_width = sizeof(bits_type) * CHAR_BIT;
+
+            /// Allocate a branch with a null child for every bit set in
+            /// `bitmap`.
+            static intrusive_shared_ptr<wide_branch> create(Allocator& alloc, bits_type prefix, unsigned shift, bitmap_type bitmap)
+            {
+                auto size = storage_size(bitmap);
+                auto p = alloc.allocate(size);
+                auto result = ::new (p) wide_branch(prefix, shift, bitmap);
+                auto children = result->children();
+                for (int i = 0; i != result->size(); ++i) {
+                    ::new (children + i) intrusive_shared_ptr<node_type>();
+                }
+                return intrusive_shared_ptr<wide_branch>(result);
+            }
+
+            /// Called by `intrusive_shared_ptr<wide_branch>`.
+            static void destroy(wide_branch* aBranch)
+            {
+                node_type::destroy(aBranch);
+            }
+
+            /// Destroy `aBranch` alone, passing each child whose last use it
+            /// held to `f(node_type*)`.
+            template <typename Function>
+            static void destroy_shallow(wide_branch* aBranch, Function& f)
+            {
+                auto size = storage_size(aBranch->fBitmap);
+                auto children = aBranch->children();
+                for (int i = 0; i != aBranch->size(); ++i) {
+                    if (auto child = children[i].abandon()) {
+                        f(child);
+                    }
+                    children[i].~intrusive_shared_ptr<node_type>();
+                }
+                aBranch->~wide_branch();
+                Allocator::deallocate(aBranch, size);
+            }
+
+            /// Bits of a key above this branch's level.
+            static bits_type high_mask(unsigned shift)
+            {
+                typedef typename std::common_type<bits_type, unsigned>::type promoted_type;
+                return shift + Bits >= key_width ? static_cast<bits_type>(0) : static_cast<bits_type>(~static_cast<promoted_type>(0) << (shift + Bits));
+            }
+
+            /// The level of the highest bit at which `bits1` and `bits2`
+            /// differ.
+            static unsigned level(bits_type bits1, bits_type bits2)
+            {
+                auto bit = static_cast<unsigned>(log2(bits1 ^ bits2));
+                return bit - bit % Bits;
+            }
+
+            bits_type prefix() const
+            {
+                return fPrefix;
+            }
+
+            unsigned shift() const
+            {
+                return this->fShift;
+            }
+
+            bitmap_type bitmap() const
+            {
+                return fBitmap;
+            }
+
+            int size() const
+            {
+                return popcount(fBitmap);
+            }
+
+            bool not_mem(bits_type bits) const
+            {
+                return (bits & high_mask(this->fShift)) != fPrefix;
+            }
+
+            bitmap_type bit(bits_type bits) const
+            {
+                return static_cast<bitmap_type>(1) << ((bits >> this->fShift) & (fanout - 1));
+            }
+
+            /// The position of the child for `bit` among the present children.
+            int position(bitmap_type bit) const
+            {
+                return popcount(static_cast<bitmap_type>(fBitmap & (bit - 1)));
+            }
+
+            intrusive_shared_ptr<node_type>* children()
+            {
+                return reinterpret_cast<intrusive_shared_ptr<node_type>*>(reinterpret_cast<char*>(this) + children_offset());
+            }
+
+            intrusive_shared_ptr<node_type> const* children() const
+            {
+                return reinterpret_cast<intrusive_shared_ptr<node_type> const*>(reinterpret_cast<char const*>(this) + children_offset());
+            }
+
+          private:
+            wide_branch(bits_type prefix, unsigned shift, bitmap_type bitmap)
+                : node_type(node_type::branch_kind)
+                , fPrefix(prefix)
+                , fBitmap(bitmap)
+            {
+                this->fShift = static_cast<unsigned char>(shift);
+            }
+
+            ~wide_branch() {}
+
+            /// The children start at the first suitably aligned offset past
+            /// the branch.
+            static std::size_t children_offset()
+            {
+                auto alignment = alignof(intrusive_shared_ptr<node_type>);
+                return (sizeof(wide_branch) + alignment - 1) / alignment * alignment;
+            }
+
+            static std::size_t storage_size(bitmap_type bitmap)
+            {
+                return children_offset() + popcount(bitmap) * sizeof(intrusive_shared_ptr<node_type>);
+            }
+
+            bits_type fPrefix;
+            bitmap_type fBitmap;
+        };
+
+        template <
+            typename Key,
+            typename T,
+            typename RefCount,
+            typename Allocator,
+            unsigned Bits
+            >
+        struct wide_leaf : wide_node<Key, T, RefCount, Allocator, Bits>
+        {
+            typedef wide_node<Key, T, RefCount, Allocator, Bits> node_type;
+            using typename node_type::key_type;
+            using typename node_type::mapped_type;
+            using typename node_type::value_type;
+            using typename node_type::allocator_type;
+
+            template <typename OtherKey, typename U>
+            wide_leaf(OtherKey&& key, U&& mapped)
+                : node_type(node_type::leaf_kind)
+                , fValue(std::forward<OtherKey>(key), std::forward<U>(mapped))
+            {}
+
+            template <typename KeyArgs, typename MappedArgs>
+            wide_leaf(std::piecewise_construct_t, KeyArgs&& keyArgs, MappedArgs&& mappedArgs)
+                : node_type(node_type::leaf_kind)
+                , fValue(std::piecewise_construct, std::forward<KeyArgs>(keyArgs), std::forward<MappedArgs>(mappedArgs))
+            {}
+
+            value_type& get()
+            {
+                return fValue;
+            }
+
+            value_type const& get() const
+            {
+                return fValue;
+            }
+
+          private:
+            value_type fValue;
+        };
+
+        /// Forward iterator over a tree with `wide_nodes`.  Like `iterator`,
+        /// it keeps a fixed-depth stack of the branches above the current
+        /// value, built lazily for iterators returned from `find` or
+        /// `insert`.
+        template <typename Node, typename ValueType>
+        struct wide_iterator
+        {
+            template <typename, typename>
+            friend struct wide_iterator;
+
+            typedef std::forward_iterator_tag iterator_category;
+            typedef typename std::remove_const<ValueType>::type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef ValueType* pointer;
+            typedef ValueType& reference;
+
+            wide_iterator()
+                : fValue(nullptr)
+                , fRoot(nullptr)
+                , fDepth(0)
+            {}
+
+            /// Construct an iterator pointing to the least value under
+            /// `root`.
+            explicit wide_iterator(Node const* root)
+                : fValue(nullptr)
+                , fRoot(root)
+                , fDepth(0)
+            {
+                if (root) {
+                    descend(root);
+                }
+            }
+
+            /// Construct an iterator pointing to `value` under `root`.
+            wide_iterator(Node const* root, ValueType* value)
+                : fValue(value)
+                , fRoot(root)
+                , fDepth(unbuilt)
+            {}
+
+            wide_iterator(wide_iterator const& i)
+                : fValue(i.fValue)
+                , fRoot(i.fRoot)
+                , fDepth(i.fDepth)
+            {
+                copy_stack(i);
+            }
+
+            template <typename OtherValueType>
+            wide_iterator(wide_iterator<Node, OtherValueType> const& i)
+                : fValue(i.fValue)
+                , fRoot(i.fRoot)
+                , fDepth(i.fDepth)
+            {
+                copy_stack(i);
+            }
+
+            wide_iterator& operator=(wide_iterator const& i)
+            {
+                fValue = i.fValue;
+                fRoot = i.fRoot;
+                fDepth = i.fDepth;
+                copy_stack(i);
+                return *this;
+            }
+
+            ValueType& operator*() const
+            {
+                return *fValue;
+            }
+
+            ValueType* operator->() const
+            {
+                return fValue;
+            }
+
+            wide_iterator& operator++()
+            {
+                if (fDepth == unbuilt) {
+                    build_stack();
+                }
+                while (fDepth > 0) {
+                    auto& top = fStack[fDepth - 1];
+                    if (++top.fPosition != top.fBranch->size()) {
+                        descend(top.fBranch->children()[top.fPosition].get());
+                        return *this;
+                    }
+                    --fDepth;
+                }
+                fValue = nullptr;
+                return *this;
+            }
+
+            wide_iterator operator++(int)
+            {
+                wide_iterator result(*this);
+                ++*this;
+                return result;
+            }
+
+            friend bool operator==(wide_iterator const& lhs, wide_iterator const& rhs)
+            {
+                return lhs.fValue == rhs.fValue;
+            }
+
+            friend bool operator!=(wide_iterator const& lhs, wide_iterator const& rhs)
+            {
+                return lhs.fValue != rhs.fValue;
+            }
+
+          private:
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::bits_type bits_type;
+
+            struct frame
+            {
+                branch_type const* fBranch;
+                int fPosition;
+            };
+
+            /// Every `wide_branch` on a path sits at a lower level than its
+            /// parent, and there are this many levels.
+            static const int max_depth = (sizeof(bits_type) * CHAR_BIT + branch_type::bits - 1) / branch_type::bits;
+
+            static const int unbuilt = -1;
+
+            template <typename OtherValueType>
+            void copy_stack(wide_iterator<Node, OtherValueType> const& i)
+            {
+                if (fDepth > 0) {
+                    std::copy(i.fStack, i.fStack + fDepth, fStack);
+                }
+            }
+
+            void descend(Node const* node)
+            {
+                while (!node->is_leaf()) {
+                    auto branch = static_cast<branch_type const*>(node);
+                    frame top = {branch, 0};
+                    fStack[fDepth++] = top;
+                    node = branch->children()[0].get();
+                }
+                fValue = &static_cast<leaf_type*>(const_cast<Node*>(node))->get();
+            }
+
+            void build_stack()
+            {
+                fDepth = 0;
+                auto bits = to_wide_key_bits(fValue->first);
+                auto node = fRoot;
+                while (!node->is_leaf()) {
+                    auto branch = static_cast<branch_type const*>(node);
+                    frame top = {branch, branch->position(branch->bit(bits))};
+                    fStack[fDepth++] = top;
+                    node = branch->children()[top.fPosition].get();
+                }
+            }
+
+            ValueType* fValue;
+            Node const* fRoot;
+            int fDepth;
+            frame fStack[max_depth];
+        };
+
+        /// Copy of `aBranch` with `bit` set to `child`, which may add or
+        /// replace a child.  The other children are moved out of `aBranch`
+        /// if `move` is `true`.
+        template <typename Branch, typename Node>
+        intrusive_shared_ptr<Branch> wide_set_child(Branch* aBranch,
+                                                    typename Branch::bitmap_type bit,
+                                                    intrusive_shared_ptr<Node> child,
+                                                    bool move,
+                                                    typename Node::allocator_type& alloc)
+        {
+            auto result = Branch::create(alloc, aBranch->prefix(), aBranch->shift(), aBranch->bitmap() | bit);
+            auto from = aBranch->children();
+            auto to = result->children();
+            auto position = result->position(bit);
+            for (int i = 0, j = 0; i != result->size(); ++i) {
+                if (i == position) {
+                    to[i] = std::move(child);
+                    j += aBranch->bitmap() & bit ? 1 : 0;
+                } else if (move) {
+                    to[i] = std::move(from[j++]);
+                } else {
+                    to[i] = from[j++];
+                }
+            }
+            return result;
+        }
+
+        /// Copy of `aBranch` without the child for `bit`.
+        template <typename Branch, typename Node>
+        intrusive_shared_ptr<Branch> wide_erase_child(Branch* aBranch,
+                                                      typename Branch::bitmap_type bit,
+                                                      bool move,
+                                                      typename Node::allocator_type& alloc)
+        {
+            auto result = Branch::create(alloc, aBranch->prefix(), aBranch->shift(), aBranch->bitmap() & ~bit);
+            auto from = aBranch->children();
+            auto to = result->children();
+            auto position = aBranch->position(bit);
+            for (int i = 0, j = 0; i != result->size(); ++i, ++j) {
+                if (j == position) {
+                    ++j;
+                }
+                if (move) {
+                    to[i] = std::move(from[j]);
+                } else {
+                    to[i] = from[j];
+                }
+            }
+            return result;
+        }
+
+        /// A new `wide_branch` over `node1` and `node2`, which hold keys
+        /// beginning with `bits1` and `bits2`.
+        template <typename Node>
+        intrusive_shared_ptr<Node> wide_join(typename Node::bits_type bits1,
+                                             intrusive_shared_ptr<Node> node1,
+                                             typename Node::bits_type bits2,
+                                             intrusive_shared_ptr<Node> node2,
+                                             typename Node::allocator_type& alloc)
+        {
+            typedef typename Node::branch_type branch_type;
+            auto shift = branch_type::level(bits1, bits2);
+            auto fanoutMask = static_cast<typename Node::bits_type>(branch_type::fanout - 1);
+            auto bit1 = static_cast<typename branch_type::bitmap_type>(1) << ((bits1 >> shift) & fanoutMask);
+            auto bit2 = static_cast<typename branch_type::bitmap_type>(1) << ((bits2 >> shift) & fanoutMask);
+            auto result = branch_type::create(alloc, bits1 & branch_type::high_mask(shift), shift, bit1 | bit2);
+            auto children = result->children();
+            if (bit1 < bit2) {
+                children[0] = std::move(node1);
+                children[1] = std::move(node2);
+            } else {
+                children[0] = std::move(node2);
+                children[1] = std::move(node1);
+            }
+            return result;
+        }
+
+        /// The lowest key bits under `node`, enough to place it in a parent.
+        template <typename Node>
+        typename Node::bits_type wide_node_bits(Node const* node)
+        {
+            if (node->is_leaf()) {
+                return to_wide_key_bits(static_cast<typename Node::leaf_type const*>(node)->get().first);
+            }
+            return static_cast<typename Node::branch_type const*>(node)->prefix();
+        }
+
+        /// Insert the value of `source` under `ptr`.  `unique` is whether
+        /// the path above `ptr` is unique; nodes on a unique path are
+        /// updated in place.
+        /// @see insert_value
+        template <typename Node, typename Source>
+        std::tuple<intrusive_shared_ptr<Node>, typename Node::value_type*, bool>
+        wide_insert(intrusive_shared_ptr<Node> const& ptr, Source& source, bool unique, typename Node::allocator_type& alloc)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::value_type value_type;
+            unique = unique && ptr.unique();
+            auto bits = to_wide_key_bits(source.key());
+            if (ptr->is_leaf()) {
+                auto aLeaf = static_cast<leaf_type*>(ptr.get());
+                if (source.key() == aLeaf->get().first) {
+                    if (!Source::assigns::value) {
+                        return std::make_tuple(ptr, &aLeaf->get(), false);
+                    }
+                    if (unique) {
+                        source.assign(aLeaf->get().second);
+                        return std::make_tuple(ptr, &aLeaf->get(), false);
+                    }
+                    auto leaf = source.make(alloc);
+                    auto i = &leaf->get();
+                    return std::make_tuple(intrusive_shared_ptr<Node>(std::move(leaf)), i, false);
+                }
+                auto leaf = source.make(alloc);
+                auto i = &leaf->get();
+                return std::make_tuple(wide_join(bits, intrusive_shared_ptr<Node>(std::move(leaf)), to_wide_key_bits(aLeaf->get().first), ptr, alloc), i, true);
+            }
+            auto aBranch = static_cast<branch_type*>(ptr.get());
+            if (aBranch->not_mem(bits)) {
+                auto leaf = source.make(alloc);
+                auto i = &leaf->get();
+                return std::make_tuple(wide_join(bits, intrusive_shared_ptr<Node>(std::move(leaf)), aBranch->prefix(), ptr, alloc), i, true);
+            }
+            auto bit = aBranch->bit(bits);
+            if (!(aBranch->bitmap() & bit)) {
+                auto leaf = source.make(alloc);
+                auto i = &leaf->get();
+                auto branch = wide_set_child(aBranch, bit, intrusive_shared_ptr<Node>(std::move(leaf)), unique, alloc);
+                return std::make_tuple(intrusive_shared_ptr<Node>(std::move(branch)), i, true);
+            }
+            auto& child = aBranch->children()[aBranch->position(bit)];
+            intrusive_shared_ptr<Node> result;
+            value_type* i;
+            bool inserted;
+            std::tie(result, i, inserted) = wide_insert(child, source, unique, alloc);
+            if (result == child) {
+                return std::make_tuple(ptr, i, inserted);
+            }
+            if (unique) {
+                child = std::move(result);
+                return std::make_tuple(ptr, i, inserted);
+            }
+            auto branch = wide_set_child(aBranch, bit, std::move(result), false, alloc);
+            return std::make_tuple(intrusive_shared_ptr<Node>(std::move(branch)), i, inserted);
+        }
+
+        /// Erase `key` under `ptr`, returning the node replacing `ptr` and
+        /// the number of values erased.
+        /// @see wide_insert
+        template <typename Node>
+        std::tuple<intrusive_shared_ptr<Node>, typename Node::size_type>
+        wide_erase(intrusive_shared_ptr<Node> const& ptr, typename Node::key_type const& key, bool unique, typename Node::allocator_type& alloc)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            typedef typename Node::size_type size_type;
+            if (ptr->is_leaf()) {
+                if (key == static_cast<leaf_type const*>(ptr.get())->get().first) {
+                    return std::make_tuple(intrusive_shared_ptr<Node>(), 1);
+                }
+                return std::make_tuple(ptr, 0);
+            }
+            unique = unique && ptr.unique();
+            auto bits = to_wide_key_bits(key);
+            auto aBranch = static_cast<branch_type*>(ptr.get());
+            auto bit = aBranch->bit(bits);
+            if (aBranch->not_mem(bits) || !(aBranch->bitmap() & bit)) {
+                return std::make_tuple(ptr, 0);
+            }
+            auto position = aBranch->position(bit);
+            auto& child = aBranch->children()[position];
+            intrusive_shared_ptr<Node> result;
+            size_type erased;
+            std::tie(result, erased) = wide_erase(child, key, unique, alloc);
+            if (erased == 0) {
+                return std::make_tuple(ptr, 0);
+            }
+            if (result) {
+                if (unique) {
+                    child = std::move(result);
+                    return std::make_tuple(ptr, erased);
+                }
+                auto branch = wide_set_child(aBranch, bit, std::move(result), false, alloc);
+                return std::make_tuple(intrusive_shared_ptr<Node>(std::move(branch)), erased);
+            }
+            if (aBranch->size() == 2) {
+                return std::make_tuple(aBranch->children()[1 - position], erased);
+            }
+            auto branch = wide_erase_child<branch_type, Node>(aBranch, bit, unique, alloc);
+            return std::make_tuple(intrusive_shared_ptr<Node>(std::move(branch)), erased);
+        }
+
+        /// Return the `wide_leaf` under `node` whose key is `key`, or
+        /// `nullptr`.
+        template <typename Node>
+        typename Node::leaf_type* wide_find_leaf(Node* node, typename Node::key_type const& key)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            auto bits = to_wide_key_bits(key);
+            while (!node->is_leaf()) {
+                auto branch = static_cast<branch_type const*>(node);
+                auto bit = branch->bit(bits);
+                if (branch->not_mem(bits) || !(branch->bitmap() & bit)) {
+                    return nullptr;
+                }
+                node = branch->children()[branch->position(bit)].get();
+            }
+            auto leaf = static_cast<leaf_type*>(node);
+            if (key != leaf->get().first) {
+                return nullptr;
+            }
+            return leaf;
+        }
+
+        /// Call `f` with every value under `node` in order.
+        template <typename Node, typename Function>
+        void wide_for_each_value(Node const* node, Function& f)
+        {
+            typedef typename Node::branch_type branch_type;
+            typedef typename Node::leaf_type leaf_type;
+            if (node->is_leaf()) {
+                f(static_cast<leaf_type const*>(node)->get());
+                return;
+            }
+            auto branch = static_cast<branch_type const*>(node);
+            for (int i = 0; i != branch->size(); ++i) {
+                wide_for_each_value(branch->children()[i].get(), f);
+            }
+        }
+
+        /// `SharedRadixTree` whose branches split on `Bits` bits of a key at
+        /// once, cutting the depth of a dense tree by up to a factor of
+        /// `Bits`.  A branch stores its present children in an array sized
+        /// to fit, found through a bitmap of `2^Bits` bits, and branches are
+        /// only created where keys diverge, so paths stay compressed.  Like
+        /// the binary layout, copies share nodes and copy paths on write.
+        /// `Prefix` and `Mask` are unused, `Counts` must be `uncounted`,
+        /// `Metrics` must be `no_metrics`, and set operations, `from_sorted`,
+        /// `diff`, `nth`, and `rank` are only available in the binary layout.
+        template <
+            typename Key,
+            typename T,
+            typename Prefix,
+            typename Mask,
+            typename RefCount,
+            typename Allocator,
+            typename Counts,
+            unsigned Bits,
+            typename Metrics
+            >
+        struct SharedRadixTree<Key, T, Prefix, Mask, RefCount, Allocator, Counts, wide_nodes<Bits>, Metrics>
+        {
+            static_assert(2 <= Bits && Bits <= 6, "wide_nodes supports 4- to 64-way branches");
+            static_assert(std::is_same<Counts, uncounted>::value, "wide_nodes does not support counted branches");
+            static_assert(std::is_same<Metrics, no_metrics>::value, "wide_nodes does not support metrics");
+
+          private:
+            typedef wide_node<Key, T, RefCount, Allocator, Bits> node_type;
+            typedef typename node_type::branch_type branch_type;
+            typedef typename node_type::leaf_type leaf_type;
+
+          public:
+            typedef typename node_type::key_type key_type;
+            typedef typename node_type::mapped_type mapped_type;
+            typedef typename node_type::value_type value_type;
+            typedef wide_iterator<node_type, value_type> iterator;
+            typedef wide_iterator<node_type, value_type const> const_iterator;
+            typedef typename node_type::size_type size_type;
+            typedef key_less<Key, Prefix> key_compare;
+            typedef Allocator allocator_type;
+
+            SharedRadixTree()
+                : fSize(0)
+            {}
+
+            explicit SharedRadixTree(allocator_type const& alloc)
+                : fAllocator(alloc)
+                , fSize(0)
+            {}
+
+            SharedRadixTree(SharedRadixTree const&) = default;
+
+            SharedRadixTree(SharedRadixTree&& rhs)
+                : fAllocator(std::move(rhs.fAllocator))
+                , fNode(std::move(rhs.fNode))
+                , fSize(rhs.fSize)
+            {
+                rhs.fSize = 0;
+            }
+
+            SharedRadixTree& operator=(SharedRadixTree rhs)
+            {
+                swap(rhs);
+                return *this;
+            }
+
+            void swap(SharedRadixTree& rhs)
+            {
+                using std::swap;
+                swap(fAllocator, rhs.fAllocator);
+                swap(fNode, rhs.fNode);
+                swap(fSize, rhs.fSize);
+            }
+
+            allocator_type get_allocator() const
+            {
+                return fAllocator;
+            }
+
+            key_compare key_comp() const
+            {
+                return key_compare();
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            std::pair<iterator, bool> insert(value_type const& value)
+            {
+                auto source = make_leaf_source<leaf_type, std::false_type>(value.first, std::forward_as_tuple(value.second));
+                return insert_impl(source);
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            std::pair<iterator, bool> insert(value_type&& value)
+            {
+                auto source = make_leaf_source<leaf_type, std::false_type>(value.first, std::forward_as_tuple(std::move(value.second)));
+                return insert_impl(source);
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            template <typename... Args>
+            std::pair<iterator, bool> emplace(Args&&... args)
+            {
+                return insert(value_type(std::forward<Args>(args)...));
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            template <typename... Args>
+            std::pair<iterator, bool> try_emplace(key_type const& key, Args&&... args)
+            {
+                auto source = make_leaf_source<leaf_type, std::false_type>(key, std::forward_as_tuple(std::forward<Args>(args)...));
+                return insert_impl(source);
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            template <typename M>
+            std::pair<iterator, bool> insert_or_assign(key_type const& key, M&& obj)
+            {
+                auto source = make_leaf_source<leaf_type, std::true_type>(key, std::forward_as_tuple(std::forward<M>(obj)));
+                return insert_impl(source);
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            iterator find(key_type const& key)
+            {
+                return find_impl(this, key);
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            const_iterator find(key_type const& key) const
+            {
+                return find_impl(this, key);
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            size_type erase(key_type const& key)
+            {
+                if (fNode) {
+                    size_type result;
+                    std::tie(fNode, result) = wide_erase(fNode, key, true, fAllocator);
+                    fSize -= result;
+                    return result;
+                }
+                return 0;
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            iterator begin()
+            {
+                return iterator(fNode.get());
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            const_iterator begin() const
+            {
+                return const_iterator(fNode.get());
+            }
+
+            /// `O(sizeof(Key) / Bits)`
+            const_iterator cbegin() const
+            {
+                return const_iterator(fNode.get());
+            }
+
+            /// `O(1)`
+            iterator end()
+            {
+                return iterator();
+            }
+
+            /// `O(1)`
+            const_iterator end() const
+            {
+                return const_iterator();
+            }
+
+            /// `O(1)`
+            const_iterator cend() const
+            {
+                return const_iterator();
+            }
+
+            /// `O(n)`
+            template <typename Function>
+            Function for_each(Function f) const
+            {
+                if (fNode) {
+                    wide_for_each_value(fNode.get(), f);
+                }
+                return f;
+            }
+
+            /// `O(n)`
+            void clear()
+            {
+                fNode = nullptr;
+                fSize = 0;
+            }
+
+            /// `O(1)`
+            bool empty() const
+            {
+                return !fNode;
+            }
+
+            /// `O(1)`
+            size_type size() const
+            {
+                return fSize;
+            }
+
+          private:
+            template <typename Source>
+            std::pair<iterator, bool> insert_impl(Source& source)
+            {
+                if (fNode) {
+                    value_type* i;
+                    bool inserted;
+                    std::tie(fNode, i, inserted) = wide_insert(fNode, source, true, fAllocator);
+                    if (inserted) {
+                        ++fSize;
+                    }
+                    return std::make_pair(iterator(fNode.get(), i), inserted);
+                }
+                auto leaf = source.make(fAllocator);
+                auto i = &leaf->get();
+                fNode = std::move(leaf);
+                fSize = 1;
+                return std::make_pair(iterator(fNode.get(), i), true);
+            }
+
+            template <typename This>
+            static typename find_result<This>::type find_impl(This aThis, key_type const& aKey)
+            {
+                typedef typename find_result<This>::type result_type;
+                if (!aThis->fNode) {
+                    return result_type();
+                }
+                if (auto leaf = wide_find_leaf(aThis->fNode.get(), aKey)) {
+                    return result_type(aThis->fNode.get(), &leaf->get());
+                }
+                return result_type();
+            }
+
+            /// Declared before `fNode` so that it is destroyed after it.
+            allocator_type fAllocator;
+            intrusive_shared_ptr<node_type> fNode;
+            size_type fSize;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,99 @@
+// Copyright 2015 The MathWorks, Inc.
+#ifndef _eml_general_bench_Benchmark_hpp
+#define _eml_general_bench_Benchmark_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace EML
+{
+    namespace benchmark
+    {
+        /// Call `f`, which performs `count` operations, `runs` times and
+        /// return the fastest time per operation in nanoseconds.  The
+        /// fastest run is the one least disturbed by the rest of the
+        /// machine.
+        template <typename Function>
+        double nanoseconds_per(std::size_t count, Function f, int runs = 5)
+        {
+            double best = 0;
+            for (int run = 0; run != runs; ++run) {
+                auto start = std::chrono::steady_clock::now();
+                f();
+                auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                if (run == 0 || elapsed < best) {
+                    best = elapsed;
+                }
+            }
+            return best / count;
+        }
+
+        /// Like `nanoseconds_per(count, f, runs)`, but call `setup` before
+        /// each run without timing it.
+        template <typename Setup, typename Function>
+        double nanoseconds_per(std::size_t count, Setup setup, Function f, int runs = 5)
+        {
+            double best = 0;
+            for (int run = 0; run != runs; ++run) {
+                setup();
+                auto start = std::chrono::steady_clock::now();
+                f();
+                auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                if (run == 0 || elapsed < best) {
+                    best = elapsed;
+                }
+            }
+            return best / count;
+        }
+
+        /// Keep the computation of `value` from being optimized away.  The
+        /// address escapes into an empty `asm` statement that the compiler
+        /// must assume reads it.
+        template <typename T>
+        void keep(T const& value)
+        {
+#if defined(__GNUC__)
+            __asm__ __volatile__("" : : "r"(&value) : "memory");
+#else
+            static void const* volatile sink;
+            sink = &value;
+            _ReadWriteBarrier();
+            (void)sink;
+#endif
+        }
+
+        inline void report(char const* name, double nanoseconds)
+        {
+            std::printf("%-32s %9.1f ns\n", name, nanoseconds);
+        }
+
+        /// `count` distinct random keys, in random order.
+        inline std::vector<std::uint32_t> random_keys(std::size_t count, std::uint32_t seed = 1)
+        {
+            std::mt19937 random(seed);
+            std::vector<std::uint32_t> result;
+            result.reserve(count + count / 8);
+            while (result.size() < count) {
+                while (result.size() < count + count / 8) {
+                    result.push_back(random());
+                }
+                std::sort(result.begin(), result.end());
+                result.erase(std::unique(result.begin(), result.end()), result.end());
+            }
+            std::shuffle(result.begin(), result.end(), random);
+            result.resize(count);
+            return result;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,100 @@
+// Copyright 2015 The MathWorks, Inc.
+// Latency of find hits and misses on pointer keys, walking the tree in a
+// loop as find does and recursing through each node as it used to.  Build
+// and run with and without prefetching:
+//   g++ -std=c++11 -O2 -I.. FindBenchmark.cpp && ./a.out
+//   g++ -std=c++11 -O2 -DEML_SHARED_RADIX_TREE_PREFETCH -I.. FindBenchmark.cpp && ./a.out
+// Each lookup depends on the last, so that lookups are timed one at a
+// time rather than overlapped by the processor.
+#include "Benchmark.hpp"
+#include "SharedRadixTree.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+	typedef EML::SharedRadixTree<int const*, int> tree_type;
+	typedef EML::shared_radix_tree_detail::tree_access tree_access;
+	typedef tree_access::node_of<tree_type>::type node_type;
+	typedef node_type::branch_type branch_type;
+	typedef node_type::leaf_type leaf_type;
+	typedef node_type::prefix_type prefix_type;
+
+	leaf_type const* find_node(node_type const* node, int const* key);
+
+	/// `find` as it was before it walked the tree in a loop, recursing
+	/// from each `branch` to the child that may hold `key`.
+	leaf_type const* find_branch(branch_type const* branch, int const* key)
+	{
+		if (EML::shared_radix_tree_detail::not_mem(key, branch->prefix(), branch->mask())) {
+			return nullptr;
+		}
+		if (EML::shared_radix_tree_detail::left(static_cast<prefix_type>(key), branch->mask())) {
+			return find_node(branch->left_child().get(), key);
+		}
+		return find_node(branch->right_child().get(), key);
+	}
+
+	leaf_type const* find_node(node_type const* node, int const* key)
+	{
+		if (node->is_leaf()) {
+			auto leaf = static_cast<leaf_type const*>(node);
+			return leaf->get().first == key ? leaf : nullptr;
+		}
+		return find_branch(static_cast<branch_type const*>(node), key);
+	}
+
+	/// Look up `keys` in turn, starting each lookup only once the last
+	/// one is done.
+	template <typename Find>
+	double chase(std::vector<int const*> const& keys, Find find)
+	{
+		return EML::benchmark::nanoseconds_per(keys.size(), [&] {
+			std::size_t found = 0;
+			for (std::size_t i = 0; i != keys.size(); ++i) {
+				// The next key depends on whether the last was found, so
+				// each lookup waits for the one before it.
+				found = find(keys[i ^ found]) ? 1 : 0;
+			}
+			EML::benchmark::keep(found);
+		});
+	}
+
+	void run(std::size_t count)
+	{
+		std::unique_ptr<int[]> values(new int[2 * count]);
+		std::vector<int const*> keys;
+		for (std::size_t i = 0; i != 2 * count; ++i) {
+			keys.push_back(&values[i]);
+		}
+		std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+		std::vector<int const*> hits(keys.begin(), keys.begin() + count);
+		std::vector<int const*> misses(keys.begin() + count, keys.end());
+		tree_type tree;
+		for (auto key : hits) {
+			tree.insert(std::make_pair(key, 0));
+		}
+		auto root = tree_access::root(tree).get();
+
+		std::printf("%zu keys\n", count);
+		EML::benchmark::report("  loop hit", chase(hits, [&](int const* key) { return tree.find(key) != tree.end(); }));
+		EML::benchmark::report("  loop miss", chase(misses, [&](int const* key) { return tree.find(key) != tree.end(); }));
+		EML::benchmark::report("  recursive hit", chase(hits, [&](int const* key) { return find_node(root, key) != nullptr; }));
+		EML::benchmark::report("  recursive miss", chase(misses, [&](int const* key) { return find_node(root, key) != nullptr; }));
+	}
+}
+
+int main()
+{
+#if defined(EML_SHARED_RADIX_TREE_PREFETCH)
+	std::printf("with EML_SHARED_RADIX_TREE_PREFETCH\n");
+#else
+	std::printf("without EML_SHARED_RADIX_TREE_PREFETCH\n");
+#endif
+	run(1 << 12);
+	run(1 << 20);
+}
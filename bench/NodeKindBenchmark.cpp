@@ -0,0 +1,85 @@
+// Copyright 2015 The MathWorks, Inc.
+// Nodes tagged by a kind byte against the original nodes dispatching
+// through a vtable.  Build and run with
+//   g++ -std=c++11 -O2 -I.. NodeKindBenchmark.cpp && ./a.out
+// Both trees use the default single_threaded use counts.  Built against
+// the revision that introduced the kind byte, this isolates it; later
+// revisions also change how the tree is walked.
+#include "Benchmark.hpp"
+#include "SharedRadixTree.hpp"
+#include "VirtualSharedRadixTree.hpp"
+
+#include <cstdio>
+
+namespace
+{
+	std::size_t const count = 1 << 20;
+
+	template <typename Tree>
+	void run(char const* layout)
+	{
+		auto keys = EML::benchmark::random_keys(count);
+		auto misses = EML::benchmark::random_keys(count, 2);
+		std::printf("%s\n", layout);
+		Tree tree;
+		for (auto key : keys) {
+			tree.insert(std::make_pair(key, key));
+		}
+
+		EML::benchmark::report("  find hit", EML::benchmark::nanoseconds_per(count, [&] {
+			std::uint32_t sum = 0;
+			for (auto key : keys) {
+				sum += tree.find(key)->second;
+			}
+			EML::benchmark::keep(sum);
+		}));
+
+		EML::benchmark::report("  find miss", EML::benchmark::nanoseconds_per(count, [&] {
+			std::size_t found = 0;
+			for (auto key : misses) {
+				found += tree.find(key) != tree.end();
+			}
+			EML::benchmark::keep(found);
+		}));
+
+		Tree unique;
+		EML::benchmark::report("  insert unique", EML::benchmark::nanoseconds_per(count, [&] {
+			unique = Tree();
+		}, [&] {
+			for (auto key : keys) {
+				unique.insert(std::make_pair(key, key));
+			}
+		}, 3));
+
+		EML::benchmark::report("  erase unique", EML::benchmark::nanoseconds_per(count, [&] {
+			unique = Tree();
+			for (auto key : keys) {
+				unique.insert(std::make_pair(key, key));
+			}
+		}, [&] {
+			for (auto key : keys) {
+				unique.erase(key);
+			}
+		}, 3));
+
+		EML::benchmark::report("  insert shared", EML::benchmark::nanoseconds_per(count, [&] {
+			for (auto key : misses) {
+				Tree snapshot = tree;
+				snapshot.insert(std::make_pair(key, key));
+			}
+		}));
+
+		EML::benchmark::report("  erase shared", EML::benchmark::nanoseconds_per(count, [&] {
+			for (auto key : keys) {
+				Tree snapshot = tree;
+				snapshot.erase(key);
+			}
+		}));
+	}
+}
+
+int main()
+{
+	run<EML::VirtualSharedRadixTree<std::uint32_t, std::uint32_t>>("vtable");
+	run<EML::SharedRadixTree<std::uint32_t, std::uint32_t>>("kind byte");
+}
@@ -0,0 +1,98 @@
+// Copyright 2015 The MathWorks, Inc.
+// Cost of atomic use counts.  Build and run with
+//   g++ -std=c++11 -O2 -I.. RefCountBenchmark.cpp && ./a.out
+// Only updates to shared trees, which copy a path and retain the siblings
+// along it, copies, and teardown touch use counts; lookups do not.
+#include "Benchmark.hpp"
+#include "SharedRadixTree.hpp"
+
+#include <cstdio>
+
+namespace
+{
+	std::size_t const count = 1 << 20;
+
+	template <typename RefCount>
+	void run(char const* policy)
+	{
+		typedef EML::SharedRadixTree<
+			std::uint32_t,
+			std::uint32_t,
+			EML::shared_radix_tree_detail::default_prefix<std::uint32_t>::type,
+			EML::shared_radix_tree_detail::default_mask<std::uint32_t>::type,
+			RefCount> tree_type;
+
+		auto keys = EML::benchmark::random_keys(count);
+		auto others = EML::benchmark::random_keys(count, 2);
+		std::printf("%s\n", policy);
+		tree_type tree;
+		for (auto key : keys) {
+			tree.insert(std::make_pair(key, key));
+		}
+
+		EML::benchmark::report("  find", EML::benchmark::nanoseconds_per(count, [&] {
+			std::uint32_t sum = 0;
+			for (auto key : keys) {
+				sum += tree.find(key)->second;
+			}
+			EML::benchmark::keep(sum);
+		}));
+
+		EML::benchmark::report("  copy and release", EML::benchmark::nanoseconds_per(count, [&] {
+			for (std::size_t i = 0; i != count; ++i) {
+				tree_type copy = tree;
+				EML::benchmark::keep(copy);
+			}
+		}));
+
+		// Nothing else holds the nodes, so every update is in place.
+		tree_type unique;
+		EML::benchmark::report("  insert unique", EML::benchmark::nanoseconds_per(count, [&] {
+			unique = tree_type();
+		}, [&] {
+			for (auto key : keys) {
+				unique.insert(std::make_pair(key, key));
+			}
+		}, 3));
+
+		EML::benchmark::report("  erase unique", EML::benchmark::nanoseconds_per(count, [&] {
+			unique = tree_type();
+			for (auto key : keys) {
+				unique.insert(std::make_pair(key, key));
+			}
+		}, [&] {
+			for (auto key : keys) {
+				unique.erase(key);
+			}
+		}, 3));
+
+		// Every update follows a copy, so each copies the path to its key
+		// and retains the siblings along it.
+		EML::benchmark::report("  insert shared", EML::benchmark::nanoseconds_per(count, [&] {
+			for (auto key : others) {
+				tree_type snapshot = tree;
+				snapshot.insert(std::make_pair(key, key));
+			}
+		}));
+
+		EML::benchmark::report("  erase shared", EML::benchmark::nanoseconds_per(count, [&] {
+			for (auto key : keys) {
+				tree_type snapshot = tree;
+				snapshot.erase(key);
+			}
+		}));
+
+		EML::benchmark::report("  build and release", EML::benchmark::nanoseconds_per(count, [&] {
+			tree_type built;
+			for (auto key : keys) {
+				built.insert(std::make_pair(key, key));
+			}
+		}, 3));
+	}
+}
+
+int main()
+{
+	run<EML::single_threaded>("single_threaded");
+	run<EML::multi_threaded>("multi_threaded");
+}
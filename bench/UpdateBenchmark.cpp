@@ -0,0 +1,81 @@
+// Copyright 2015 The MathWorks, Inc.
+// Cost of insert and erase along unique and shared paths.  Build and run
+// with
+//   g++ -std=c++11 -O2 -I.. UpdateBenchmark.cpp && ./a.out
+// Only insert, insert_or_assign, and erase are used, so the same harness
+// builds against earlier revisions of the header for comparison.
+#include "Benchmark.hpp"
+#include "SharedRadixTree.hpp"
+
+#include <cstdio>
+
+namespace
+{
+	std::size_t const count = 1 << 20;
+
+	typedef EML::SharedRadixTree<std::uint32_t, std::uint32_t> tree_type;
+
+	tree_type build(std::vector<std::uint32_t> const& keys)
+	{
+		tree_type result;
+		for (auto key : keys) {
+			result.insert(std::make_pair(key, key));
+		}
+		return result;
+	}
+}
+
+int main()
+{
+	auto keys = EML::benchmark::random_keys(count);
+	auto others = EML::benchmark::random_keys(count, 2);
+	auto tree = build(keys);
+
+	// Nothing else holds the nodes, so every update is in place.
+	tree_type unique;
+	EML::benchmark::report("insert fresh", EML::benchmark::nanoseconds_per(count, [&] {
+		unique = tree_type();
+	}, [&] {
+		for (auto key : keys) {
+			unique.insert(std::make_pair(key, key));
+		}
+	}, 3));
+
+	EML::benchmark::report("assign unique", EML::benchmark::nanoseconds_per(count, [&] {
+		std::uint32_t value = 0;
+		for (auto key : keys) {
+			unique.insert_or_assign(key, ++value);
+		}
+	}, 3));
+
+	// Every update follows a copy, so each copies the path to its key,
+	// and the copy is released before the next one.
+	EML::benchmark::report("assign shared", EML::benchmark::nanoseconds_per(count, [&] {
+		for (auto key : keys) {
+			tree_type snapshot = tree;
+			snapshot.insert_or_assign(key, key + 1);
+		}
+	}, 3));
+
+	EML::benchmark::report("insert shared", EML::benchmark::nanoseconds_per(count, [&] {
+		for (auto key : others) {
+			tree_type snapshot = tree;
+			snapshot.insert(std::make_pair(key, key));
+		}
+	}, 3));
+
+	EML::benchmark::report("erase shared", EML::benchmark::nanoseconds_per(count, [&] {
+		for (auto key : keys) {
+			tree_type snapshot = tree;
+			snapshot.erase(key);
+		}
+	}, 3));
+
+	EML::benchmark::report("erase unique", EML::benchmark::nanoseconds_per(count, [&] {
+		unique = build(keys);
+	}, [&] {
+		for (auto key : keys) {
+			unique.erase(key);
+		}
+	}, 3));
+}
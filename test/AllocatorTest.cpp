@@ -0,0 +1,178 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -pthread -I.. AllocatorTest.cpp && ./a.out
+// and preferably again with -fsanitize=address.
+#include "SharedRadixTree.hpp"
+
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace
+{
+	typedef EML::SharedRadixTree<
+		int,
+		std::string,
+		EML::shared_radix_tree_detail::default_prefix<int>::type,
+		EML::shared_radix_tree_detail::default_mask<int>::type,
+		EML::single_threaded,
+		EML::arena_allocator
+		> arena_tree;
+
+	typedef EML::SharedRadixTree<
+		int,
+		std::string,
+		EML::shared_radix_tree_detail::default_prefix<int>::type,
+		EML::shared_radix_tree_detail::default_mask<int>::type,
+		EML::single_threaded,
+		EML::pool_allocator
+		> pool_tree;
+
+	typedef EML::SharedRadixTree<
+		int,
+		int,
+		EML::shared_radix_tree_detail::default_prefix<int>::type,
+		EML::shared_radix_tree_detail::default_mask<int>::type,
+		EML::multi_threaded,
+		EML::pool_allocator
+		> concurrent_pool_tree;
+
+	arena_tree make_arena_tree(int first, int last)
+	{
+		arena_tree result;
+		for (int i = first; i < last; ++i) {
+			result.insert(std::make_pair(i, std::to_string(i)));
+		}
+		return result;
+	}
+
+	void check(arena_tree const& tree, int first, int last)
+	{
+		assert(tree.size() == static_cast<arena_tree::size_type>(last - first));
+		for (int i = first; i < last; ++i) {
+			auto found = tree.find(i);
+			assert(found != tree.end() && found->second == std::to_string(i));
+		}
+	}
+
+	/// Set operations with an operand from another arena must not keep its
+	/// nodes, which are freed with that arena.
+	void test_foreign_arena()
+	{
+		auto first = [](std::string const& mine, std::string const&) { return mine; };
+		{
+			auto tree = make_arena_tree(0, 100);
+			tree.merge_with(make_arena_tree(50, 150), first);
+			check(tree, 0, 150);
+		}
+		{
+			arena_tree tree;
+			tree.join(make_arena_tree(0, 100));
+			check(tree, 0, 100);
+		}
+		{
+			auto tree = make_arena_tree(0, 100);
+			tree.intersect_with(make_arena_tree(50, 150), first);
+			check(tree, 50, 100);
+		}
+		{
+			auto tree = make_arena_tree(0, 100);
+			tree.difference(make_arena_tree(50, 150));
+			check(tree, 0, 50);
+		}
+		{
+			// Copies of one tree share its arena, so nothing is copied.
+			auto tree = make_arena_tree(0, 100);
+			auto copy = tree;
+			copy.insert(std::make_pair(100, std::string("100")));
+			tree.merge_with(copy, first);
+			check(tree, 0, 101);
+		}
+	}
+
+	/// A `thread_local` tree constructed before the thread's pool is
+	/// destroyed after it, releasing its nodes at thread exit.
+	void test_pool_thread_exit()
+	{
+		std::thread([] {
+			static thread_local pool_tree tree;
+			for (int i = 0; i < 1000; ++i) {
+				tree.insert(std::make_pair(i, std::to_string(i)));
+			}
+		}).join();
+		pool_tree tree;
+		for (int i = 0; i < 1000; ++i) {
+			tree.insert(std::make_pair(i, std::to_string(i)));
+		}
+		assert(tree.size() == 1000);
+	}
+
+	/// A writer publishes versions that a reader drops, so every node the
+	/// writer allocates is freed on the reader's thread.  The reader must
+	/// hand those nodes back rather than keep them all, or the writer
+	/// carves new chunks forever.
+	void test_pool_producer_consumer()
+	{
+		static const int rounds = 40;
+		static const int versions = 10000;
+		static const std::size_t capacity = 64;
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::deque<concurrent_pool_tree> queue;
+		bool done = false;
+
+		std::thread reader([&] {
+			std::unique_lock<std::mutex> lock(mutex);
+			for (;;) {
+				changed.wait(lock, [&] { return done || !queue.empty(); });
+				if (queue.empty()) {
+					return;
+				}
+				auto version = std::move(queue.front());
+				queue.pop_front();
+				changed.notify_all();
+				lock.unlock();
+				assert(version.size() == 1000);
+				version = concurrent_pool_tree();
+				lock.lock();
+			}
+		});
+
+		concurrent_pool_tree tree;
+		for (int i = 0; i < 1000; ++i) {
+			tree.insert(std::make_pair(i, i));
+		}
+		std::size_t warm = 0;
+		for (int round = 0; round < rounds; ++round) {
+			for (int i = 0; i < versions; ++i) {
+				tree.insert_or_assign(i % 1000, round);
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&] { return queue.size() < capacity; });
+				queue.push_back(tree);
+				changed.notify_all();
+			}
+			if (round == 4) {
+				warm = EML::pool_allocator::reserved();
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+			changed.notify_all();
+		}
+		reader.join();
+		assert(EML::pool_allocator::reserved() <= 2 * warm);
+	}
+}
+
+int main()
+{
+	test_foreign_arena();
+	test_pool_thread_exit();
+	test_pool_producer_consumer();
+	std::cout << "ok" << std::endl;
+}
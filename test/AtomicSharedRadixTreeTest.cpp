@@ -0,0 +1,148 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -pthread -I.. AtomicSharedRadixTreeTest.cpp && ./a.out
+// and preferably again with -fsanitize=address and -fsanitize=thread.
+#include "AtomicSharedRadixTree.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	std::atomic<int> live(0);
+
+	/// A mapped value counting its live instances, so that a leaked or
+	/// doubly released node shows up at the end of a test.
+	struct counted_value
+	{
+		counted_value(int value)
+			: fValue(value)
+		{
+			++live;
+		}
+
+		counted_value(counted_value const& rhs)
+			: fValue(rhs.fValue)
+		{
+			++live;
+		}
+
+		counted_value& operator=(counted_value const&) = default;
+
+		~counted_value()
+		{
+			--live;
+		}
+
+		int fValue;
+	};
+
+	typedef EML::ConcurrentSharedRadixTree<int, counted_value> tree_type;
+
+	/// Readers load while the writer republishes the same root, through a
+	/// no-op `update` and through `store` of an older version.  A load that
+	/// mistook a republished root for the one it claimed would leak a use.
+	void test_republish_same_root()
+	{
+		for (int run = 0; run < 40; ++run) {
+			{
+				tree_type initial;
+				initial.insert(std::make_pair(1, counted_value(2)));
+				EML::atomic_shared_radix_tree<tree_type> cell(initial);
+				std::atomic<bool> done(false);
+				std::vector<std::thread> readers;
+				for (int i = 0; i < 4; ++i) {
+					readers.emplace_back([&] {
+						while (!done.load()) {
+							auto tree = cell.load();
+							assert(tree.find(1) != tree.end());
+						}
+					});
+				}
+				for (int i = 0; i < 2000; ++i) {
+					cell.update([](tree_type& tree) {
+						tree.insert(std::make_pair(1, counted_value(3)));
+					});
+					if (i % 10 == 0) {
+						auto old = cell.load();
+						cell.update([&](tree_type& tree) {
+							tree.insert_or_assign(i, counted_value(i));
+						});
+						cell.store(old);
+					}
+				}
+				done = true;
+				for (auto& reader : readers) {
+					reader.join();
+				}
+				cell.reclaim();
+			}
+			assert(live == 0);
+		}
+	}
+
+	/// Readers load and borrow while writers publish new versions; every
+	/// version a reader sees must be internally consistent.
+	void test_readers_and_writers()
+	{
+		{
+			EML::atomic_shared_radix_tree<tree_type> cell;
+			std::atomic<bool> done(false);
+			std::vector<std::thread> threads;
+			for (int i = 0; i < 4; ++i) {
+				threads.emplace_back([&, i] {
+					while (!done.load()) {
+						if (i % 2 == 0) {
+							auto tree = cell.load();
+							int count = 0;
+							for (auto& value : tree) {
+								assert(value.first == value.second.fValue);
+								++count;
+							}
+							assert(count == tree.size());
+						} else {
+							auto borrowed = cell.borrow();
+							for (auto& value : borrowed) {
+								assert(value.first == value.second.fValue);
+							}
+						}
+					}
+				});
+			}
+			std::vector<std::thread> writers;
+			for (int w = 0; w < 2; ++w) {
+				writers.emplace_back([&, w] {
+					for (int i = 0; i < 5000; ++i) {
+						auto key = (i * 2 + w) % 512;
+						cell.update([&](tree_type& tree) {
+							if (tree.find(key) != tree.end()) {
+								tree.erase(key);
+							} else {
+								tree.insert(std::make_pair(key, counted_value(key)));
+							}
+						});
+					}
+				});
+			}
+			for (auto& writer : writers) {
+				writer.join();
+			}
+			done = true;
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			cell.reclaim();
+		}
+		assert(live == 0);
+	}
+}
+
+int main()
+{
+	test_republish_same_root();
+	test_readers_and_writers();
+	std::cout << "ok" << std::endl;
+}
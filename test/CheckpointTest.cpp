@@ -0,0 +1,148 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -I.. CheckpointTest.cpp && ./a.out
+// and preferably again with -fsanitize=address.
+#include "SerializedSharedRadixTree.hpp"
+#include "TestSupport.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	typedef EML::SharedRadixTree<std::uint32_t, int> tree_type;
+	typedef test_support::reference_of<tree_type> reference_type;
+	using test_support::derive;
+
+	std::size_t nodes(tree_type const& tree)
+	{
+		auto stats = tree.stats();
+		return stats.fBranches + stats.fLeaves;
+	}
+
+	bool throws(EML::checkpoint_reader<tree_type>& reader, std::vector<char> const& checkpoint)
+	{
+		try {
+			reader.read(checkpoint.data(), checkpoint.size());
+		} catch (std::invalid_argument const&) {
+			return true;
+		}
+		return false;
+	}
+
+	/// Every version is read back as it was written, with the nodes of
+	/// consecutive versions shared again, and checkpoints of versions
+	/// differing in a few keys hold little more than their paths.
+	void test_versions()
+	{
+		std::mt19937 random(61);
+		EML::checkpoint_writer<tree_type> writer;
+		EML::checkpoint_reader<tree_type> reader;
+		auto version = derive(std::make_pair(tree_type(), reference_type()), random, 2000, 1 << 16);
+		auto full = writer.write(version.first);
+		auto previous = reader.read(full.data(), full.size());
+		assert(reference_type(previous.begin(), previous.end()) == version.second);
+		for (int i = 0; i < 100; ++i) {
+			auto next = derive(version, random, static_cast<int>(random() % 4), 1 << 16);
+			auto checkpoint = writer.write(next.first);
+			assert(checkpoint.size() * 10 < full.size());
+			auto read = reader.read(checkpoint.data(), checkpoint.size());
+			assert(read.size() == static_cast<tree_type::size_type>(next.second.size()));
+			assert(reference_type(read.begin(), read.end()) == next.second);
+			assert(reader.nodes() == nodes(next.first) && writer.nodes() == reader.nodes());
+
+			// Only the changed keys differ between the versions read.
+			std::size_t differences = 0;
+			auto note = [&](std::pair<std::uint32_t const, int> const&) { ++differences; };
+			EML::diff(previous, read, note, note, [&](std::pair<std::uint32_t const, int> const&, std::pair<std::uint32_t const, int> const&) { ++differences; });
+			assert(differences <= 3);
+			assert(previous.stats().fSharedBytes > 0);
+			previous = read;
+			version = next;
+		}
+
+		// An unchanged version is only a header.
+		auto unchanged = writer.write(version.first);
+		assert(unchanged.size() == sizeof(EML::shared_radix_tree_detail::checkpoint_header));
+		auto read = reader.read(unchanged.data(), unchanged.size());
+		assert(reference_type(read.begin(), read.end()) == version.second);
+
+		auto empty = writer.write(tree_type());
+		assert(reader.read(empty.data(), empty.size()).empty());
+		assert(reader.nodes() == 0 && writer.nodes() == 0);
+	}
+
+	/// After `reset`, the writer starts a new log that a new reader can
+	/// follow, as can a reader of the old log.
+	void test_reset()
+	{
+		std::mt19937 random(67);
+		EML::checkpoint_writer<tree_type> writer;
+		EML::checkpoint_reader<tree_type> reader;
+		auto version = derive(std::make_pair(tree_type(), reference_type()), random, 500, 1 << 12);
+		auto first = writer.write(version.first);
+		reader.read(first.data(), first.size());
+		version = derive(version, random, 10, 1 << 12);
+		writer.write(version.first);
+
+		writer.reset();
+		auto base = writer.write(version.first);
+		assert(base.size() >= first.size() / 2);
+		EML::checkpoint_reader<tree_type> newReader;
+		auto read = newReader.read(base.data(), base.size());
+		assert(reference_type(read.begin(), read.end()) == version.second);
+		read = reader.read(base.data(), base.size());
+		assert(reference_type(read.begin(), read.end()) == version.second);
+
+		version = derive(version, random, 10, 1 << 12);
+		auto next = writer.write(version.first);
+		read = newReader.read(next.data(), next.size());
+		assert(reference_type(read.begin(), read.end()) == version.second);
+	}
+
+	/// A checkpoint that is truncated, of another tree type, or out of
+	/// order is rejected, and the reader keeps the version it had.
+	void test_errors()
+	{
+		std::mt19937 random(71);
+		EML::checkpoint_writer<tree_type> writer;
+		EML::checkpoint_reader<tree_type> reader;
+		auto version = derive(std::make_pair(tree_type(), reference_type()), random, 200, 1 << 12);
+		auto first = writer.write(version.first);
+		reader.read(first.data(), first.size());
+		auto next = derive(version, random, 5, 1 << 12);
+		auto second = writer.write(next.first);
+
+		for (std::size_t size = 0; size < second.size(); size += 7) {
+			assert(throws(reader, std::vector<char>(second.begin(), second.begin() + size)));
+		}
+
+		EML::checkpoint_writer<EML::SharedRadixTree<std::uint64_t, int>> otherWriter;
+		EML::SharedRadixTree<std::uint64_t, int> other;
+		other.insert(std::make_pair(static_cast<std::uint64_t>(1), 1));
+		assert(throws(reader, otherWriter.write(other)));
+
+		// A checkpoint depending on one the reader never saw.
+		EML::checkpoint_reader<tree_type> fresh;
+		assert(throws(fresh, second));
+		assert(fresh.nodes() == 0);
+
+		assert(reader.nodes() == nodes(version.first));
+		auto read = reader.read(second.data(), second.size());
+		assert(reference_type(read.begin(), read.end()) == next.second);
+	}
+}
+
+int main()
+{
+	test_versions();
+	test_reset();
+	test_errors();
+	std::cout << "ok" << std::endl;
+}
@@ -0,0 +1,116 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -I.. CompactSharedRadixTreeTest.cpp && ./a.out
+// and preferably again with -fsanitize=address.
+#include "CompactSharedRadixTree.hpp"
+#include "TestSupport.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	template <typename Key>
+	using tree_type = EML::SharedRadixTree<
+		Key,
+		int,
+		typename EML::shared_radix_tree_detail::default_prefix<Key>::type,
+		typename EML::shared_radix_tree_detail::default_mask<Key>::type,
+		EML::single_threaded,
+		EML::new_allocator,
+		EML::uncounted,
+		EML::compact_nodes>;
+
+	/// Versions copied from one another share one arena, and those kept
+	/// from earlier runs stay intact as later ones are updated.
+	template <typename Key>
+	void test_copies(std::uint64_t range)
+	{
+		typedef tree_type<Key> tree;
+		typedef test_support::reference_of<tree> reference_type;
+		std::mt19937 random(31);
+		std::vector<tree> versions;
+		std::vector<reference_type> references;
+		int run = 0;
+		test_support::random_updates<tree>(random, range, 100, [&](tree const& version, reference_type const& reference) {
+			if (run++ % 10 == 0) {
+				versions.push_back(version);
+				references.push_back(reference);
+			}
+		});
+		for (std::size_t i = 0; i != versions.size(); ++i) {
+			assert(reference_type(versions[i].begin(), versions[i].end()) == references[i]);
+			assert(versions[i].arena_bytes() == versions.back().arena_bytes());
+		}
+	}
+
+	/// The arena reuses the storage of freed nodes, so filling and
+	/// emptying a tree again holds no more slabs than the first time.
+	void test_reuse()
+	{
+		typedef tree_type<std::uint32_t> tree;
+		tree version;
+		assert(version.arena_bytes() == 0);
+		std::mt19937 random(37);
+		std::size_t bytes = 0;
+		for (int run = 0; run < 10; ++run) {
+			std::vector<std::uint32_t> keys;
+			for (int i = 0; i < 5000; ++i) {
+				keys.push_back(static_cast<std::uint32_t>(random()));
+				version.insert(std::make_pair(keys.back(), i));
+			}
+			if (run == 0) {
+				bytes = version.arena_bytes();
+				assert(bytes > 0);
+			}
+			assert(version.arena_bytes() == bytes);
+			for (auto key : keys) {
+				version.erase(key);
+			}
+			assert(version.empty() && version.arena_bytes() == bytes);
+		}
+
+		// A copy updated in place of its original takes only its paths.
+		for (std::uint32_t key = 0; key < 1000; ++key) {
+			version.insert(std::make_pair(key, 0));
+		}
+		auto copy = version;
+		copy.insert_or_assign(0u, 1);
+		assert(copy.arena_bytes() == bytes && version.find(0u)->second == 0);
+	}
+
+	/// A tree moved from is empty and uses no arena, and swapping trees
+	/// swaps their contents.
+	void test_move()
+	{
+		typedef tree_type<std::uint32_t> tree;
+		tree first;
+		for (std::uint32_t key = 0; key < 100; ++key) {
+			first.insert(std::make_pair(key, static_cast<int>(key)));
+		}
+		tree second(std::move(first));
+		assert(first.empty() && first.size() == 0 && first.begin() == first.end());
+		assert(second.size() == 100 && second.find(99u)->second == 99);
+
+		first.insert(std::make_pair(7u, 7));
+		first.swap(second);
+		assert(first.size() == 100 && second.size() == 1 && second.find(7u)->second == 7);
+		second = first;
+		assert(second.size() == 100 && second.arena_bytes() == first.arena_bytes());
+	}
+}
+
+int main()
+{
+	test_copies<std::uint32_t>(1 << 12);
+	test_copies<std::uint32_t>(0xffffffffu);
+	test_copies<std::uint64_t>(1 << 20);
+	test_copies<std::uint16_t>(1 << 16);
+	test_reuse();
+	test_move();
+	std::cout << "ok" << std::endl;
+}
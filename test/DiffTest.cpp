@@ -0,0 +1,130 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -I.. DiffTest.cpp && ./a.out
+// and preferably again with -fsanitize=address.
+#include "SharedRadixTree.hpp"
+#include "TestSupport.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	typedef EML::SharedRadixTree<std::uint32_t, int> tree_type;
+	typedef test_support::reference_of<tree_type> reference_type;
+	using test_support::derive;
+	typedef std::pair<std::uint32_t const, int> value_type;
+
+	struct changes
+	{
+		std::vector<std::uint32_t> fAdded;
+		std::vector<std::uint32_t> fRemoved;
+		std::vector<std::pair<int, int>> fChanged;
+		std::vector<std::uint32_t> fChangedKeys;
+	};
+
+	changes diff(tree_type const& before, tree_type const& after)
+	{
+		changes result;
+		EML::diff(before,
+		          after,
+		          [&](value_type const& value) { result.fAdded.push_back(value.first); },
+		          [&](value_type const& value) { result.fRemoved.push_back(value.first); },
+		          [&](value_type const& value1, value_type const& value2) {
+		              assert(value1.first == value2.first);
+		              result.fChangedKeys.push_back(value1.first);
+		              result.fChanged.push_back(std::make_pair(value1.second, value2.second));
+		          });
+		return result;
+	}
+
+	/// Every added and removed key is reported once, in key order.  Keys
+	/// in both versions are reported as changed if their values differ,
+	/// and may be if they only have different `leaf` nodes.
+	void test_diff()
+	{
+		std::mt19937 random(13);
+		for (int run = 0; run < 300; ++run) {
+			auto range = static_cast<std::uint32_t>(1) << (random() % 20 + 1);
+			// With few values, a key erased and inserted again often gets
+			// its old value in a new `leaf`.
+			auto before = derive(std::make_pair(tree_type(), reference_type()), random, static_cast<int>(random() % 300), range, 4);
+			auto after = run % 4 == 0 ? derive(std::make_pair(tree_type(), reference_type()), random, static_cast<int>(random() % 300), range, 4)
+			                          : derive(before, random, static_cast<int>(random() % 20), range, 4);
+
+			std::vector<std::uint32_t> added;
+			std::vector<std::uint32_t> removed;
+			std::vector<std::uint32_t> differing;
+			for (auto& value : after.second) {
+				auto found = before.second.find(value.first);
+				if (found == before.second.end()) {
+					added.push_back(value.first);
+				} else if (found->second != value.second) {
+					differing.push_back(value.first);
+				}
+			}
+			for (auto& value : before.second) {
+				if (!after.second.count(value.first)) {
+					removed.push_back(value.first);
+				}
+			}
+
+			auto result = diff(before.first, after.first);
+			assert(result.fAdded == added);
+			assert(result.fRemoved == removed);
+			assert(std::is_sorted(result.fChangedKeys.begin(), result.fChangedKeys.end()));
+			auto next = differing.begin();
+			for (std::size_t i = 0; i != result.fChangedKeys.size(); ++i) {
+				auto key = result.fChangedKeys[i];
+				assert(before.second.at(key) == result.fChanged[i].first);
+				assert(after.second.at(key) == result.fChanged[i].second);
+				if (next != differing.end() && *next == key) {
+					++next;
+				}
+			}
+			assert(next == differing.end());
+
+			auto reversed = diff(after.first, before.first);
+			assert(reversed.fAdded == removed);
+			assert(reversed.fRemoved == added);
+		}
+	}
+
+	/// Versions sharing every node have no differences, and a single
+	/// update is reported alone.
+	void test_shared()
+	{
+		tree_type tree;
+		for (std::uint32_t i = 0; i < 1000; ++i) {
+			tree.insert(std::make_pair(i * 7919, 0));
+		}
+		auto copy = tree;
+		auto result = diff(tree, copy);
+		assert(result.fAdded.empty() && result.fRemoved.empty() && result.fChangedKeys.empty());
+
+		copy.erase(7919);
+		copy.insert(std::make_pair(static_cast<std::uint32_t>(7919), 1));
+		result = diff(tree, copy);
+		assert(result.fAdded.empty() && result.fRemoved.empty());
+		assert(result.fChangedKeys == std::vector<std::uint32_t>(1, 7919));
+		assert(result.fChanged[0] == std::make_pair(0, 1));
+
+		result = diff(tree_type(), tree_type());
+		assert(result.fAdded.empty() && result.fRemoved.empty() && result.fChangedKeys.empty());
+		result = diff(tree_type(), tree);
+		assert(result.fAdded.size() == 1000 && result.fRemoved.empty());
+	}
+}
+
+int main()
+{
+	test_diff();
+	test_shared();
+	std::cout << "ok" << std::endl;
+}
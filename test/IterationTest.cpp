@@ -0,0 +1,85 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -I.. IterationTest.cpp && ./a.out
+// and preferably again with -fsanitize=address.
+#include "SharedRadixTree.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace
+{
+	typedef EML::SharedRadixTree<std::uint32_t, int> tree_type;
+	typedef std::map<std::uint32_t, int> reference_type;
+	typedef std::pair<std::uint32_t, int> value_type;
+
+	/// Iteration, `for_each`, and range-for visit the values in key order.
+	void test_order()
+	{
+		std::mt19937 random(3);
+		for (int run = 0; run < 100; ++run) {
+			tree_type tree;
+			reference_type reference;
+			auto range = static_cast<std::uint32_t>(1) << (random() % 31 + 1);
+			for (int i = static_cast<int>(random() % 200); i > 0; --i) {
+				auto key = static_cast<std::uint32_t>(random() % range);
+				tree.insert(std::make_pair(key, i));
+				reference.insert(std::make_pair(key, i));
+			}
+			assert(reference_type(tree.begin(), tree.end()) == reference);
+			assert(std::distance(tree.cbegin(), tree.cend()) == static_cast<std::ptrdiff_t>(reference.size()));
+
+			std::vector<value_type> expected(reference.begin(), reference.end());
+			std::vector<value_type> visited;
+			tree.for_each([&](std::pair<std::uint32_t const, int> const& value) { visited.push_back(value); });
+			assert(visited == expected);
+
+			visited.clear();
+			for (auto& value : tree) {
+				visited.push_back(value);
+			}
+			assert(visited == expected);
+		}
+	}
+
+	/// An iterator returned by `find` or `insert` continues from its value
+	/// once incremented.
+	void test_increment_from_find()
+	{
+		tree_type tree;
+		reference_type reference;
+		std::mt19937 random(5);
+		for (int i = 0; i < 500; ++i) {
+			auto key = static_cast<std::uint32_t>(random());
+			tree.insert(std::make_pair(key, i));
+			reference.insert(std::make_pair(key, i));
+		}
+		for (auto& value : reference) {
+			auto i = tree.find(value.first);
+			auto j = reference.find(value.first);
+			for (int step = 0; step < 3 && j != reference.end(); ++step, ++j) {
+				assert(i != tree.end() && *i == *j);
+				i++;
+			}
+		}
+		auto inserted = tree.insert(std::make_pair(static_cast<std::uint32_t>(0), -1));
+		reference.insert(std::make_pair(static_cast<std::uint32_t>(0), -1));
+		assert(reference_type(inserted.first, tree.end()) == reference);
+
+		tree_type::const_iterator converted = tree.begin();
+		assert(converted == tree.cbegin());
+		assert(tree_type().begin() == tree_type().end());
+	}
+}
+
+int main()
+{
+	test_order();
+	test_increment_from_find();
+	std::cout << "ok" << std::endl;
+}
@@ -0,0 +1,331 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -pthread -I.. QueryTest.cpp && ./a.out
+// and preferably again with -fsanitize=address.
+#include "AtomicSharedRadixTree.hpp"
+
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	typedef std::map<std::uint32_t, int> reference_type;
+
+	template <typename Counts>
+	using tree_type = EML::SharedRadixTree<
+		std::uint32_t,
+		int,
+		EML::shared_radix_tree_detail::default_prefix<std::uint32_t>::type,
+		EML::shared_radix_tree_detail::default_mask<std::uint32_t>::type,
+		EML::multi_threaded,
+		EML::new_allocator,
+		Counts>;
+
+	template <typename Counts>
+	std::pair<tree_type<Counts>, reference_type> make_tree(std::mt19937& random, int count, std::uint32_t range)
+	{
+		std::pair<tree_type<Counts>, reference_type> result;
+		for (int i = 0; i < count; ++i) {
+			auto key = static_cast<std::uint32_t>(random() % range);
+			result.first.insert(std::make_pair(key, i));
+			result.second.insert(std::make_pair(key, i));
+		}
+		return result;
+	}
+
+	/// Whether `tree` has yet to count its values.
+	template <typename Tree>
+	bool size_unknown(Tree const& tree)
+	{
+		typedef typename Tree::size_type size_type;
+		return EML::shared_radix_tree_detail::tree_access::stored_size(tree) ==
+		       EML::shared_radix_tree_detail::lazy_size<size_type>::unknown();
+	}
+
+	/// `nth` and `rank` agree with positions in `std::map`, and stay
+	/// exact across updates of copies.
+	void test_nth_rank()
+	{
+		typedef tree_type<EML::counted> tree;
+		std::mt19937 random(19);
+		for (int run = 0; run < 100; ++run) {
+			auto range = static_cast<std::uint32_t>(1) << (random() % 31 + 1);
+			auto version = make_tree<EML::counted>(random, static_cast<int>(random() % 300), range);
+			auto copy = version.first;
+			for (int i = 0; i < 20; ++i) {
+				auto key = static_cast<std::uint32_t>(random() % range);
+				if (random() % 2) {
+					copy.erase(key);
+				} else {
+					copy.insert(std::make_pair(key, -i));
+				}
+			}
+			assert(reference_type(version.first.begin(), version.first.end()) == version.second);
+
+			tree::size_type n = 0;
+			for (auto& value : version.second) {
+				auto i = version.first.nth(n);
+				assert(i != version.first.end() && *i == value);
+				assert(version.first.rank(value.first) == n);
+				assert(version.first.rank(value.first + 1) == n + 1 || value.first + 1 == 0);
+				++n;
+			}
+			assert(version.first.nth(n) == version.first.end());
+			assert(version.first.nth(-1) == version.first.end());
+
+			std::vector<std::uint32_t> keys;
+			for (auto& value : copy) {
+				keys.push_back(value.first);
+			}
+			for (std::size_t i = 0; i != keys.size(); ++i) {
+				assert(copy.nth(static_cast<tree::size_type>(i))->first == keys[i]);
+				assert(copy.rank(keys[i]) == static_cast<tree::size_type>(i));
+			}
+		}
+		assert(tree().nth(0) == tree().end());
+		assert(tree().rank(0) == 0);
+	}
+
+	/// `find_many` returns what `find` does for every key, in order,
+	/// however many groups of lookups the keys span, and reads each key
+	/// of a single-pass range once.
+	void test_find_many()
+	{
+		typedef tree_type<EML::uncounted> tree;
+		std::mt19937 random(31);
+		for (int run = 0; run < 50; ++run) {
+			auto range = static_cast<std::uint32_t>(1) << (random() % 31 + 1);
+			auto version = make_tree<EML::uncounted>(random, static_cast<int>(random() % 1000), range);
+			std::vector<std::uint32_t> keys;
+			for (int i = static_cast<int>(random() % 100); i > 0; --i) {
+				if (!version.second.empty() && random() % 2) {
+					auto j = version.second.begin();
+					std::advance(j, random() % version.second.size());
+					keys.push_back(j->first);
+				} else {
+					keys.push_back(static_cast<std::uint32_t>(random() % range));
+				}
+			}
+
+			std::vector<tree::iterator> found;
+			auto out = version.first.find_many(keys.begin(), keys.end(), std::back_inserter(found));
+			assert(found.size() == keys.size());
+			tree const& constTree = version.first;
+			std::vector<tree::const_iterator> constFound(keys.size());
+			assert(constTree.find_many(keys.begin(), keys.end(), constFound.begin()) == constFound.end());
+			for (std::size_t i = 0; i != keys.size(); ++i) {
+				assert(found[i] == version.first.find(keys[i]));
+				assert(constFound[i] == constTree.find(keys[i]));
+				auto expected = version.second.find(keys[i]);
+				if (expected == version.second.end()) {
+					assert(found[i] == version.first.end());
+				} else {
+					assert(found[i]->second == expected->second);
+				}
+			}
+			*out = version.first.end();
+			assert(found.size() == keys.size() + 1);
+
+			std::ostringstream written;
+			for (auto key : keys) {
+				written << key << ' ';
+			}
+			std::istringstream read(written.str());
+			std::vector<tree::const_iterator> streamed;
+			constTree.find_many(std::istream_iterator<std::uint32_t>(read), std::istream_iterator<std::uint32_t>(), std::back_inserter(streamed));
+			assert(streamed == constFound);
+		}
+
+		std::vector<std::uint32_t> keys(20, 1);
+		std::vector<tree::const_iterator> found;
+		tree const empty;
+		empty.find_many(keys.begin(), keys.end(), std::back_inserter(found));
+		assert(found == std::vector<tree::const_iterator>(20, empty.end()));
+	}
+
+	/// `lower_bound`, `upper_bound`, and `equal_range` agree with
+	/// `std::map` for present keys, absent keys, and keys beyond either
+	/// end.
+	void test_bounds()
+	{
+		std::mt19937 random(37);
+		for (int run = 0; run < 100; ++run) {
+			auto range = static_cast<std::uint32_t>(1) << (random() % 31 + 1);
+			auto version = make_tree<EML::uncounted>(random, static_cast<int>(random() % 300), range);
+			auto const& constTree = version.first;
+			std::vector<std::uint32_t> keys = {0, range - 1, range, 0xffffffffu};
+			for (int i = 0; i < 50; ++i) {
+				keys.push_back(static_cast<std::uint32_t>(random() % range));
+			}
+			for (auto& value : version.second) {
+				keys.push_back(value.first);
+			}
+			for (auto key : keys) {
+				auto lower = version.second.lower_bound(key);
+				auto upper = version.second.upper_bound(key);
+				assert(reference_type(version.first.lower_bound(key), version.first.end()) == reference_type(lower, version.second.end()));
+				assert(reference_type(constTree.upper_bound(key), constTree.end()) == reference_type(upper, version.second.end()));
+				auto found = version.first.equal_range(key);
+				assert(reference_type(found.first, found.second) == reference_type(lower, upper));
+			}
+		}
+	}
+
+	/// Signed keys are visited and bounded in `key_comp()` order, which
+	/// places negative keys after non-negative ones, and `subtree`
+	/// splits them on the sign bit.
+	void test_signed()
+	{
+		typedef EML::SharedRadixTree<int, int> tree;
+		typedef std::map<int, int, tree::key_compare> signed_reference_type;
+		std::mt19937 random(41);
+		tree version;
+		signed_reference_type reference;
+		std::vector<int> keys = {INT_MIN, INT_MIN + 1, -1, 0, 1, INT_MAX};
+		for (int i = 0; i < 500; ++i) {
+			keys.push_back(static_cast<int>(random()));
+		}
+		for (auto key : keys) {
+			version.insert(std::make_pair(key, key / 2));
+			reference.insert(std::make_pair(key, key / 2));
+		}
+		assert(signed_reference_type(version.begin(), version.end()) == reference);
+		assert(version.begin()->first == 0 && reference.rbegin()->first == -1);
+		for (auto key : keys) {
+			assert(signed_reference_type(version.lower_bound(key), version.end()) ==
+			       signed_reference_type(reference.lower_bound(key), reference.end()));
+			assert(signed_reference_type(version.upper_bound(key), version.end()) ==
+			       signed_reference_type(reference.upper_bound(key), reference.end()));
+		}
+
+		signed_reference_type negative;
+		signed_reference_type nonNegative;
+		for (auto& value : reference) {
+			(value.first < 0 ? negative : nonNegative).insert(value);
+		}
+		auto low = version.subtree(INT_MIN, 1);
+		assert(signed_reference_type(low.begin(), low.end()) == negative);
+		assert(low.size() == static_cast<tree::size_type>(negative.size()));
+		auto high = version.subtree(0, 1);
+		assert(signed_reference_type(high.begin(), high.end()) == nonNegative);
+		auto exact = version.subtree(INT_MIN, 32);
+		assert(exact.size() == 1 && exact.begin()->first == INT_MIN);
+		assert(version.subtree(INT_MIN, 0).size() == version.size());
+		assert(tree().subtree(INT_MIN, 1).empty());
+	}
+
+	/// `subtree` holds exactly the keys agreeing with its prefix on the
+	/// requested leading bits, for every number of bits.
+	void test_subtree()
+	{
+		typedef tree_type<EML::counted> tree;
+		std::mt19937 random(43);
+		for (int run = 0; run < 50; ++run) {
+			auto range = static_cast<std::uint32_t>(1) << (random() % 31 + 1);
+			auto version = make_tree<EML::counted>(random, static_cast<int>(random() % 300), range);
+			auto key = static_cast<std::uint32_t>(random() % range);
+			for (int bits = 0; bits <= 33; ++bits) {
+				reference_type expected;
+				for (auto& value : version.second) {
+					if (bits == 0 || (bits >= 32 ? value.first == key : (value.first ^ key) >> (32 - bits) == 0)) {
+						expected.insert(value);
+					}
+				}
+				auto result = version.first.subtree(key, bits);
+				assert(reference_type(result.begin(), result.end()) == expected);
+				assert(result.size() == static_cast<tree::size_type>(expected.size()));
+			}
+		}
+	}
+
+	/// The results of `split` and `subtree` of an `uncounted` tree
+	/// count their values when first asked, and keep an exact size
+	/// through later updates, joins, and publication.
+	void test_lazy_size()
+	{
+		typedef tree_type<EML::uncounted> tree;
+		std::mt19937 random(23);
+		auto version = make_tree<EML::uncounted>(random, 5000, 1 << 20);
+		auto key = static_cast<std::uint32_t>(1) << 19;
+		reference_type less(version.second.begin(), version.second.lower_bound(key));
+		reference_type rest(version.second.lower_bound(key), version.second.end());
+		auto upper = static_cast<tree::size_type>(rest.size());
+
+		auto halves = version.first.split(key);
+		assert(size_unknown(halves.first) && size_unknown(halves.second));
+		halves.first.insert(std::make_pair(static_cast<std::uint32_t>(1), -1));
+		less.insert(std::make_pair(static_cast<std::uint32_t>(1), -1));
+		halves.second.erase(rest.begin()->first);
+		rest.erase(rest.begin());
+		assert(halves.first.size() == static_cast<tree::size_type>(less.size()));
+		assert(!size_unknown(halves.first));
+		assert(reference_type(halves.second.begin(), halves.second.end()) == rest);
+
+		auto joined = halves.first;
+		joined.join(halves.second);
+		assert(size_unknown(joined));
+		auto expected = less;
+		expected.insert(rest.begin(), rest.end());
+		assert(joined.size() == static_cast<tree::size_type>(expected.size()));
+
+		// A half left empty takes the known size of the whole.
+		auto whole = version.first.split(0);
+		assert(whole.first.empty() && whole.first.size() == 0);
+		assert(!size_unknown(whole.second) && whole.second.size() == version.first.size());
+
+		// The keys agreeing with `key` on their leading 13 bits are those
+		// from `key` up.
+		auto sub = version.first.subtree(key, 13);
+		assert(size_unknown(sub));
+		EML::atomic_shared_radix_tree<tree> cell(sub);
+		assert(cell.borrow().size() == upper);
+		assert(cell.load().size() == upper);
+
+		for (auto& value : reference_type(sub.begin(), sub.end())) {
+			sub.erase(value.first);
+		}
+		assert(sub.empty() && sub.size() == 0);
+	}
+
+	/// A tree moved from is empty with size 0, whether the size it had
+	/// was known or not, and the tree moved to keeps that size.
+	void test_move()
+	{
+		typedef tree_type<EML::uncounted> tree;
+		std::mt19937 random(41);
+		auto version = make_tree<EML::uncounted>(random, 10, 1 << 20);
+		tree moved(std::move(version.first));
+		assert(version.first.empty() && version.first.size() == 0);
+		assert(moved.size() == 10 && reference_type(moved.begin(), moved.end()) == version.second);
+
+		auto key = std::next(version.second.begin(), 4)->first;
+		auto sub = moved.split(key).second;
+		assert(size_unknown(sub));
+		tree movedSub(std::move(sub));
+		assert(sub.empty() && !size_unknown(sub) && sub.size() == 0);
+		assert(size_unknown(movedSub) && movedSub.size() == 6);
+
+		sub = std::move(movedSub);
+		assert(movedSub.empty() && movedSub.size() == 0 && sub.size() == 6);
+	}
+}
+
+int main()
+{
+	test_nth_rank();
+	test_find_many();
+	test_bounds();
+	test_signed();
+	test_subtree();
+	test_lazy_size();
+	test_move();
+	std::cout << "ok" << std::endl;
+}
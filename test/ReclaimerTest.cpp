@@ -0,0 +1,134 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -pthread -I.. ReclaimerTest.cpp && ./a.out
+// and preferably again with -fsanitize=address and -fsanitize=thread.
+#include "DeferredSharedRadixTree.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	template <typename RefCount, typename Allocator>
+	using tree_type = EML::SharedRadixTree<
+		std::uint32_t,
+		int,
+		EML::shared_radix_tree_detail::default_prefix<std::uint32_t>::type,
+		EML::shared_radix_tree_detail::default_mask<std::uint32_t>::type,
+		RefCount,
+		Allocator,
+		EML::uncounted,
+		EML::binary_nodes,
+		EML::atomic_metrics>;
+	typedef std::map<std::uint32_t, int> reference_type;
+
+	template <typename Tree>
+	Tree make_tree(int count, std::uint32_t seed, typename Tree::allocator_type const& alloc = typename Tree::allocator_type())
+	{
+		std::mt19937 random(seed);
+		Tree result(alloc);
+		while (result.size() != count) {
+			result.insert(std::make_pair(static_cast<std::uint32_t>(random()), static_cast<int>(result.size())));
+		}
+		return result;
+	}
+
+	std::uint64_t freed()
+	{
+		return EML::atomic_metrics::get(EML::tree_event::node_free);
+	}
+
+	/// Retiring a tree destroys nothing until `step`, which destroys no
+	/// more nodes than its budget, oldest trees first.
+	template <typename Allocator>
+	void test_deferred()
+	{
+		typedef tree_type<EML::single_threaded, Allocator> tree;
+		EML::atomic_metrics::reset();
+		{
+			EML::deferred_reclaimer<tree> reclaimer;
+			assert(reclaimer.empty() && reclaimer.step(100) == 0);
+			reclaimer.retire(make_tree<tree>(1000, 1));
+			reclaimer.retire(make_tree<tree>(10, 2));
+			reclaimer.retire(tree());
+			assert(freed() == 0 && !reclaimer.empty());
+
+			assert(reclaimer.step(0) == 0);
+			assert(reclaimer.step(500) == 500 && freed() == 500);
+			// The rest of the first tree and all of the second.
+			assert(reclaimer.step(10000) == 1999 - 500 + 19);
+			assert(reclaimer.empty() && freed() == 1999 + 19);
+
+			reclaimer.retire(make_tree<tree>(100, 3));
+			assert(reclaimer.step(1) == 1);
+			assert(reclaimer.drain() == 198 && reclaimer.empty());
+		}
+		assert(freed() == 1999 + 19 + 199);
+	}
+
+	/// A tree sharing its nodes with one still in use leaves nothing to
+	/// destroy, and a retired copy only destroys what it alone holds.
+	void test_shared()
+	{
+		typedef tree_type<EML::single_threaded, EML::new_allocator> tree;
+		EML::deferred_reclaimer<tree> reclaimer;
+		auto kept = make_tree<tree>(1000, 4);
+		reference_type reference(kept.begin(), kept.end());
+		EML::atomic_metrics::reset();
+		reclaimer.retire(kept);
+		assert(reclaimer.empty());
+
+		auto copy = kept;
+		copy.erase(reference.begin()->first);
+		copy.insert(std::make_pair(static_cast<std::uint32_t>(7), 7));
+		auto copied = EML::atomic_metrics::get(EML::tree_event::branch_create) + EML::atomic_metrics::get(EML::tree_event::leaf_create);
+		auto before = freed();
+		reclaimer.retire(std::move(copy));
+		assert(reclaimer.drain() == copied && freed() - before == copied);
+		assert(reference_type(kept.begin(), kept.end()) == reference);
+	}
+
+	/// A background reclaimer destroys every tree retired to it by the
+	/// time it is destroyed, while copies still in use stay intact.
+	template <typename Allocator>
+	void test_background()
+	{
+		typedef tree_type<EML::multi_threaded, Allocator> tree;
+		std::vector<tree> kept;
+		std::vector<reference_type> references;
+		EML::atomic_metrics::reset();
+		std::uint64_t expected = 0;
+		{
+			EML::background_reclaimer<tree> reclaimer(64);
+			for (std::uint32_t i = 0; i < 50; ++i) {
+				auto version = make_tree<tree>(2000, i);
+				if (i % 5 == 0) {
+					kept.push_back(version);
+					references.emplace_back(version.begin(), version.end());
+				} else {
+					expected += 2 * 2000 - 1;
+				}
+				reclaimer.retire(std::move(version));
+			}
+		}
+		assert(freed() == expected);
+		for (std::size_t i = 0; i != kept.size(); ++i) {
+			assert(reference_type(kept[i].begin(), kept[i].end()) == references[i]);
+		}
+	}
+}
+
+int main()
+{
+	test_deferred<EML::new_allocator>();
+	test_deferred<EML::arena_allocator>();
+	test_shared();
+	test_background<EML::new_allocator>();
+	test_background<EML::pool_allocator>();
+	std::cout << "ok" << std::endl;
+}
@@ -0,0 +1,232 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -pthread -I.. SetOperationsTest.cpp && ./a.out
+// and preferably again with -fsanitize=address.
+#include "ParallelSharedRadixTree.hpp"
+#include "SerializedSharedRadixTree.hpp"
+#include "TestSupport.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	typedef std::map<std::uint32_t, int> reference_type;
+
+	template <typename Counts>
+	using tree_type = EML::SharedRadixTree<
+		std::uint32_t,
+		int,
+		EML::shared_radix_tree_detail::default_prefix<std::uint32_t>::type,
+		EML::shared_radix_tree_detail::default_mask<std::uint32_t>::type,
+		EML::multi_threaded,
+		EML::new_allocator,
+		Counts>;
+
+	using test_support::check;
+	using test_support::derive;
+
+	template <typename Counts>
+	void test_set_operations()
+	{
+		typedef tree_type<Counts> tree;
+		auto first = [](int mine, int) { return mine; };
+		std::mt19937 random(7);
+		for (int run = 0; run < 200; ++run) {
+			auto range = static_cast<std::uint32_t>(1) << (random() % 20 + 1);
+			auto base = derive(std::make_pair(tree(), reference_type()), random, static_cast<int>(random() % 300), range);
+			auto lhs = derive(base, random, static_cast<int>(random() % 20), range);
+			auto rhs = run % 4 == 0 ? derive(std::make_pair(tree(), reference_type()), random, static_cast<int>(random() % 300), range)
+			                        : derive(base, random, static_cast<int>(random() % 20), range);
+
+			auto merged = lhs.first;
+			merged.merge_with(rhs.first, first);
+			auto mergedReference = lhs.second;
+			mergedReference.insert(rhs.second.begin(), rhs.second.end());
+			check(merged, mergedReference);
+
+			auto parallel = lhs.first;
+			EML::parallel_merge_with(parallel, rhs.first, first, 3);
+			check(parallel, mergedReference);
+
+			auto intersected = lhs.first;
+			intersected.intersect_with(rhs.first, first);
+			reference_type intersectedReference;
+			for (auto& value : lhs.second) {
+				if (rhs.second.count(value.first)) {
+					intersectedReference.insert(value);
+				}
+			}
+			check(intersected, intersectedReference);
+
+			auto parallelIntersected = lhs.first;
+			EML::parallel_intersect_with(parallelIntersected, rhs.first, first, 3);
+			check(parallelIntersected, intersectedReference);
+
+			auto difference = lhs.first;
+			difference.difference(rhs.first);
+			reference_type differenceReference;
+			for (auto& value : lhs.second) {
+				if (!rhs.second.count(value.first)) {
+					differenceReference.insert(value);
+				}
+			}
+			check(difference, differenceReference);
+
+			auto parallelDifference = lhs.first;
+			EML::parallel_difference(parallelDifference, rhs.first, 3);
+			check(parallelDifference, differenceReference);
+
+			// The halves of a `split` have yet to count their values.
+			auto key = static_cast<std::uint32_t>(random() % range);
+			auto lower = lhs.first.split(key).first;
+			EML::parallel_difference(lower, rhs.first, 3);
+			reference_type lowerReference(differenceReference.begin(), differenceReference.lower_bound(key));
+			check(lower, lowerReference);
+
+			auto halves = lhs.first.split(key);
+			check(halves.first, reference_type(lhs.second.begin(), lhs.second.lower_bound(key)));
+			check(halves.second, reference_type(lhs.second.lower_bound(key), lhs.second.end()));
+			auto joined = halves.second;
+			joined.join(halves.first);
+			check(joined, lhs.second);
+
+			// Keys in both trees keep the values of the first, and are
+			// counted once, whether or not the sizes were known.
+			auto overlapping = lhs.first;
+			overlapping.join(rhs.first);
+			check(overlapping, mergedReference);
+			overlapping = halves.second;
+			overlapping.join(rhs.first);
+			auto overlappingReference = reference_type(lhs.second.lower_bound(key), lhs.second.end());
+			overlappingReference.insert(rhs.second.begin(), rhs.second.end());
+			check(overlapping, overlappingReference);
+
+			auto bits = static_cast<int>(random() % 33);
+			reference_type subtreeReference;
+			for (auto& value : lhs.second) {
+				if (bits == 0 || (value.first ^ key) >> (32 - bits) == 0) {
+					subtreeReference.insert(value);
+				}
+			}
+			check(lhs.first.subtree(key, bits), subtreeReference);
+
+			auto even = [](std::pair<std::uint32_t const, int> const& value) { return value.second % 2 == 0; };
+			reference_type filteredReference;
+			for (auto& value : lhs.second) {
+				if (even(value)) {
+					filteredReference.insert(value);
+				}
+			}
+			check(EML::parallel_filter(lhs.first, even, 3), filteredReference);
+
+			std::mutex mutex;
+			reference_type visited;
+			EML::parallel_for_each(lhs.first, [&](std::pair<std::uint32_t const, int> const& value) {
+				std::lock_guard<std::mutex> lock(mutex);
+				assert(visited.insert(value).second);
+			}, 3);
+			assert(visited == lhs.second);
+
+			typedef std::map<std::uint32_t, long long> transformed_reference_type;
+			auto scale = [](std::pair<std::uint32_t const, int> const& value) { return 3LL * value.second + value.first; };
+			auto transformed = EML::parallel_transform(lhs.first, scale, 3);
+			transformed_reference_type transformedReference;
+			for (auto& value : lhs.second) {
+				transformedReference.insert(std::make_pair(value.first, scale(value)));
+			}
+			assert(transformed.size() == static_cast<typename tree::size_type>(transformedReference.size()));
+			assert(transformed_reference_type(transformed.begin(), transformed.end()) == transformedReference);
+			// The size of a half yet to count its values is counted later.
+			auto transformedHalf = EML::parallel_transform(lhs.first.split(key).second, scale, 3);
+			assert(transformedHalf.size() == static_cast<typename tree::size_type>(std::distance(transformedReference.lower_bound(key), transformedReference.end())));
+
+			std::vector<std::pair<std::uint32_t, int>> sorted(lhs.second.begin(), lhs.second.end());
+			if (!sorted.empty()) {
+				sorted.insert(sorted.begin() + random() % sorted.size(), sorted[random() % sorted.size()]);
+				std::sort(sorted.begin(), sorted.end(), [](std::pair<std::uint32_t, int> const& a, std::pair<std::uint32_t, int> const& b) {
+					return a.first < b.first;
+				});
+			}
+			check(tree::from_sorted(sorted.begin(), sorted.end()), lhs.second);
+		}
+	}
+
+	/// `split` and the `join` of its halves only build `branch` nodes on
+	/// the path of the split key, and the joined tree has the shape of
+	/// the original and shares all of its other nodes.
+	void test_split_join_reuse()
+	{
+		typedef EML::SharedRadixTree<
+			std::uint32_t,
+			int,
+			EML::shared_radix_tree_detail::default_prefix<std::uint32_t>::type,
+			EML::shared_radix_tree_detail::default_mask<std::uint32_t>::type,
+			EML::single_threaded,
+			EML::new_allocator,
+			EML::uncounted,
+			EML::binary_nodes,
+			EML::atomic_metrics> tree;
+		std::mt19937 random(47);
+		tree version;
+		for (int i = 0; i < 10000; ++i) {
+			version.insert(std::make_pair(static_cast<std::uint32_t>(random()), i));
+		}
+		auto before = version.stats();
+		for (int run = 0; run < 20; ++run) {
+			auto key = static_cast<std::uint32_t>(random());
+			EML::atomic_metrics::reset();
+			auto halves = version.split(key);
+			auto splitBranches = EML::atomic_metrics::get(EML::tree_event::branch_create);
+			assert(splitBranches <= before.fMaxDepth);
+			assert(EML::atomic_metrics::get(EML::tree_event::leaf_create) == 0);
+
+			auto joined = halves.second;
+			EML::atomic_metrics::reset();
+			joined.join(halves.first);
+			assert(EML::atomic_metrics::get(EML::tree_event::branch_create) <= before.fMaxDepth);
+			assert(EML::atomic_metrics::get(EML::tree_event::leaf_create) == 0);
+
+			auto after = joined.stats();
+			assert(after.fBranches == before.fBranches && after.fLeaves == before.fLeaves);
+			assert(after.fDepths == before.fDepths);
+			assert(joined.size() == version.size());
+			bool changed = false;
+			auto note = [&](std::pair<std::uint32_t const, int> const&) { changed = true; };
+			EML::diff(version, joined, note, note, [&](std::pair<std::uint32_t const, int> const&, std::pair<std::uint32_t const, int> const&) { changed = true; });
+			assert(!changed);
+		}
+	}
+
+	/// Versions read back from checkpoints keep their sizes.
+	void test_checkpoint_sizes()
+	{
+		typedef tree_type<EML::uncounted> tree;
+		std::mt19937 random(11);
+		EML::checkpoint_writer<tree> writer;
+		EML::checkpoint_reader<tree> reader;
+		auto version = std::make_pair(tree(), reference_type());
+		for (int i = 0; i < 50; ++i) {
+			version = derive(version, random, 20, 256);
+			auto checkpoint = writer.write(version.first);
+			check(reader.read(checkpoint.data(), checkpoint.size()), version.second);
+		}
+	}
+}
+
+int main()
+{
+	test_set_operations<EML::uncounted>();
+	test_set_operations<EML::counted>();
+	test_split_join_reuse();
+	test_checkpoint_sizes();
+	std::cout << "ok" << std::endl;
+}
@@ -0,0 +1,215 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -I.. StatsTest.cpp && ./a.out
+// and preferably again with -fsanitize=address.
+#include "SharedRadixTree.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+	typedef EML::SharedRadixTree<std::uint32_t, int> tree_type;
+	typedef EML::SharedRadixTree<
+		std::uint32_t,
+		int,
+		EML::shared_radix_tree_detail::default_prefix<std::uint32_t>::type,
+		EML::shared_radix_tree_detail::default_mask<std::uint32_t>::type,
+		EML::single_threaded,
+		EML::new_allocator,
+		EML::uncounted,
+		EML::binary_nodes,
+		EML::atomic_metrics> metered_tree_type;
+
+	tree_type make_tree(std::vector<std::uint32_t> const& keys)
+	{
+		tree_type result;
+		for (auto key : keys) {
+			result.insert(std::make_pair(key, 0));
+		}
+		return result;
+	}
+
+	/// Node counts, depths, and bytes of small trees of known shape.
+	void test_shape()
+	{
+		auto empty = tree_type().stats();
+		assert(empty.fBranches == 0 && empty.fLeaves == 0 && empty.fMaxDepth == 0);
+		assert(empty.fDepths.empty() && empty.fBytes == 0 && empty.fSharedBytes == 0);
+
+		auto single = make_tree({7}).stats();
+		assert(single.fBranches == 0 && single.fLeaves == 1 && single.fMaxDepth == 0);
+		assert(single.fDepths == std::vector<std::size_t>(1, 1) && single.fAverageDepth == 0);
+		auto leafBytes = single.fBytes;
+		assert(leafBytes > 0);
+
+		auto pair = make_tree({7, 8}).stats();
+		assert(pair.fBranches == 1 && pair.fLeaves == 2 && pair.fMaxDepth == 1);
+		auto branchBytes = pair.fBytes - 2 * leafBytes;
+		assert(branchBytes > 0);
+
+		// Keys differing in their low three bits make a complete tree.
+		auto complete = make_tree({5, 3, 0, 7, 1, 6, 2, 4}).stats();
+		assert(complete.fBranches == 7 && complete.fLeaves == 8);
+		assert(complete.fMaxDepth == 3 && complete.fAverageDepth == 3);
+		assert(complete.fDepths == std::vector<std::size_t>({0, 0, 0, 8}));
+		assert(complete.fBytes == 8 * leafBytes + 7 * branchBytes);
+
+		// Each key splits off the path to the next, making a chain.
+		auto chain = make_tree({1, 2, 4, 8, 16}).stats();
+		assert(chain.fBranches == 4 && chain.fMaxDepth == 4);
+		assert(chain.fDepths == std::vector<std::size_t>({0, 1, 1, 1, 2}));
+		assert(chain.fAverageDepth == 14.0 / 5);
+	}
+
+	/// A random tree has one `branch` fewer than it has values, with
+	/// every `leaf` counted at exactly one depth.
+	void test_counts()
+	{
+		std::mt19937 random(53);
+		for (int run = 0; run < 50; ++run) {
+			std::vector<std::uint32_t> keys;
+			for (int i = static_cast<int>(random() % 1000) + 1; i > 0; --i) {
+				keys.push_back(static_cast<std::uint32_t>(random()));
+			}
+			auto tree = make_tree(keys);
+			auto stats = tree.stats();
+			assert(stats.fLeaves == static_cast<std::size_t>(tree.size()));
+			assert(stats.fBranches == stats.fLeaves - 1);
+			std::size_t leaves = 0;
+			std::size_t depths = 0;
+			for (std::size_t depth = 0; depth != stats.fDepths.size(); ++depth) {
+				leaves += stats.fDepths[depth];
+				depths += depth * stats.fDepths[depth];
+			}
+			assert(leaves == stats.fLeaves);
+			assert(stats.fDepths.back() > 0 && stats.fMaxDepth == stats.fDepths.size() - 1);
+			assert(stats.fAverageDepth == static_cast<double>(depths) / stats.fLeaves);
+			assert(stats.fSharedBytes == 0);
+		}
+	}
+
+	/// Bytes reachable from a copy are shared until an update copies the
+	/// path to its key, which only the updated tree then holds.
+	void test_shared_bytes()
+	{
+		std::mt19937 random(59);
+		std::vector<std::uint32_t> keys;
+		for (int i = 0; i < 1000; ++i) {
+			keys.push_back(static_cast<std::uint32_t>(random()));
+		}
+		auto tree = make_tree(keys);
+		auto bytes = tree.stats().fBytes;
+		{
+			auto copy = tree;
+			assert(tree.stats().fSharedBytes == bytes);
+			assert(copy.stats().fSharedBytes == bytes);
+
+			copy.erase(keys[0]);
+			auto stats = tree.stats();
+			auto copyStats = copy.stats();
+			assert(stats.fBytes == bytes && stats.fSharedBytes < bytes);
+			assert(copyStats.fSharedBytes < copyStats.fBytes);
+			// What only one tree holds is the path to the erased key.
+			assert(bytes - stats.fSharedBytes <= (stats.fMaxDepth + 1) * (stats.fBytes / stats.fLeaves));
+			assert(stats.fSharedBytes == copyStats.fSharedBytes);
+		}
+		assert(tree.stats().fSharedBytes == 0);
+	}
+
+	std::uint64_t events(EML::tree_event event)
+	{
+		return EML::atomic_metrics::get(event);
+	}
+
+	/// Writes, lookups, and node construction and destruction are each
+	/// counted once.
+	void test_events()
+	{
+		EML::atomic_metrics::reset();
+		{
+			metered_tree_type tree;
+			for (std::uint32_t key = 0; key != 8; key += 2) {
+				tree.insert(std::make_pair(key, 0));
+			}
+			// The first insert only creates a `leaf`.
+			assert(events(EML::tree_event::write) == 3 && events(EML::tree_event::shared_write) == 0);
+			assert(events(EML::tree_event::leaf_create) == 4 && events(EML::tree_event::branch_create) == 3);
+
+			assert(tree.find(4)->second == 0 && tree.find(5) == tree.end());
+			assert(events(EML::tree_event::lookup) == 2);
+			// Both lookups end at a `leaf` under two `branch` nodes.
+			assert(EML::atomic_metrics::lookups_at_depth(2) == 2);
+
+			auto copy = tree;
+			copy.erase(4);
+			assert(events(EML::tree_event::shared_write) == 1);
+			assert(events(EML::tree_event::branch_copy) == 1);
+		}
+		// Four leaves and three branches of the tree, the branch copied
+		// for the copy, and the branch the erase replaced by its sibling.
+		assert(events(EML::tree_event::node_free) == 4 + 3 + 1);
+
+		std::uint64_t total = 0;
+		int names = 0;
+		EML::atomic_metrics::for_each([&](char const* name, std::uint64_t count) {
+			assert(name && *name);
+			total += count;
+			++names;
+		});
+		assert(names == EML::shared_radix_tree_detail::tree_event_count && total > 0);
+		EML::atomic_metrics::reset();
+		assert(events(EML::tree_event::write) == 0 && EML::atomic_metrics::lookups_at_depth(2) == 0);
+	}
+
+	/// `branch_update` counts the unique `branch` nodes an update actually
+	/// rewrote or recounted, and nothing for updates that change nothing.
+	void test_branch_updates()
+	{
+		// A root masking bit 2 over two `branch` nodes masking bit 1.
+		metered_tree_type tree;
+		for (std::uint32_t key = 0; key != 8; key += 2) {
+			tree.insert(std::make_pair(key, 0));
+		}
+		EML::atomic_metrics::reset();
+		assert(!tree.insert(std::make_pair(2u, 1)).second);
+		assert(!tree.try_emplace(4u, 1).second);
+		assert(tree.erase(5u) == 0 && tree.erase(64u) == 0);
+		assert(events(EML::tree_event::branch_update) == 0);
+		tree.insert_or_assign(2u, 1);
+		assert(events(EML::tree_event::branch_update) == 0);
+
+		// The new `branch` over 0 and 1 goes under both unique branches on
+		// the path, and erasing 1 again replaces it with 0.
+		tree.insert(std::make_pair(1u, 0));
+		assert(events(EML::tree_event::branch_update) == 2);
+		tree.erase(1u);
+		assert(events(EML::tree_event::branch_update) == 4);
+
+		// A copy shares every node, so updating it copies the path and
+		// updates nothing in place.  The copied path is then unique, and
+		// replacing the shared `leaf` of 2 rewrites only its parent.
+		auto copy = tree;
+		EML::atomic_metrics::reset();
+		copy.insert_or_assign(0u, 1);
+		assert(events(EML::tree_event::branch_update) == 0);
+		assert(events(EML::tree_event::branch_copy) == 2);
+		copy.insert_or_assign(2u, 2);
+		assert(events(EML::tree_event::branch_update) == 1);
+		assert(events(EML::tree_event::branch_copy) == 2);
+		assert(tree.find(2u)->second == 1 && copy.find(2u)->second == 2);
+	}
+}
+
+int main()
+{
+	test_shape();
+	test_counts();
+	test_shared_bytes();
+	test_events();
+	test_branch_updates();
+	std::cout << "ok" << std::endl;
+}
@@ -0,0 +1,132 @@
+// Copyright 2015 The MathWorks, Inc.
+#ifndef _eml_test_TestSupport_hpp
+#define _eml_test_TestSupport_hpp
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace test_support
+{
+	/// The `std::map` a test checks a `Tree` against.
+	template <typename Tree>
+	using reference_of = std::map<typename Tree::key_type, typename Tree::mapped_type>;
+
+	/// `size` must agree with the values the tree holds.
+	template <typename Tree, typename Reference>
+	void check(Tree const& tree, Reference const& reference)
+	{
+		assert(tree.size() == static_cast<typename Tree::size_type>(reference.size()));
+		assert(Reference(tree.begin(), tree.end()) == reference);
+	}
+
+	/// A tree and its reference derived from `base` by a few random
+	/// changes, so that the two share most of their nodes.  Keys are
+	/// below `range` and values below `values`.
+	template <typename Tree>
+	std::pair<Tree, reference_of<Tree>> derive(std::pair<Tree, reference_of<Tree>> base,
+	                                           std::mt19937& random,
+	                                           int changes,
+	                                           std::uint64_t range,
+	                                           int values = 1000)
+	{
+		typedef typename Tree::key_type key_type;
+		typedef typename Tree::mapped_type mapped_type;
+		for (int i = 0; i < changes; ++i) {
+			auto key = static_cast<key_type>(random() % range);
+			if (random() % 2) {
+				base.first.erase(key);
+				base.second.erase(key);
+			} else {
+				auto value = static_cast<mapped_type>(random() % values);
+				base.first.insert_or_assign(key, value);
+				base.second[key] = value;
+			}
+		}
+		return base;
+	}
+
+	/// Random updates of copies agree with `std::map`, never disturb the
+	/// trees they were copied from, and iterate in key order.  Each of
+	/// `runs` versions is copied from the last and passed to
+	/// `visit(version, reference)`.  Keys are below `range`.
+	template <typename Tree, typename Visit>
+	void random_updates(std::mt19937& random, std::uint64_t range, int runs, Visit visit)
+	{
+		typedef reference_of<Tree> reference_type;
+		typedef typename Tree::key_type key_type;
+		typedef typename Tree::size_type size_type;
+		typedef typename Tree::value_type value_type;
+		typedef std::pair<key_type, int> pair_type;
+		Tree version;
+		reference_type reference;
+		for (int run = 0; run < runs; ++run) {
+			auto copy = version;
+			auto copyReference = reference;
+			for (int i = 0; i < 50; ++i) {
+				auto key = static_cast<key_type>(random() % range);
+				switch (random() % 5) {
+				case 0:
+					assert(copy.erase(key) == static_cast<size_type>(copyReference.erase(key)));
+					break;
+				case 1:
+					assert(copy.insert_or_assign(key, i).second == !copyReference.count(key));
+					copyReference[key] = i;
+					assert(copy.find(key)->second == i);
+					break;
+				case 2:
+					assert(copy.try_emplace(key, i).second == copyReference.insert(std::make_pair(key, i)).second);
+					break;
+				case 3:
+					assert(copy.emplace(key, i).second == copyReference.insert(std::make_pair(key, i)).second);
+					break;
+				default: {
+					auto inserted = copy.insert(std::make_pair(key, i));
+					assert(inserted.second == copyReference.insert(std::make_pair(key, i)).second);
+					assert(inserted.first->first == key && inserted.first->second == copyReference[key]);
+				}
+				}
+			}
+			check(copy, copyReference);
+			assert(reference_type(version.begin(), version.end()) == reference);
+
+			std::vector<pair_type> expected(copyReference.begin(), copyReference.end());
+			std::vector<pair_type> visited;
+			copy.for_each([&](value_type const& value) { visited.push_back(value); });
+			assert(visited == expected);
+			Tree const& constCopy = copy;
+			assert(std::vector<pair_type>(constCopy.cbegin(), constCopy.cend()) == expected);
+			for (auto& value : copyReference) {
+				assert(constCopy.find(value.first)->second == value.second);
+			}
+			if (range <= std::numeric_limits<key_type>::max()) {
+				assert(copy.find(static_cast<key_type>(range)) == copy.end());
+			}
+
+			visit(constCopy, copyReference);
+			version = std::move(copy);
+			reference = copyReference;
+		}
+		version.clear();
+		assert(version.empty() && version.size() == 0 && version.begin() == version.end());
+	}
+
+	struct ignore_version
+	{
+		template <typename Tree, typename Reference>
+		void operator()(Tree const&, Reference const&) const
+		{}
+	};
+
+	template <typename Tree>
+	void random_updates(std::mt19937& random, std::uint64_t range, int runs)
+	{
+		random_updates<Tree>(random, range, runs, ignore_version());
+	}
+}
+
+#endif
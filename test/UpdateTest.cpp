@@ -0,0 +1,118 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -I.. UpdateTest.cpp && ./a.out
+// and preferably again with -fsanitize=address.
+#include "SharedRadixTree.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+
+namespace
+{
+	typedef EML::SharedRadixTree<
+		std::uint32_t,
+		int,
+		EML::shared_radix_tree_detail::default_prefix<std::uint32_t>::type,
+		EML::shared_radix_tree_detail::default_mask<std::uint32_t>::type,
+		EML::single_threaded,
+		EML::new_allocator,
+		EML::uncounted,
+		EML::binary_nodes,
+		EML::atomic_metrics> tree_type;
+	typedef std::map<std::uint32_t, int> reference_type;
+
+	tree_type make_tree()
+	{
+		tree_type result;
+		for (std::uint32_t i = 0; i < 1000; ++i) {
+			result.insert(std::make_pair(i * 7919, 0));
+		}
+		return result;
+	}
+
+	/// Whether every node of `tree` is shared with another tree.
+	bool all_shared(tree_type const& tree)
+	{
+		auto stats = tree.stats();
+		return stats.fSharedBytes == stats.fBytes;
+	}
+
+	/// Updates of a copy that leave it unchanged copy nothing.
+	void test_unchanged()
+	{
+		auto tree = make_tree();
+		auto copy = tree;
+		EML::atomic_metrics::reset();
+		// Present keys.
+		assert(!copy.insert(std::make_pair(7919u, 1)).second);
+		assert(!copy.try_emplace(2 * 7919u, 1).second);
+		assert(!copy.emplace(3 * 7919u, 1).second);
+		// A key off every path, and one reaching a `leaf` with another key.
+		assert(copy.erase(0xffffffffu) == 0);
+		assert(copy.erase(7919u + 1) == 0);
+		assert(EML::atomic_metrics::get(EML::tree_event::branch_copy) == 0);
+		assert(EML::atomic_metrics::get(EML::tree_event::branch_create) == 0);
+		assert(EML::atomic_metrics::get(EML::tree_event::leaf_create) == 0);
+		assert(all_shared(copy));
+		assert(copy.size() == 1000 && copy.find(7919u)->second == 0);
+	}
+
+	/// The first update of a copy copies the path to its key.  Later
+	/// updates on that path find the copies unique to the copy and modify
+	/// them in place.
+	void test_batch()
+	{
+		auto tree = make_tree();
+		auto copy = tree;
+		EML::atomic_metrics::reset();
+		copy.insert(std::make_pair(1u, 1));
+		auto copied = EML::atomic_metrics::get(EML::tree_event::branch_copy);
+		assert(copied > 0);
+		assert(!all_shared(copy));
+		for (int i = 0; i < 10; ++i) {
+			copy.erase(1u);
+			copy.insert(std::make_pair(1u, i));
+		}
+		assert(EML::atomic_metrics::get(EML::tree_event::branch_copy) == copied);
+		assert(copy.size() == 1001 && copy.find(1u)->second == 9);
+		assert(tree.size() == 1000 && tree.find(1u) == tree.end());
+	}
+
+	/// Random updates of copies agree with `std::map`, and never disturb
+	/// the trees they were copied from.
+	void test_copies()
+	{
+		std::mt19937 random(17);
+		tree_type tree;
+		reference_type reference;
+		for (int run = 0; run < 100; ++run) {
+			auto copy = tree;
+			auto copyReference = reference;
+			for (int i = 0; i < 50; ++i) {
+				auto key = static_cast<std::uint32_t>(random() % 512);
+				if (random() % 3 == 0) {
+					assert(copy.erase(key) == static_cast<tree_type::size_type>(copyReference.erase(key)));
+				} else {
+					auto inserted = copy.insert(std::make_pair(key, i));
+					assert(inserted.second == copyReference.insert(std::make_pair(key, i)).second);
+					assert(inserted.first->first == key && inserted.first->second == copyReference[key]);
+				}
+			}
+			assert(reference_type(tree.begin(), tree.end()) == reference);
+			assert(reference_type(copy.begin(), copy.end()) == copyReference);
+			tree = copy;
+			reference = copyReference;
+		}
+	}
+}
+
+int main()
+{
+	test_unchanged();
+	test_batch();
+	test_copies();
+	std::cout << "ok" << std::endl;
+}
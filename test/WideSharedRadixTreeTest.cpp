@@ -0,0 +1,91 @@
+// Copyright 2015 The MathWorks, Inc.
+// Build and run with
+//   g++ -std=c++11 -I.. WideSharedRadixTreeTest.cpp && ./a.out
+// and preferably again with -fsanitize=address.
+#include "TestSupport.hpp"
+#include "WideSharedRadixTree.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <utility>
+
+namespace
+{
+	template <typename Key, unsigned Bits>
+	using tree_type = EML::SharedRadixTree<
+		Key,
+		int,
+		typename EML::shared_radix_tree_detail::default_prefix<Key>::type,
+		typename EML::shared_radix_tree_detail::default_mask<Key>::type,
+		EML::single_threaded,
+		EML::new_allocator,
+		EML::uncounted,
+		EML::wide_nodes<Bits>>;
+
+	template <typename Key, unsigned Bits>
+	void test_copies(std::uint64_t range)
+	{
+		std::mt19937 random(29);
+		test_support::random_updates<tree_type<Key, Bits>>(random, range, 100);
+	}
+
+	/// A tree with every key of a dense range, whose branches are full,
+	/// empties again as its keys are erased in another order.
+	template <unsigned Bits>
+	void test_dense()
+	{
+		typedef tree_type<std::uint32_t, Bits> tree;
+		tree version;
+		for (std::uint32_t key = 0; key < 4096; ++key) {
+			version.insert(std::make_pair(key, static_cast<int>(key)));
+		}
+		auto copy = version;
+		std::uint32_t expected = 0;
+		for (auto& value : copy) {
+			assert(value.first == expected && value.second == static_cast<int>(expected));
+			++expected;
+		}
+		assert(expected == 4096);
+		for (std::uint32_t key = 0; key < 4096; ++key) {
+			assert(copy.erase((key * 2654435761u) % 4096) == 1);
+		}
+		assert(copy.empty() && copy.size() == 0);
+		assert(version.size() == 4096 && version.find(4095)->second == 4095);
+	}
+
+	/// A tree moved from is empty with size 0, and swapping trees swaps
+	/// their contents.
+	void test_move()
+	{
+		typedef tree_type<std::uint32_t, 4> tree;
+		tree first;
+		for (std::uint32_t key = 0; key < 10; ++key) {
+			first.insert(std::make_pair(key, static_cast<int>(key)));
+		}
+		tree second(std::move(first));
+		assert(first.empty() && first.size() == 0 && first.begin() == first.end());
+		assert(second.size() == 10 && second.find(9u)->second == 9);
+
+		first.insert(std::make_pair(70u, 7));
+		first.swap(second);
+		assert(first.size() == 10 && second.size() == 1 && second.find(70u)->second == 7);
+		second = std::move(first);
+		assert(first.empty() && first.size() == 0);
+		assert(second.size() == 10 && second.find(0u)->second == 0);
+	}
+}
+
+int main()
+{
+	test_copies<std::uint32_t, 2>(1 << 12);
+	test_copies<std::uint32_t, 4>(1 << 20);
+	test_copies<std::uint32_t, 5>(0xffffffffu);
+	test_copies<std::uint64_t, 6>(1 << 16);
+	test_dense<2>();
+	test_dense<3>();
+	test_dense<6>();
+	test_move();
+	std::cout << "ok" << std::endl;
+}